@@ -6,14 +6,25 @@
 #define _DATAMODEL_HPP_
 
 #include <iostream>
+#include <vector>
 
 #include <Eigen/Core> /** Core methods of Eigen implementation **/
 #include <Eigen/Dense> /** for the algebra and transformation matrices **/
+#include <Eigen/StdVector> /** For STL container with Eigen types **/
 #include <localization/Configuration.hpp> /** For the localization framework constant and configuration values **/
 
 namespace localization	
 {
 
+    /** Criterion of the covariance intersection weight **/
+    enum IntersectionCriterion
+    {
+        /** minimum determinant of the fused covariance **/
+        MINIMUM_DETERMINANT = 0,
+        /** minimum trace of the fused covariance **/
+        MINIMUM_TRACE = 1
+    };
+
     /** Class for representing a 3D slip, linear or contact angle velocity vector and
      * its uncertainty in the estimation by Weighted Least-Squares**/
     template < typename _Scalar, int _DIM >
@@ -59,74 +70,154 @@ namespace localization
             return;
         }
 
+        /*@brief safe fusion of two estimates with unknown correlation
+         *
+         * In the basis where the covariance of this estimate is the identity
+         * and the one of data2 is diagonal, each component is taken from the
+         * estimate with the smaller variance. Both covariances are symmetric,
+         * the bases come from fixed size eigen decompositions and no matrix
+         * is inverted.
+         */
 	void safeFusion(const DataModel<_Scalar, _DIM> &data2)
         {
             DataModel &data1 (*this);
 
-            /** Variables for the safe fusion **/
-            Eigen::Matrix<_Scalar, _DIM, _DIM> I1, I2;
-            Eigen::Matrix<_Scalar, _DIM, _DIM> U1, sqrtD1, isqrtD1;
-            Eigen::Matrix<_Scalar, _DIM, _DIM> U2, D2;
-            Eigen::Matrix<_Scalar, _DIM, _DIM> D3;
-
-            Eigen::Matrix<_Scalar, _DIM, 1> result;
-            Eigen::Matrix<_Scalar, _DIM, 1> datatrans1, datatrans2;
-
-            D3.setZero();
-
-            I1 = data1.Cov.inverse();
-            I2 = data2.Cov.inverse();
-
-            /**
-            * Single Value Decomposition
-            */
-            Eigen::JacobiSVD < Eigen::MatrixXd > svdOfI1(I1, Eigen::ComputeThinU);
-
-            sqrtD1 = svdOfI1.singularValues().array().cwiseSqrt().matrix().asDiagonal();
-            U1 = svdOfI1.matrixU();
-
-        //     std::cout<<"sqrt(D1):\n"<<sqrtD1<<"\n";
-        //     std::cout<<"U1:\n"<<U1<<"\n";
+            Matrix iT;
+            Vector D2, datatrans1, datatrans2;
+            if (!jointDiagonalization(data2, iT, D2, datatrans1, datatrans2))
+            {
+                std::cerr << "[DATA_MODEL] covariance is not positive definite, no safe fusion" << std::endl;
+                return;
+            }
 
-            isqrtD1 = sqrtD1.inverse();
+            Vector result, D3;
+            for (register int i = 0; i < D2.size(); ++i)
+            {
+                if (D2[i] > 1.0)
+                {
+                    result[i] = datatrans1[i];
+                    D3[i] = 1.0;
+                }
+                else
+                {
+                    result[i] = datatrans2[i];
+                    D3[i] = D2[i];
+                }
+            }
 
-        //     std::cout<<"sqrt(D1)^-1:\n"<<isqrtD1<<"\n";
+            data1.data = iT * result;
+            data1.Cov = iT * D3.asDiagonal() * iT.transpose();
+        }
 
-            I2 = isqrtD1 * U1.transpose() * I2 * U1 * isqrtD1;
+        /*@brief covariance intersection with data2
+         *
+         * Fused information omega * Cov1^-1 + (1 - omega) * Cov2^-1 with the
+         * weight omega in [0, 1] minimizing the determinant or the trace of
+         * the fused covariance. Consistent for any unknown correlation.
+         *
+         * In the basis of safeFusion both informations are diagonal, the
+         * criterion and its derivatives cost O(_DIM) per Newton step of the
+         * weight after the two eigen decompositions.
+         *
+         * @param omega weight of this estimate
+         */
+	bool covarianceIntersection(const DataModel<_Scalar, _DIM> &data2, _Scalar &omega,
+                const IntersectionCriterion criterion = MINIMUM_DETERMINANT)
+        {
+            DataModel &data1 (*this);
 
-            Eigen::JacobiSVD <Eigen::MatrixXd > svdOfI2(I2, Eigen::ComputeThinU);
+            Matrix iT;
+            Vector D2, datatrans1, datatrans2;
+            if (!jointDiagonalization(data2, iT, D2, datatrans1, datatrans2))
+            {
+                std::cerr << "[DATA_MODEL] covariance is not positive definite, no covariance intersection" << std::endl;
+                return false;
+            }
 
-            D2 = svdOfI2.singularValues().array().matrix().asDiagonal();
-            U2 = svdOfI2.matrixU();
+            /** Fused information of each component b + omega * a **/
+            const Vector b (D2.cwiseInverse());
+            const Vector a (Vector::Ones() - b);
+            Vector weights;
+            if (criterion == MINIMUM_TRACE)
+                weights = iT.colwise().squaredNorm().transpose();
+            else
+                weights.setOnes();
+
+            /** Both criteria are convex in omega: the end points or Newton
+             * steps safeguarded by bisection **/
+            _Scalar slope, curvature;
+            intersectionSlope(0.0, a, b, weights, criterion, slope, curvature);
+            if (slope >= 0)
+                omega = 0.0;
+            else
+            {
+                intersectionSlope(1.0, a, b, weights, criterion, slope, curvature);
+                if (slope <= 0)
+                    omega = 1.0;
+                else
+                {
+                    _Scalar low = 0.0, high = 1.0;
+                    omega = 0.5;
+                    for (register int iteration = 0; iteration < 50; ++iteration)
+                    {
+                        intersectionSlope(omega, a, b, weights, criterion, slope, curvature);
+                        if (slope > 0)
+                            high = omega;
+                        else
+                            low = omega;
+
+                        _Scalar next = omega - slope / curvature;
+                        if (!(next > low && next < high))
+                            next = 0.5 * (low + high);
+
+                        const _Scalar step = next - omega;
+                        omega = next;
+                        if (std::abs(step) < 1e-09)
+                            break;
+                    }
+                }
+            }
 
-        //     std::cout<<"D2:\n"<<D2<<"\n";
+            const Vector D3 ((b + omega * a).cwiseInverse());
+            const Vector result (D3.cwiseProduct(omega * datatrans1 + (1.0 - omega) * b.cwiseProduct(datatrans2)));
 
-            Eigen::Matrix<_Scalar, 3, 3> T;
+            data1.data = iT * result;
+            data1.Cov = iT * D3.asDiagonal() * iT.transpose();
 
-            T = U2.transpose() * sqrtD1 * U1;
+            return true;
+        }
 
-            /** Safe transformation **/
-            datatrans1 = T * data1.data;
-            datatrans2 = T * data2.data;
+	bool covarianceIntersection(const DataModel<_Scalar, _DIM> &data2,
+                const IntersectionCriterion criterion = MINIMUM_DETERMINANT)
+        {
+            _Scalar omega;
+            return covarianceIntersection(data2, omega, criterion);
+        }
 
-            for (int i = 0; i<data1.data.size(); i++)
+        /*@brief covariance intersection of any number of estimates
+         *
+         * The inputs are intersected one after the other with the fusion of
+         * the previous ones. The joint weights of more than two inputs have
+         * no common diagonal basis, the sequential fusion keeps every step
+         * O(_DIM) and the result consistent.
+         */
+	static bool covarianceIntersection(const std::vector< DataModel, Eigen::aligned_allocator<DataModel> > &inputs,
+                DataModel &result, const IntersectionCriterion criterion = MINIMUM_DETERMINANT)
+        {
+            if (inputs.empty())
             {
-                if (D2(i,i) < 1.0)
-                {
-                    result[i] = datatrans1[i];
-                    D3(i,i) = 1.0;
-                }
-                else
-                {
-                    result[i] = datatrans2[i];
-                    D3(i,i) =  D2(i,i);
-                }
-
+                std::cerr << "[DATA_MODEL] no estimate to intersect" << std::endl;
+                return false;
             }
 
-            data1.data = T.inverse() * result;
-            data1.Cov = T.inverse() * D3.inverse() * T.inverse().transpose();
+            result = inputs[0];
+            for (register size_t i = 1; i < inputs.size(); ++i)
+            {
+                if (!result.covarianceIntersection(inputs[i], criterion))
+                    return false;
+            }
 
+            return true;
         }
 
 	DataModel operator+(const DataModel<_Scalar, _DIM> &data2) const
@@ -169,6 +260,213 @@ namespace localization
             return out;
         }
 
+    private:
+	typedef Eigen::Matrix<_Scalar, _DIM, 1> Vector;
+	typedef Eigen::Matrix<_Scalar, _DIM, _DIM> Matrix;
+
+        /*@brief basis T where Cov is the identity and data2.Cov the diagonal D2
+         *
+         * Cov = U1 * D1 * U1^T, D1^-1/2 * U1^T * data2.Cov * U1 * D1^-1/2 = U2 * D2 * U2^T
+         * and T = U2^T * D1^-1/2 * U1^T. Returns T^-1 = U1 * D1^1/2 * U2 and
+         * both data vectors in the basis, false if a covariance is not
+         * positive definite.
+         */
+	bool jointDiagonalization(const DataModel<_Scalar, _DIM> &data2, Matrix &iT, Vector &D2,
+                Vector &datatrans1, Vector &datatrans2) const
+        {
+            const Eigen::SelfAdjointEigenSolver<Matrix> eigenOfCov1 (Cov);
+            if (eigenOfCov1.info() != Eigen::Success || !(eigenOfCov1.eigenvalues().minCoeff() > 0))
+                return false;
+
+            const Matrix &U1 (eigenOfCov1.eigenvectors());
+            const Vector sqrtD1 (eigenOfCov1.eigenvalues().cwiseSqrt());
+            const Vector isqrtD1 (sqrtD1.cwiseInverse());
+
+            const Matrix Cov2 (isqrtD1.asDiagonal() * (U1.transpose() * data2.Cov * U1) * isqrtD1.asDiagonal());
+            const Eigen::SelfAdjointEigenSolver<Matrix> eigenOfCov2 (Cov2);
+            if (eigenOfCov2.info() != Eigen::Success || !(eigenOfCov2.eigenvalues().minCoeff() > 0))
+                return false;
+
+            const Matrix &U2 (eigenOfCov2.eigenvectors());
+            D2 = eigenOfCov2.eigenvalues();
+            datatrans1 = U2.transpose() * isqrtD1.cwiseProduct(U1.transpose() * data);
+            datatrans2 = U2.transpose() * isqrtD1.cwiseProduct(U1.transpose() * data2.data);
+            iT = U1 * sqrtD1.asDiagonal() * U2;
+
+            return true;
+        }
+
+        /*@brief first and second derivative in omega of the criterion of
+         * the covariance intersection, with the fused information b + omega * a
+         */
+	static void intersectionSlope(const _Scalar omega, const Vector &a, const Vector &b, const Vector &weights,
+                const IntersectionCriterion criterion, _Scalar &slope, _Scalar &curvature)
+        {
+            const Vector information (b + omega * a);
+            if (criterion == MINIMUM_TRACE)
+            {
+                /** sum of weights / information **/
+                const Vector variance (information.cwiseInverse());
+                slope = -(weights.cwiseProduct(a).cwiseProduct(variance.cwiseAbs2())).sum();
+                curvature = 2.0 * (weights.cwiseProduct(a.cwiseAbs2()).cwiseProduct(variance.cwiseAbs2().cwiseProduct(variance))).sum();
+            }
+            else
+            {
+                /** - sum of log(information) **/
+                const Vector ratio (a.cwiseQuotient(information));
+                slope = -ratio.sum();
+                curvature = ratio.squaredNorm();
+            }
+        }
+
+    };
+
+    namespace detail
+    {
+        /** Inverse of a symmetric positive definite matrix with the
+         * Cholesky factorization, false if it is not positive definite **/
+        template < typename _Matrix, bool _ClosedForm = (_Matrix::RowsAtCompileTime != Eigen::Dynamic && _Matrix::RowsAtCompileTime <= 4) >
+        struct SymmetricInverse
+        {
+            static bool run(const _Matrix &matrix, _Matrix &inverse)
+            {
+                const Eigen::LLT<_Matrix> llt (matrix);
+                if (llt.info() != Eigen::Success)
+                    return false;
+
+                inverse = llt.solve(_Matrix::Identity(matrix.rows(), matrix.cols()));
+                return true;
+            }
+        };
+
+        /** Sylvester's criterion on the leading principal minors of size
+         * 1 to _Size, in closed form **/
+        template < typename _Matrix, int _Size = _Matrix::RowsAtCompileTime - 1 >
+        struct LeadingMinorsPositive
+        {
+            static bool run(const _Matrix &matrix)
+            {
+                return matrix.template topLeftCorner<_Size, _Size>().determinant() > 0
+                    && LeadingMinorsPositive<_Matrix, _Size - 1>::run(matrix);
+            }
+        };
+
+        template < typename _Matrix >
+        struct LeadingMinorsPositive<_Matrix, 0>
+        {
+            static bool run(const _Matrix &) { return true; }
+        };
+
+        /** Closed form cofactors up to 4x4, faster than the factorization.
+         * The matrix is positive definite when its determinant and all its
+         * smaller leading principal minors are positive. There is no
+         * absolute threshold on the determinant, small covariances are
+         * valid **/
+        template < typename _Matrix >
+        struct SymmetricInverse<_Matrix, true>
+        {
+            static bool run(const _Matrix &matrix, _Matrix &inverse)
+            {
+                if (!(matrix.determinant() > 0) || !LeadingMinorsPositive<_Matrix>::run(matrix))
+                    return false;
+
+                inverse = matrix.inverse();
+                return true;
+            }
+        };
+    }
+
+    /** Fusion of any number of DataModel estimates in information form.
+     *
+     * The information matrices Cov^-1 and vectors Cov^-1 * data of the
+     * inputs are summed up and the result is solved once at the end, the
+     * same as pairwise DataModel::fusion of all the inputs with one inverse
+     * per input and one for the result instead of three per pair.
+     */
+    template < typename _Scalar, int _DIM >
+    class DataModelFusion
+    {
+
+    public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	typedef Eigen::Matrix<_Scalar, _DIM, 1> Vector;
+	typedef Eigen::Matrix<_Scalar, _DIM, _DIM> Matrix;
+
+    public:
+
+	DataModelFusion()
+        {
+            reset();
+        }
+
+        /*@brief starts a new fusion
+         */
+	void reset()
+        {
+            information.setZero();
+            information_vector.setZero();
+            number_inputs = 0;
+        }
+
+        /*@brief adds one estimate, false if its covariance cannot be inverted
+         */
+	bool add(const DataModel<_Scalar, _DIM> &input)
+        {
+            Matrix input_information;
+            if (!detail::SymmetricInverse<Matrix>::run(input.Cov, input_information))
+            {
+                std::cerr << "[DATA_MODEL] covariance of the input " << number_inputs << " cannot be inverted" << std::endl;
+                return false;
+            }
+
+            information += input_information;
+            information_vector += input_information * input.data;
+            ++number_inputs;
+
+            return true;
+        }
+
+        /*@brief adds an estimate given in information form
+         */
+	void addInformation(const Matrix &input_information, const Vector &input_information_vector)
+        {
+            information += input_information;
+            information_vector += input_information_vector;
+            ++number_inputs;
+        }
+
+        /*@brief fused estimate of the inputs added so far, false if there is none
+         */
+	bool result(DataModel<_Scalar, _DIM> &fused) const
+        {
+            if (number_inputs == 0)
+            {
+                std::cerr << "[DATA_MODEL] no estimate to fuse" << std::endl;
+                return false;
+            }
+
+            Matrix cov;
+            if (!detail::SymmetricInverse<Matrix>::run(information, cov))
+            {
+                std::cerr << "[DATA_MODEL] fused information cannot be inverted" << std::endl;
+                return false;
+            }
+
+            fused.data = cov * information_vector;
+            fused.Cov = cov;
+
+            return true;
+        }
+
+	unsigned int size() const { return number_inputs; }
+
+	const Matrix& getInformation() const { return information; }
+	const Vector& getInformationVector() const { return information_vector; }
+
+    private:
+	Matrix information; //! sum of the information matrices
+	Vector information_vector; //! sum of the information vectors
+	unsigned int number_inputs;
     };
 }
 
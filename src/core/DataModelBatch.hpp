@@ -0,0 +1,384 @@
+/**\file DataModelBatch.hpp
+ * Header function file and defines
+ */
+
+#ifndef _DATAMODEL_BATCH_HPP_
+#define _DATAMODEL_BATCH_HPP_
+
+#include <iostream>
+
+#include <Eigen/Core> /** Core methods of Eigen implementation **/
+#include <localization/core/DataModel.hpp> /** Single data vector and covariance **/
+
+namespace localization
+{
+
+    /** Class for representing _N data vectors of DataModel, e.g. one per
+     * wheel, in structure of arrays layout.
+     *
+     * data has one column per component and Cov one column per coefficient
+     * of the column-major _DIM x _DIM covariance. Row i belongs to the i-th
+     * element. The operations run over the columns, all the elements at
+     * once, and give the same as DataModel on each element.
+     */
+    template < typename _Scalar, int _DIM, int _N >
+    class DataModelBatch
+    {
+
+    public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	typedef Eigen::Matrix<_Scalar, _N, _DIM> Data;
+	typedef Eigen::Matrix<_Scalar, _N, _DIM*_DIM> Covariances;
+
+	Data data; //! data vectors, one per row
+	Covariances Cov; //! covariance matrices, one per row
+
+    public:
+
+        /*@brief constructor, same initial values as DataModel
+         */
+	DataModelBatch()
+        {
+            data.setZero();
+            Cov.setZero();
+            for (register int i = 0; i < _DIM; ++i)
+                Cov.col(i + _DIM*i).setConstant(localization::ZERO_UNCERTAINTY);
+        }
+
+	inline int size () const
+        {
+            return _N;
+        }
+
+	void set(const int i, const DataModel<_Scalar, _DIM> &model)
+        {
+            data.row(i) = model.data.transpose();
+            for (register int c = 0; c < _DIM; ++c)
+                for (register int r = 0; r < _DIM; ++r)
+                    Cov(i, r + _DIM*c) = model.Cov(r, c);
+        }
+
+	DataModel<_Scalar, _DIM> get(const int i) const
+        {
+            DataModel<_Scalar, _DIM> model;
+            model.data = data.row(i).transpose();
+            for (register int c = 0; c < _DIM; ++c)
+                for (register int r = 0; r < _DIM; ++r)
+                    model.Cov(r, c) = Cov(i, r + _DIM*c);
+            return model;
+        }
+
+        /*@brief DataModel::fusion of every element with the one of data2.
+         *
+         * In the form x1 + C1 (C1 + C2)^-1 (x2 - x1), C1 - C1 (C1 + C2)^-1 C1
+         * with one Cholesky factorization per element instead of three
+         * inverses. Elements with a non positive definite C1 + C2 are left
+         * unchanged and false is returned.
+         */
+	bool fusion(const DataModelBatch<_Scalar, _DIM, _N> &data2)
+        {
+            LaneMatrix C1, S, L, Y;
+            load(Cov, C1);
+            load(data2.Cov, S);
+            for (register int r = 0; r < _DIM; ++r)
+                for (register int c = 0; c < _DIM; ++c)
+                    S.c[r][c] += C1.c[r][c];
+
+            /** S = L * L^T **/
+            Mask valid (Mask::Constant(true));
+            for (register int j = 0; j < _DIM; ++j)
+            {
+                Lanes d (S.c[j][j]);
+                for (register int k = 0; k < j; ++k)
+                    d -= L.c[j][k].square();
+                valid = valid && (d > 0);
+                L.c[j][j] = d.sqrt();
+
+                for (register int i = j+1; i < _DIM; ++i)
+                {
+                    Lanes e (S.c[i][j]);
+                    for (register int k = 0; k < j; ++k)
+                        e -= L.c[i][k] * L.c[j][k];
+                    L.c[i][j] = e / L.c[j][j];
+                }
+            }
+
+            /** Y = S^-1 * C1, by forward and back substitution of each column **/
+            for (register int c = 0; c < _DIM; ++c)
+            {
+                for (register int i = 0; i < _DIM; ++i)
+                {
+                    Lanes z (C1.c[i][c]);
+                    for (register int k = 0; k < i; ++k)
+                        z -= L.c[i][k] * Y.c[k][c];
+                    Y.c[i][c] = z / L.c[i][i];
+                }
+                for (register int i = _DIM-1; i >= 0; --i)
+                {
+                    Lanes y (Y.c[i][c]);
+                    for (register int k = i+1; k < _DIM; ++k)
+                        y -= L.c[k][i] * Y.c[k][c];
+                    Y.c[i][c] = y / L.c[i][i];
+                }
+            }
+
+            Lanes residual[_DIM];
+            for (register int k = 0; k < _DIM; ++k)
+                residual[k] = data2.data.col(k).array() - data.col(k).array();
+
+            for (register int i = 0; i < _DIM; ++i)
+            {
+                Lanes x (data.col(i).array());
+                for (register int k = 0; k < _DIM; ++k)
+                    x += Y.c[k][i] * residual[k];
+                data.col(i) = valid.select(x, data.col(i).array()).matrix();
+            }
+
+            for (register int i = 0; i < _DIM; ++i)
+            {
+                for (register int j = i; j < _DIM; ++j)
+                {
+                    Lanes p (C1.c[i][j]);
+                    for (register int k = 0; k < _DIM; ++k)
+                        p -= C1.c[i][k] * Y.c[k][j];
+                    p = valid.select(p, C1.c[i][j]);
+                    Cov.col(i + _DIM*j) = p.matrix();
+                    Cov.col(j + _DIM*i) = p.matrix();
+                }
+            }
+
+            return checkValid(valid, "fusion");
+        }
+
+        /*@brief DataModel::safeFusion of every element with the one of data2.
+         *
+         * The eigen decompositions are cyclic Jacobi sweeps run on all the
+         * elements at once. Elements with a non positive definite
+         * covariance are left unchanged and false is returned.
+         */
+	bool safeFusion(const DataModelBatch<_Scalar, _DIM, _N> &data2)
+        {
+            LaneMatrix C1, C2, U1, M, U2, iT;
+            load(Cov, C1);
+            load(data2.Cov, C2);
+
+            /** Cov1 = U1 * D1 * U1^T **/
+            LaneMatrix D1 (C1);
+            jacobi(D1, U1);
+
+            Mask valid (Mask::Constant(true));
+            Lanes sqrtD1[_DIM], isqrtD1[_DIM];
+            for (register int i = 0; i < _DIM; ++i)
+            {
+                valid = valid && (D1.c[i][i] > 0);
+                sqrtD1[i] = D1.c[i][i].sqrt();
+                isqrtD1[i] = sqrtD1[i].inverse();
+            }
+
+            /** Cov2 in the basis of Cov1 scaled to the identity **/
+            for (register int j = 0; j < _DIM; ++j)
+            {
+                Lanes C2U1[_DIM];
+                for (register int k = 0; k < _DIM; ++k)
+                {
+                    C2U1[k] = Lanes::Zero();
+                    for (register int l = 0; l < _DIM; ++l)
+                        C2U1[k] += C2.c[k][l] * U1.c[l][j];
+                }
+                for (register int i = 0; i <= j; ++i)
+                {
+                    Lanes m (Lanes::Zero());
+                    for (register int k = 0; k < _DIM; ++k)
+                        m += U1.c[k][i] * C2U1[k];
+                    M.c[i][j] = m * isqrtD1[i] * isqrtD1[j];
+                    M.c[j][i] = M.c[i][j];
+                }
+            }
+            jacobi(M, U2);
+
+            /** Safe transformation T = U2^T * D1^-1/2 * U1^T **/
+            Lanes y1[_DIM], y2[_DIM], result[_DIM], D3[_DIM];
+            for (register int i = 0; i < _DIM; ++i)
+            {
+                y1[i] = Lanes::Zero();
+                y2[i] = Lanes::Zero();
+                for (register int k = 0; k < _DIM; ++k)
+                {
+                    y1[i] += U1.c[k][i] * data.col(k).array();
+                    y2[i] += U1.c[k][i] * data2.data.col(k).array();
+                }
+                y1[i] *= isqrtD1[i];
+                y2[i] *= isqrtD1[i];
+            }
+            for (register int i = 0; i < _DIM; ++i)
+            {
+                Lanes datatrans1 (Lanes::Zero()), datatrans2 (Lanes::Zero());
+                for (register int k = 0; k < _DIM; ++k)
+                {
+                    datatrans1 += U2.c[k][i] * y1[k];
+                    datatrans2 += U2.c[k][i] * y2[k];
+                }
+                const Lanes &D2 (M.c[i][i]);
+                valid = valid && (D2 > 0);
+                result[i] = (D2 > 1.0).select(datatrans1, datatrans2);
+                D3[i] = (D2 > 1.0).select(Lanes::Ones(), D2);
+            }
+
+            /** Back with T^-1 = U1 * D1^1/2 * U2 **/
+            for (register int i = 0; i < _DIM; ++i)
+            {
+                for (register int j = 0; j < _DIM; ++j)
+                {
+                    iT.c[i][j] = Lanes::Zero();
+                    for (register int k = 0; k < _DIM; ++k)
+                        iT.c[i][j] += U1.c[i][k] * sqrtD1[k] * U2.c[k][j];
+                }
+            }
+
+            for (register int i = 0; i < _DIM; ++i)
+            {
+                Lanes x (Lanes::Zero());
+                for (register int k = 0; k < _DIM; ++k)
+                    x += iT.c[i][k] * result[k];
+                data.col(i) = valid.select(x, data.col(i).array()).matrix();
+            }
+
+            for (register int i = 0; i < _DIM; ++i)
+            {
+                for (register int j = i; j < _DIM; ++j)
+                {
+                    Lanes p (Lanes::Zero());
+                    for (register int k = 0; k < _DIM; ++k)
+                        p += iT.c[i][k] * D3[k] * iT.c[j][k];
+                    p = valid.select(p, C1.c[i][j]);
+                    Cov.col(i + _DIM*j) = p.matrix();
+                    Cov.col(j + _DIM*i) = p.matrix();
+                }
+            }
+
+            return checkValid(valid, "safe fusion");
+        }
+
+	DataModelBatch operator+(const DataModelBatch<_Scalar, _DIM, _N> &data2) const
+        {
+            DataModelBatch result;
+
+            result.data = data + data2.data;
+            result.Cov = Cov + data2.Cov;
+
+            return result;
+        }
+
+	DataModelBatch operator-(const DataModelBatch<_Scalar, _DIM, _N> &data2) const
+        {
+            DataModelBatch result;
+
+            result.data = data - data2.data;
+            result.Cov = Cov + data2.Cov;
+
+            return result;
+        }
+
+        /** Default std::cout function
+        */
+        friend std::ostream & operator<<(std::ostream &out, const DataModelBatch<_Scalar, _DIM, _N> &m1)
+        {
+            out <<"\n" << m1.data << "\n";
+            out <<"\n" << m1.Cov << "\n";
+
+            return out;
+        }
+
+    private:
+	typedef Eigen::Array<_Scalar, _N, 1> Lanes;
+	typedef Eigen::Array<bool, _N, 1> Mask;
+
+        /** _DIM x _DIM matrices of all the elements, one array per coefficient **/
+	struct LaneMatrix
+	{
+	    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	    Lanes c[_DIM][_DIM];
+	};
+
+	static void load(const Covariances &cov, LaneMatrix &matrix)
+        {
+            for (register int c = 0; c < _DIM; ++c)
+                for (register int r = 0; r < _DIM; ++r)
+                    matrix.c[r][c] = cov.col(r + _DIM*c).array();
+        }
+
+        /*@brief eigen decomposition A = V * D * V^T of symmetric matrices.
+         *
+         * Cyclic Jacobi rotations applied to all the elements at once, A is
+         * replaced by D. The sweeps stop when the off diagonal of every
+         * element is negligible.
+         */
+	static void jacobi(LaneMatrix &A, LaneMatrix &V)
+        {
+            const _Scalar eps2 = Eigen::NumTraits<_Scalar>::epsilon() * Eigen::NumTraits<_Scalar>::epsilon();
+            const int max_sweeps = 16;
+
+            for (register int r = 0; r < _DIM; ++r)
+                for (register int c = 0; c < _DIM; ++c)
+                    V.c[r][c] = (r == c)? Lanes::Ones() : Lanes::Zero();
+
+            for (register int sweep = 0; sweep < max_sweeps; ++sweep)
+            {
+                Lanes off (Lanes::Zero()), diagonal (Lanes::Zero());
+                for (register int p = 0; p < _DIM; ++p)
+                {
+                    diagonal += A.c[p][p].square();
+                    for (register int q = p+1; q < _DIM; ++q)
+                        off += A.c[p][q].square();
+                }
+                if ((off <= eps2 * diagonal).all())
+                    break;
+
+                for (register int p = 0; p < _DIM; ++p)
+                {
+                    for (register int q = p+1; q < _DIM; ++q)
+                    {
+                        /** Rotation that zeroes A(p,q), none where it is zero already **/
+                        const Lanes apq (A.c[p][q]);
+                        const Lanes theta ((A.c[q][q] - A.c[p][p]) / (2.0 * apq));
+                        const Lanes t ((apq == 0).select(Lanes::Zero(),
+                                    (theta >= 0).select(Lanes::Ones(), -Lanes::Ones()) / (theta.abs() + (theta.square() + 1.0).sqrt())));
+                        const Lanes cs ((t.square() + 1.0).rsqrt());
+                        const Lanes sn (t * cs);
+
+                        A.c[p][p] -= t * apq;
+                        A.c[q][q] += t * apq;
+                        A.c[p][q] = Lanes::Zero();
+                        A.c[q][p] = Lanes::Zero();
+                        for (register int k = 0; k < _DIM; ++k)
+                        {
+                            if (k != p && k != q)
+                            {
+                                const Lanes akp (A.c[k][p]), akq (A.c[k][q]);
+                                A.c[k][p] = cs * akp - sn * akq;
+                                A.c[k][q] = sn * akp + cs * akq;
+                                A.c[p][k] = A.c[k][p];
+                                A.c[q][k] = A.c[k][q];
+                            }
+                            const Lanes vkp (V.c[k][p]), vkq (V.c[k][q]);
+                            V.c[k][p] = cs * vkp - sn * vkq;
+                            V.c[k][q] = sn * vkp + cs * vkq;
+                        }
+                    }
+                }
+            }
+        }
+
+	static bool checkValid(const Mask &valid, const char *operation)
+        {
+            if (valid.all())
+                return true;
+
+            std::cerr << "[DATA_MODEL] " << (_N - valid.count()) << " of " << _N
+                << " covariances are not positive definite, no " << operation << " for them" << std::endl;
+            return false;
+        }
+    };
+}
+
+#endif
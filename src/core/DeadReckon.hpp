@@ -9,7 +9,10 @@
 #include <Eigen/Dense> /** for the algebra and transformation matrices **/
 #include <Eigen/Geometry> /** Eigen data type for Matrix, Quaternion, etc... */
 #include <Eigen/StdVector> /** For STL container with Eigen types **/
+#include <vector>
+#include <algorithm> /** std::upper_bound of the velocity samples **/
 #include <localization/core/Transform.hpp> /** Envire module which has transformation with uncertainty **/
+#include <localization/core/TransformImpl.hpp> /** Closed form SO(3) Jacobians **/
 #include <localization/Configuration.hpp> /** For the localization framework constant and configuration values **/
 #include <base/Matrix.hpp>
 
@@ -17,6 +20,105 @@
 
 namespace localization	
 {
+    namespace detail
+    {
+        /** \Brief Adjoint of trans^-1 in [rotation translation] order
+         */
+        inline Eigen::Matrix<double, 6, 6> se3_adjoint_inverse(const Eigen::Affine3d &trans)
+        {
+            const Eigen::Matrix3d Rt (trans.linear().transpose());
+            Eigen::Matrix<double, 6, 6> Ad;
+            Ad << Rt, Eigen::Matrix3d::Zero(),
+               -Rt * skew_symmetric(Eigen::Vector3d(trans.translation())), Rt;
+            return Ad;
+        }
+
+        /** \Brief Maps a change of [r t] to the tangent space of trans
+         */
+        inline Eigen::Matrix<double, 6, 6> se3_to_tangent(const Eigen::Affine3d &trans)
+        {
+            const Eigen::Quaterniond q (trans.linear());
+            Eigen::Matrix<double, 6, 6> M (Eigen::Matrix<double, 6, 6>::Zero());
+            M.block<3,3>(0,0) = so3_right_jacobian(q_to_r(q));
+            M.block<3,3>(3,3) = trans.linear().transpose();
+            return M;
+        }
+
+        /** \Brief Inverse of se3_to_tangent
+         */
+        inline Eigen::Matrix<double, 6, 6> se3_from_tangent(const Eigen::Affine3d &trans)
+        {
+            const Eigen::Quaterniond q (trans.linear());
+            Eigen::Matrix<double, 6, 6> M_inv (Eigen::Matrix<double, 6, 6>::Zero());
+            M_inv.block<3,3>(0,0) = so3_right_jacobian_inverse(q_to_r(q));
+            M_inv.block<3,3>(3,3) = trans.linear();
+            return M_inv;
+        }
+    }
+
+    /** \Brief Linear interpolation of body velocity samples
+     *
+     * Velocity callable of DeadReckon::updatePoseAdaptive. The samples are
+     * pushed in increasing time, the velocity is constant outside of them.
+     */
+    class VelocityInterpolation
+    {
+
+    public:
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef Eigen::Matrix<double, 6, 1> Velocity;
+        typedef Eigen::Matrix<double, 6, 6> Covariance;
+
+    public:
+
+        void push(const double time, const Velocity &velocity, const Covariance &cov)
+        {
+            times.push_back(time);
+            velocities.push_back(velocity);
+            covariances.push_back(cov);
+        }
+
+        void clear()
+        {
+            times.clear();
+            velocities.clear();
+            covariances.clear();
+        }
+
+        size_t size() const { return times.size(); }
+
+        /** \Brief velocity and covariance at time t, zero without samples **/
+        void operator()(const double t, Velocity &velocity, Covariance &cov) const
+        {
+            if (times.empty())
+            {
+                velocity.setZero();
+                cov.setZero();
+                return;
+            }
+
+            const std::vector<double>::const_iterator it = std::upper_bound(times.begin(), times.end(), t);
+            if (it == times.begin() || it == times.end())
+            {
+                const size_t i = (it == times.begin())? 0 : times.size() - 1;
+                velocity = velocities[i];
+                cov = covariances[i];
+                return;
+            }
+
+            const size_t i = it - times.begin();
+            const double alpha = (t - times[i-1]) / (times[i] - times[i-1]);
+            velocity = (1.0 - alpha) * velocities[i-1] + alpha * velocities[i];
+            cov = (1.0 - alpha) * covariances[i-1] + alpha * covariances[i];
+        }
+
+    private:
+        std::vector<double> times;
+        std::vector< Velocity, Eigen::aligned_allocator<Velocity> > velocities;
+        std::vector< Covariance, Eigen::aligned_allocator<Covariance> > covariances;
+    };
 
     /** Class to perform Dead Reckoning assuming constant acceleration **/
     class DeadReckon
@@ -26,6 +128,16 @@ namespace localization
 	
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
+        /** Integration scheme of updateAttitude **/
+        enum AttitudeIntegration
+        {
+            /** third order series of 4x4 angular velocity matrices **/
+            QUATERNION_SERIES = 0,
+            /** closed form quaternion exponential of the rotation vector
+             * with the coning (commutation) correction **/
+            QUATERNION_EXPONENTIAL = 1
+        };
+
     public:
 
         static TransformWithUncertainty updatePose (const double delta_t,
@@ -33,30 +145,41 @@ namespace localization
                                         const Eigen::Matrix <double, 6, 6> &cartesianVelCov,
                                         const TransformWithUncertainty &prevPose, TransformWithUncertainty &postPose)
         {
-            /** Calculate the delta quaternion **/
-            std::vector< Eigen::Vector3d, Eigen::aligned_allocator< Eigen::Vector3d > > angularVelocities (cartesianVelocities.size(), Eigen::Vector3d::Zero());
-            angularVelocities[0] = cartesianVelocities[0].block<3, 1> (3, 0);
-            angularVelocities[1] = cartesianVelocities[1].block<3, 1> (3, 0);
+            return updatePose(delta_t, cartesianVelocities[0], cartesianVelocities[1], cartesianVelCov, prevPose, postPose);
+        }
 
-            Eigen::Quaterniond deltaq = updateAttitude(delta_t, angularVelocities);
+        /** \Brief Fixed size form of the dead reckoning step, without heap allocations
+         *
+         * @param currentVelocity current [v w] in body frame (cartesianVelocities[0])
+         * @param previousVelocity previous [v w] in body frame (cartesianVelocities[1])
+         *
+         * @return delta pose of the change in pose
+         */
+        static TransformWithUncertainty updatePose (const double delta_t,
+                                        const Eigen::Matrix <double, 6, 1> &currentVelocity,
+                                        const Eigen::Matrix <double, 6, 1> &previousVelocity,
+                                        const Eigen::Matrix <double, 6, 6> &cartesianVelCov,
+                                        const TransformWithUncertainty &prevPose, TransformWithUncertainty &postPose)
+        {
+            /** Calculate the delta quaternion **/
+            Eigen::Quaterniond deltaq = updateAttitude(delta_t, Eigen::Vector3d(currentVelocity.block<3, 1> (3, 0)),
+                                                    Eigen::Vector3d(previousVelocity.block<3, 1> (3, 0)));
 
             /** Delta transformation **/
             Eigen::Affine3d deltaTrans;
             deltaTrans = deltaq;
-            deltaTrans.translation() = (delta_t/2.0) * (cartesianVelocities[0].block<3,1> (0,0) + cartesianVelocities[1].block<3,1>(0,0));
+            deltaTrans.translation() = (delta_t/2.0) * (currentVelocity.block<3,1> (0,0) + previousVelocity.block<3,1>(0,0));
 
             /** Delta pose uncertainty (top left corner for orientation, bottom right corner for position) **/
             Eigen::Matrix<double, 6, 6> deltaPoseCov(Eigen::Matrix<double, 6, 6>::Zero());
             deltaPoseCov.block<3,3>(0,0) = cartesianVelCov.block<3,3> (3,3) * delta_t * delta_t;
             deltaPoseCov.block<3,3>(3,3) = cartesianVelCov.block<3,3> (0,0) * delta_t * delta_t;
-            Eigen::LLT< Eigen::Matrix<double, 6, 6> > llt(deltaPoseCov);
-            Eigen::Matrix<double, 6, 6> deltaPoseStd = llt.matrixL();
-            TransformWithUncertainty deltaPose (deltaTrans, deltaPoseStd * deltaPoseStd.transpose());
+            TransformWithUncertainty deltaPose (deltaTrans, deltaPoseCov);
 
             #ifdef DEAD_RECKON_DEBUG_PRINTS
             std::cout<<"[DR] **** delta_t: "<<delta_t<<"\n";
-            std::cout<<"[DR] cartesianVelocities[0]:\n"<<cartesianVelocities[0]<<"\n";
-            std::cout<<"[DR] cartesianVelocities[1]:\n"<<cartesianVelocities[1]<<"\n";
+            std::cout<<"[DR] currentVelocity:\n"<<currentVelocity<<"\n";
+            std::cout<<"[DR] previousVelocity:\n"<<previousVelocity<<"\n";
             std::cout<<"[DR] deltaPose\n" <<deltaPose.getTransform().matrix()<<"\n";
             std::cout<<"[DR] deltaPoseCov\n" <<deltaPose.getCovariance()<<"\n";
             Eigen::Matrix <double,localization::NUMAXIS,1> euler; /** In euler angles **/
@@ -74,7 +197,8 @@ namespace localization
 
 
             /** Dead reckon delta step **/
-            postPose = prevPose * deltaPose;
+            postPose = prevPose;
+            postPose *= deltaPose;
 
             return deltaPose;
         }
@@ -133,30 +257,41 @@ namespace localization
                             const base::samples::RigidBodyState &prevPose,
                             base::samples::RigidBodyState &postPose,
                             bool useTranforWithUncertainty = false)
+        {
+            return updatePose(delta_t, cartesianVelocities[0], cartesianVelocities[1], cartesianVelCov,
+                    prevPose, postPose, useTranforWithUncertainty);
+        }
+
+	/** \Brief Fixed size form of the time integration, without heap allocations
+	 *
+	 * @param currentVelocity current [v w] in body frame (cartesianVelocities[0])
+	 * @param previousVelocity previous [v w] in body frame (cartesianVelocities[1])
+	 *
+	 * @return delta pose of the change in pose
+	 */
+	static base::samples::RigidBodyState updatePose(const double delta_t,
+                            const Eigen::Matrix <double, 6, 1> &currentVelocity,
+                            const Eigen::Matrix <double, 6, 1> &previousVelocity,
+                            const Eigen::Matrix <double, 6, 6> &cartesianVelCov,
+                            const base::samples::RigidBodyState &prevPose,
+                            base::samples::RigidBodyState &postPose,
+                            bool useTranforWithUncertainty = false)
         {
             base::samples::RigidBodyState deltaPose; /** rbs form of the computation **/
-            TransformWithUncertainty tfDeltaPose; /** delta transformation between current pose and next pose **/
-            TransformWithUncertainty tfPrevPose; /** Previous pose**/
-            TransformWithUncertainty tfPostPose; /** Posterior pose **/
 
             /** Form the delta pose **/
             deltaPose.invalidate();
 
             /** Calculate the delta position from velocity (dead reckoning) assuming constant acceleration **/
-            deltaPose.position = (delta_t/2.0) * (cartesianVelocities[0].block<NUMAXIS,1> (0,0) + cartesianVelocities[1].block<NUMAXIS,1>(0,0));
+            deltaPose.position = (delta_t/2.0) * (currentVelocity.block<NUMAXIS,1> (0,0) + previousVelocity.block<NUMAXIS,1>(0,0));
 
-            deltaPose.velocity = cartesianVelocities[0].block<NUMAXIS,1> (0,0);
-            deltaPose.angular_velocity = cartesianVelocities[0].block<NUMAXIS,1> (NUMAXIS,0);
+            deltaPose.velocity = currentVelocity.block<NUMAXIS,1> (0,0);
+            deltaPose.angular_velocity = currentVelocity.block<NUMAXIS,1> (NUMAXIS,0);
 
             /** Calculate the delta quaternion **/
-            std::vector< Eigen::Matrix < double, NUMAXIS, 1 > , Eigen::aligned_allocator
-                < Eigen::Matrix <double, NUMAXIS, 1> > > angularVelocities (cartesianVelocities.size(), Eigen::Matrix < double, NUMAXIS, 1 >::Zero());
-            Eigen::Matrix < double, NUMAXIS, NUMAXIS > angularVelCov;
-            angularVelocities[0] = cartesianVelocities[0].block<NUMAXIS, 1> (NUMAXIS, 0);
-            angularVelocities[1] = cartesianVelocities[1].block<NUMAXIS, 1> (NUMAXIS, 0);
-            angularVelCov = cartesianVelCov.block<NUMAXIS, NUMAXIS> (NUMAXIS, NUMAXIS);
-
-            deltaPose.orientation = updateAttitude(delta_t, angularVelocities, angularVelCov);
+            Eigen::Matrix < double, NUMAXIS, NUMAXIS > angularVelCov (cartesianVelCov.block<NUMAXIS, NUMAXIS> (NUMAXIS, NUMAXIS));
+            deltaPose.orientation = updateAttitude(delta_t, Eigen::Vector3d(currentVelocity.block<NUMAXIS, 1> (NUMAXIS, 0)),
+                                                Eigen::Vector3d(previousVelocity.block<NUMAXIS, 1> (NUMAXIS, 0)), angularVelCov);
 
             /** Set the uncertainty matrices **/
             if (base::isnotnan(cartesianVelCov))
@@ -175,8 +310,8 @@ namespace localization
 
             #ifdef DEAD_RECKON_DEBUG_PRINTS
             std::cout<<"[DR] delta_t: "<<delta_t<<"\n";
-            std::cout<<"[DR] cartesianVelocities[0]:\n"<<cartesianVelocities[0]<<"\n";
-            std::cout<<"[DR] cartesianVelocities[1]:\n"<<cartesianVelocities[1]<<"\n";
+            std::cout<<"[DR] currentVelocity:\n"<<currentVelocity<<"\n";
+            std::cout<<"[DR] previousVelocity:\n"<<previousVelocity<<"\n";
             std::cout<<"[DR] deltaPose.position\n" <<deltaPose.position<<"\n";
             std::cout<<"[DR] deltaPose.cov_position\n" <<deltaPose.cov_position<<"\n";
             Eigen::Matrix <double,localization::NUMAXIS,1> euler; /** In euler angles **/
@@ -196,17 +331,8 @@ namespace localization
 
             if (useTranforWithUncertainty)
             {
-                /** Prev Pose in TF form **/
-                tfPrevPose = prevPose;
-
-                /** Create the transformation from the delta position and the actual position **/
-                tfDeltaPose = deltaPose;
-
-                /** To perform the transformation **/
-                tfPostPose = tfPrevPose * tfDeltaPose;
-
-                /** Fill the rigid body state **/
-                tfPostPose.copyToRigidBodyState(postPose);
+                /** Compose the rigid body states directly, same as in TransformWithUncertainty form **/
+                localization::composition(prevPose, deltaPose, postPose);
             }
             else
             {
@@ -218,13 +344,13 @@ namespace localization
             }
 
             /** Update the velocity information in the posterior **/
-            postPose.velocity = cartesianVelocities[0].block<NUMAXIS, 1> (0,0); //!Velocity in body frame
+            postPose.velocity = currentVelocity.block<NUMAXIS, 1> (0,0); //!Velocity in body frame
             postPose.cov_velocity = cartesianVelCov.block<NUMAXIS, NUMAXIS> (0,0);
-            postPose.angular_velocity = cartesianVelocities[0].block<NUMAXIS, 1> (NUMAXIS, 0);
+            postPose.angular_velocity = currentVelocity.block<NUMAXIS, 1> (NUMAXIS, 0);
             postPose.cov_angular_velocity = cartesianVelCov.block<NUMAXIS, NUMAXIS> (NUMAXIS, NUMAXIS);
 
             #ifdef DEAD_RECKON_DEBUG_PRINTS
-            std::cout<<"[DR] Distance\n"<<postPose.orientation * cartesianVelocities[0].block<NUMAXIS, 1> (0,0) * delta_t << "\n";
+            std::cout<<"[DR] Distance\n"<<postPose.orientation * currentVelocity.block<NUMAXIS, 1> (0,0) * delta_t << "\n";
             std::cout<<"[DR] postPose.position\n" <<postPose.position<<"\n";
             std::cout<<"[DR] postPose.cov_position\n" <<postPose.cov_position<<"\n";
             std::cout<<"[DR] postPose.velocity\n" <<postPose.velocity<<"\n";
@@ -246,8 +372,29 @@ namespace localization
         * */
         static Eigen::Quaternion<double> updateAttitude (const double dt,
                                 const std::vector< Eigen::Matrix < double, NUMAXIS, 1> , Eigen::aligned_allocator < Eigen::Matrix <double, NUMAXIS, 1> > > &angularVelocities,
-                                const Eigen::Matrix <double, NUMAXIS, NUMAXIS> &angularVelCov = Eigen::Matrix <double, NUMAXIS, NUMAXIS>::Zero())
+                                const Eigen::Matrix <double, NUMAXIS, NUMAXIS> &angularVelCov = Eigen::Matrix <double, NUMAXIS, NUMAXIS>::Zero(),
+                                const AttitudeIntegration method = QUATERNION_SERIES)
         {
+            return updateAttitude(dt, angularVelocities[0], angularVelocities[1], angularVelCov, method);
+        }
+
+        /** \Brief Fixed size form of the quaternion integration, without heap allocations
+        *
+        * @param currentAngularVelocity current angular velocity (angularVelocities[0])
+        * @param previousAngularVelocity previous angular velocity (angularVelocities[1])
+        *
+        * @return delta quaternion of the change in Attitude.
+        *
+        * */
+        static Eigen::Quaternion<double> updateAttitude (const double dt,
+                                const Eigen::Matrix < double, NUMAXIS, 1> &currentAngularVelocity,
+                                const Eigen::Matrix < double, NUMAXIS, 1> &previousAngularVelocity,
+                                const Eigen::Matrix <double, NUMAXIS, NUMAXIS> &angularVelCov = Eigen::Matrix <double, NUMAXIS, NUMAXIS>::Zero(),
+                                const AttitudeIntegration method = QUATERNION_SERIES)
+        {
+            if (method == QUATERNION_EXPONENTIAL)
+                return updateAttitudeExponential(dt, currentAngularVelocity, previousAngularVelocity);
+
             Eigen::Quaternion<double> deltaq; /** Instantaneous change in attitude **/
             Eigen::Matrix <double,QUATERSIZE,QUATERSIZE> omega4, oldomega4; /** Angular velocity matrix */
             Eigen::Matrix <double,QUATERSIZE,1> quat; /** Quaternion integration matrix */
@@ -255,21 +402,21 @@ namespace localization
             quat<< 1.00, 0.00, 0.00, 0.00; /**Identity quaternion */
 
             /** Discrete quaternion integration of the angular velocity **/
-            omega4 << 0,-angularVelocities[0](0), -angularVelocities[0](1), -angularVelocities[0](2),
-	        angularVelocities[0](0), 0, angularVelocities[0](2), -angularVelocities[0](1),
-	        angularVelocities[0](1), -angularVelocities[0](2), 0, angularVelocities[0](0),
-	        angularVelocities[0](2), angularVelocities[0](1), -angularVelocities[0](0), 0;
+            omega4 << 0,-currentAngularVelocity(0), -currentAngularVelocity(1), -currentAngularVelocity(2),
+	        currentAngularVelocity(0), 0, currentAngularVelocity(2), -currentAngularVelocity(1),
+	        currentAngularVelocity(1), -currentAngularVelocity(2), 0, currentAngularVelocity(0),
+	        currentAngularVelocity(2), currentAngularVelocity(1), -currentAngularVelocity(0), 0;
 
-            oldomega4 << 0,-angularVelocities[1](0), -angularVelocities[1](1), -angularVelocities[1](2),
-	        angularVelocities[1](0), 0, angularVelocities[1](2), -angularVelocities[1](1),
-	        angularVelocities[1](1), -angularVelocities[1](2), 0, angularVelocities[1](0),
-	        angularVelocities[1](2), angularVelocities[1](1), -angularVelocities[1](0), 0;
+            oldomega4 << 0,-previousAngularVelocity(0), -previousAngularVelocity(1), -previousAngularVelocity(2),
+	        previousAngularVelocity(0), 0, previousAngularVelocity(2), -previousAngularVelocity(1),
+	        previousAngularVelocity(1), -previousAngularVelocity(2), 0, previousAngularVelocity(0),
+	        previousAngularVelocity(2), previousAngularVelocity(1), -previousAngularVelocity(0), 0;
 
 
             /** Quaternion integration (third order linearization) **/
             quat = (Eigen::Matrix<double,QUATERSIZE,QUATERSIZE>::Identity() + (0.75 * omega4 *dt)- (0.25 * oldomega4 * dt) -
-            ((1.0/6.0) * angularVelocities[0].squaredNorm() * pow(dt,2) *  Eigen::Matrix<double,QUATERSIZE,QUATERSIZE>::Identity()) -
-            ((1.0/24.0) * omega4 * oldomega4 * pow(dt,2)) - ((1.0/48.0) * angularVelocities[0].squaredNorm() * omega4 * pow(dt,3))) * quat;
+            ((1.0/6.0) * currentAngularVelocity.squaredNorm() * pow(dt,2) *  Eigen::Matrix<double,QUATERSIZE,QUATERSIZE>::Identity()) -
+            ((1.0/24.0) * omega4 * oldomega4 * pow(dt,2)) - ((1.0/48.0) * currentAngularVelocity.squaredNorm() * omega4 * pow(dt,3))) * quat;
 
             /** Store in a quaternion form **/
             deltaq.w() = quat(0);
@@ -286,6 +433,96 @@ namespace localization
             return deltaq;
         }
 
+        /** \Brief Closed form quaternion integration assuming constant angular acceleration
+        *
+        * Same model as the series of updateAttitude: the angular velocity is
+        * extrapolated linearly from the previous to the current sample. The
+        * rotation vector of the step is its integral plus the coning term
+        * (dt^2/12) * previous x current, the quaternion is its exponential.
+        *
+        * @return delta quaternion of the change in Attitude.
+        *
+        * */
+        static Eigen::Quaternion<double> updateAttitudeExponential (const double dt,
+                                const Eigen::Matrix < double, NUMAXIS, 1> &currentAngularVelocity,
+                                const Eigen::Matrix < double, NUMAXIS, 1> &previousAngularVelocity)
+        {
+            const double a = 1.5 * dt, b = 0.5 * dt, c = dt * dt / 12.0;
+            const double wx = currentAngularVelocity[0], wy = currentAngularVelocity[1], wz = currentAngularVelocity[2];
+            const double ox = previousAngularVelocity[0], oy = previousAngularVelocity[1], oz = previousAngularVelocity[2];
+
+            /** Rotation vector with the coning correction **/
+            const double rx = a * wx - b * ox + c * (oy * wz - oz * wy);
+            const double ry = a * wy - b * oy + c * (oz * wx - ox * wz);
+            const double rz = a * wz - b * oz + c * (ox * wy - oy * wx);
+
+            const double theta2 = rx * rx + ry * ry + rz * rz;
+            double w, s;
+            expCoefficients(theta2, w, s);
+
+            return Eigen::Quaternion<double> (w, s * rx, s * ry, s * rz);
+        }
+
+        /** \Brief Batched form of updateAttitudeExponential
+        *
+        * Integrates n samples at once. The samples are stored one per row,
+        * each component in a contiguous column so that the loop over the
+        * samples is vectorized.
+        *
+        * @param currentAngularVelocities n x 3 current angular velocities
+        * @param previousAngularVelocities n x 3 previous angular velocities
+        * @param deltaq n x 4 delta quaternions in [w x y z] order
+        *
+        * */
+        static void updateAttitudeExponential (const double dt,
+                                const Eigen::Matrix < double, Eigen::Dynamic, NUMAXIS> &currentAngularVelocities,
+                                const Eigen::Matrix < double, Eigen::Dynamic, NUMAXIS> &previousAngularVelocities,
+                                Eigen::Matrix < double, Eigen::Dynamic, QUATERSIZE> &deltaq)
+        {
+            const double a = 1.5 * dt, b = 0.5 * dt, c = dt * dt / 12.0;
+            const Eigen::Index n = currentAngularVelocities.rows();
+
+            deltaq.resize(n, QUATERSIZE);
+
+            /** Rotation vectors with the coning correction, in the vector part **/
+            Eigen::Block< Eigen::Matrix < double, Eigen::Dynamic, QUATERSIZE>, Eigen::Dynamic, NUMAXIS, true> r (deltaq.rightCols<NUMAXIS>());
+            for (register int i=0; i<NUMAXIS; ++i)
+            {
+                const int j = (i+1) % NUMAXIS, k = (i+2) % NUMAXIS;
+                r.col(i).array() = a * currentAngularVelocities.col(i).array() - b * previousAngularVelocities.col(i).array()
+                    + c * (previousAngularVelocities.col(j).array() * currentAngularVelocities.col(k).array()
+                        - previousAngularVelocities.col(k).array() * currentAngularVelocities.col(j).array());
+            }
+
+            /** cos(theta/2) and sin(theta/2)/theta as Taylor polynomials of
+             * theta^2/4, exact to double precision up to theta = 1 rad.
+             * Larger steps fall back to the scalar functions. **/
+            static const double cos_coeffs[8] = {1.0, -1.0/2.0, 1.0/24.0, -1.0/720.0, 1.0/40320.0,
+                -1.0/3628800.0, 1.0/479001600.0, -1.0/87178291200.0};
+            static const double sin_coeffs[8] = {1.0, -1.0/6.0, 1.0/120.0, -1.0/5040.0, 1.0/362880.0,
+                -1.0/39916800.0, 1.0/6227020800.0, -1.0/1307674368000.0};
+
+            typedef Eigen::Array<double, Eigen::Dynamic, 1> Column;
+            const Column theta2 (r.rowwise().squaredNorm().array());
+            const Column h2 (0.25 * theta2);
+            Column w (Column::Constant(n, cos_coeffs[7])), s (Column::Constant(n, sin_coeffs[7]));
+            for (register int k=6; k>=0; --k)
+            {
+                w = cos_coeffs[k] + h2 * w;
+                s = sin_coeffs[k] + h2 * s;
+            }
+            s *= 0.5;
+
+            for (Eigen::Index i=0; i<n; ++i)
+            {
+                if (theta2[i] > 1.0)
+                    expCoefficients(theta2[i], w[i], s[i]);
+            }
+
+            deltaq.col(0) = w.matrix();
+            r.array().colwise() *= s;
+        }
+
         /** \Brief Performs the time integration of delta pose updates
 	 *
 	 * @return delta pose of the change in pose
@@ -299,12 +536,10 @@ namespace localization
             /** Propagate Covariance **/
             if (useTranforWithUncertainty)
             {
-                TransformWithUncertainty tfDeltaPose(deltaPose, deltaCov); /** delta transformation between current pose and next pose **/
-                TransformWithUncertainty tfPrevPose(prevPose, prevCov); /** Previous pose**/
-                TransformWithUncertainty tfPostPose(postPose, postCov); /** Posterior pose **/
+                TransformWithUncertainty tfPostPose(prevPose, prevCov); /** Previous pose, posterior after the composition **/
 
                 /** To perform the transformation **/
-                tfPostPose = tfPrevPose * tfDeltaPose;
+                tfPostPose *= TransformWithUncertainty(deltaPose, deltaCov);
 
                 /** Get the pose and uncertainty **/
                 postPose = tfPostPose.getTransform();
@@ -326,6 +561,283 @@ namespace localization
             return;
         }
 
+        /** \Brief Dead reckoning with an adaptive step size
+         *
+         * Integrates the body velocity over [start, start + duration] with
+         * fourth order Magnus steps on SE(3). Each step is compared with two
+         * half steps, the difference is the local error estimate. The step is
+         * accepted when the error is below the share of the tolerance of its
+         * length and the next step grows or shrinks accordingly: smooth motion
+         * is integrated in few long steps.
+         *
+         * The velocity is a const callable velocity(t, vel, cov) returning
+         * [v w] in body frame and its covariance at time t, e.g.
+         * VelocityInterpolation.
+         * The velocity noise is integrated over each step as white noise of
+         * density cov * samplePeriod in the tangent space of the step, each
+         * part moved to the end of the step by the adjoint of the remaining
+         * motion (three point Gauss quadrature). It is the limit of
+         * updatePose called at every sample of samplePeriod to first order
+         * in the noise, the rotation noise moves the later translations and
+         * the covariance does not depend on the step sizes.
+         *
+         * @param tolerance error bound of the final pose in meters and radians
+         * @param initialStep first step length, the duration if zero
+         *
+         * @return number of accepted steps
+         */
+        template <typename _Velocity>
+        static unsigned int updatePoseAdaptive (const _Velocity &velocity, const double start, const double duration,
+                                        const double tolerance, const double samplePeriod,
+                                        const TransformWithUncertainty &prevPose, TransformWithUncertainty &postPose,
+                                        const double initialStep = 0.00)
+        {
+            postPose = prevPose;
+            if (duration <= 0.00)
+                return 0;
+
+            const double minStep = duration * 1e-06;
+            double h = (initialStep > 0.00)? std::min(initialStep, duration) : duration;
+            double t = 0.00;
+            unsigned int steps = 0;
+            bool last = false;
+
+            Eigen::Matrix<double, 6, 1> vel;
+            Eigen::Matrix<double, 6, 6> velCov;
+            while (!last)
+            {
+                if (duration - t <= h)
+                {
+                    h = duration - t;
+                    last = true;
+                }
+
+                /** One step and two half steps **/
+                Eigen::Affine3d full, first, second;
+                magnusStep(velocity, start + t, h, full);
+                magnusStep(velocity, start + t, 0.5 * h, first);
+                magnusStep(velocity, start + t + 0.5 * h, 0.5 * h, second);
+                const Eigen::Affine3d fine (first * second);
+
+                /** Richardson estimate of the error of the half steps **/
+                const double rotationError = Eigen::Quaterniond(fine.linear()).angularDistance(Eigen::Quaterniond(full.linear()));
+                const double error = std::max(rotationError, (fine.translation() - full.translation()).norm()) / 15.0;
+                const double allowed = tolerance * h / duration;
+
+                if (error <= allowed || h <= minStep)
+                {
+                    /** Velocity noise in the tangent space of the step, at
+                     * the Gauss points moved to the end of the step **/
+                    static const double nodes[3] = {0.5 - 0.5 * std::sqrt(0.6), 0.5, 0.5 + 0.5 * std::sqrt(0.6)};
+                    static const double weights[3] = {5.0 / 18.0, 8.0 / 18.0, 5.0 / 18.0};
+                    Eigen::Matrix<double, 6, 6> tangentCov (Eigen::Matrix<double, 6, 6>::Zero()), noise;
+                    for (register int j=0; j<3; ++j)
+                    {
+                        const double s = nodes[j] * h;
+                        velocity(start + t + s, vel, velCov);
+                        noise << velCov.block<3,3>(3,3), velCov.block<3,3>(3,0),
+                              velCov.block<3,3>(0,3), velCov.block<3,3>(0,0);
+
+                        Eigen::Affine3d rest;
+                        magnusStep(velocity, start + t + s, h - s, rest);
+                        const Eigen::Matrix<double, 6, 6> Ad (detail::se3_adjoint_inverse(rest));
+                        tangentCov += (weights[j] * h * samplePeriod) * Ad * noise * Ad.transpose();
+                    }
+
+                    const Eigen::Matrix<double, 6, 6> M_inv (detail::se3_from_tangent(fine));
+                    postPose *= TransformWithUncertainty(fine, M_inv * tangentCov * M_inv.transpose());
+
+                    t += h;
+                    ++steps;
+                }
+                else
+                {
+                    last = false;
+                }
+
+                /** Fifth order local error of the fourth order steps **/
+                const double factor = (error > 0.00)? 0.9 * std::pow(allowed / error, 0.2) : 5.0;
+                h = std::max(minStep, h * std::min(5.0, std::max(0.2, factor)));
+            }
+
+            #ifdef DEAD_RECKON_DEBUG_PRINTS
+            std::cout<<"[DR] adaptive steps: "<<steps<<" for "<<duration<<" seconds\n";
+            #endif
+
+            return steps;
+        }
+
+    private:
+        /** \Brief Fourth order Magnus step of length h on SE(3)
+         *
+         * Two point Gauss quadrature of the twist with the commutator term,
+         * the delta pose is the exponential of the resulting twist.
+         */
+        template <typename _Velocity>
+        static void magnusStep(const _Velocity &velocity, const double t, const double h, Eigen::Affine3d &delta)
+        {
+            const double offset = std::sqrt(3.0) / 6.0;
+            Eigen::Matrix<double, 6, 1> a1, a2;
+            Eigen::Matrix<double, 6, 6> cov;
+            velocity(t + (0.5 - offset) * h, a1, cov);
+            velocity(t + (0.5 + offset) * h, a2, cov);
+
+            const Eigen::Vector3d v1 (a1.block<3,1>(0,0)), w1 (a1.block<3,1>(3,0));
+            const Eigen::Vector3d v2 (a2.block<3,1>(0,0)), w2 (a2.block<3,1>(3,0));
+
+            /** Body frame twists: the commutator is [a1, a2] **/
+            const double c = std::sqrt(3.0) / 12.0 * h * h;
+            const Eigen::Vector3d rho (0.5 * h * (v1 + v2) + c * (w1.cross(v2) - w2.cross(v1)));
+            const Eigen::Vector3d phi (0.5 * h * (w1 + w2) + c * w1.cross(w2));
+
+            double w, s;
+            expCoefficients(phi.squaredNorm(), w, s);
+            delta = Eigen::Quaterniond(w, s * phi[0], s * phi[1], s * phi[2]);
+            delta.translation() = detail::so3_right_jacobian(phi).transpose() * rho;
+        }
+
+        /** \Brief cos(theta/2) and sin(theta/2)/theta of the rotation vector norm
+         * theta, with the Taylor series close to zero **/
+        static void expCoefficients(const double theta2, double &w, double &s)
+        {
+            if (theta2 < Eigen::NumTraits<double>::epsilon())
+            {
+                w = 1.0 - theta2 / 8.0;
+                s = 0.5 - theta2 / 48.0;
+            }
+            else
+            {
+                const double theta = std::sqrt(theta2);
+                w = std::cos(0.5 * theta);
+                s = std::sin(0.5 * theta) / theta;
+            }
+        }
+    };
+
+
+    /** \Brief Preintegration of odometry velocities into one delta pose
+     *
+     * Accumulates high rate velocity samples with the same integration as
+     * DeadReckon::updatePose. The delta pose is kept with its covariance in
+     * the right tangent space of SE(3), [rotation translation] order:
+     * delta * exp(xi). In this space the Jacobian of start * delta with
+     * respect to the start pose is the adjoint of the inverse delta, it does
+     * not depend on the start pose. The delta is computed once per keyframe
+     * and can be applied to any start pose afterwards.
+     */
+    class OdometryPreintegration
+    {
+
+    public:
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef Eigen::Matrix<double, 6, 6> Covariance;
+
+    public:
+
+        OdometryPreintegration()
+        {
+            reset();
+        }
+
+        /** \Brief Starts a new delta
+         */
+        void reset()
+        {
+            delta.setIdentity();
+            cov.setZero();
+            delta_time = 0.00;
+            number_samples = 0;
+        }
+
+        /** \Brief Integrates one step from the previous to the current velocity
+         *
+         * @param cartesianVelocities [0] current and [1] previous [v w] in body frame, as in DeadReckon::updatePose
+         * @param cartesianVelCov covariance of [v w]
+         */
+        void integrate(const double delta_t,
+                    const std::vector< Eigen::Matrix <double, 6, 1> , Eigen::aligned_allocator < Eigen::Matrix <double, 6, 1> > > &cartesianVelocities,
+                    const Eigen::Matrix <double, 6, 6> &cartesianVelCov)
+        {
+            integrate(delta_t, cartesianVelocities[0], cartesianVelocities[1], cartesianVelCov);
+        }
+
+        /** \Brief Fixed size form of integrate, without heap allocations
+         */
+        void integrate(const double delta_t,
+                    const Eigen::Matrix <double, 6, 1> &currentVelocity,
+                    const Eigen::Matrix <double, 6, 1> &previousVelocity,
+                    const Eigen::Matrix <double, 6, 6> &cartesianVelCov)
+        {
+            /** Step in the same form as DeadReckon::updatePose **/
+            Eigen::Affine3d step (DeadReckon::updateAttitude(delta_t, Eigen::Vector3d(currentVelocity.block<3, 1> (3, 0)),
+                                                    Eigen::Vector3d(previousVelocity.block<3, 1> (3, 0))));
+            step.translation() = (delta_t/2.0) * (currentVelocity.block<3,1> (0,0) + previousVelocity.block<3,1>(0,0));
+
+            /** Step uncertainty in [r t], mapped to the tangent space of the step **/
+            Covariance stepCov (Covariance::Zero());
+            stepCov.block<3,3>(0,0) = cartesianVelCov.block<3,3> (3,3) * delta_t * delta_t;
+            stepCov.block<3,3>(3,3) = cartesianVelCov.block<3,3> (0,0) * delta_t * delta_t;
+            Covariance M (detail::se3_to_tangent(step));
+
+            /** xi_k+1 = Ad(step^-1) * xi_k + xi_step **/
+            Covariance Ad (detail::se3_adjoint_inverse(step));
+            cov = Ad * cov * Ad.transpose() + M * stepCov * M.transpose();
+            delta = delta * step;
+
+            delta_time += delta_t;
+            number_samples++;
+        }
+
+        /** \Brief Delta transformation since the last reset
+         */
+        const Eigen::Affine3d& getDelta() const { return delta; }
+
+        /** \Brief Covariance of the delta in its tangent space
+         */
+        const Covariance& getCovariance() const { return cov; }
+
+        /** \Brief Jacobian of start * delta with respect to the start pose, both in tangent space
+         */
+        Covariance getStartJacobian() const { return detail::se3_adjoint_inverse(delta); }
+
+        double getDeltaTime() const { return delta_time; }
+        unsigned int getNumberSamples() const { return number_samples; }
+
+        /** \Brief Delta with the covariance of its [r t] representation
+         */
+        TransformWithUncertainty getDeltaWithUncertainty() const
+        {
+            const Covariance M_inv (detail::se3_from_tangent(delta));
+            return TransformWithUncertainty(delta, M_inv * cov * M_inv.transpose());
+        }
+
+        /** \Brief Re-applies the delta to a start pose
+         *
+         * Same as start.composition(getDeltaWithUncertainty(), TransformWithUncertainty::ADJOINT)
+         */
+        TransformWithUncertainty apply(const TransformWithUncertainty &start) const
+        {
+            const Eigen::Affine3d post (start.getTransform() * delta);
+
+            Covariance postCov (cov);
+            if (start.hasUncertainty())
+            {
+                const Covariance J (getStartJacobian() * detail::se3_to_tangent(start.getTransform()));
+                postCov += J * start.getCovariance() * J.transpose();
+            }
+
+            const Covariance M_inv (detail::se3_from_tangent(post));
+            return TransformWithUncertainty(post, M_inv * postCov * M_inv.transpose());
+        }
+
+    private:
+
+        Eigen::Affine3d delta; /** Delta transformation **/
+        Covariance cov; /** Covariance of the delta in tangent space **/
+        double delta_time; /** Integrated time **/
+        unsigned int number_samples; /** Integrated steps **/
     };
 
 }
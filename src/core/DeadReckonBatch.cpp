@@ -0,0 +1,164 @@
+#include "DeadReckonBatch.hpp"
+#include <iostream>
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+using namespace localization;
+
+namespace
+{
+    // trajectories are advanced in chunks which stay in the cache over all
+    // the samples, the strided covariance rows of larger chunks do not
+    const int CHUNK = 128;
+
+    typedef std::vector<const VelocityBatch*> Samples;
+    typedef Eigen::Array<double,Eigen::Dynamic,1,Eigen::ColMajor,CHUNK,1> Column;
+
+    // delta poses of the trajectories [begin, begin+n) between previous and
+    // current, as DeadReckon::updatePose with DeadReckon::updateAttitude
+    void formDeltas( const VelocityBatch& current, const VelocityBatch& previous, const Eigen::MatrixXd& delta_t, int step,
+	    size_t begin, int n, TransformBatch& deltas )
+    {
+	const Column dt( delta_t.col( step ).segment( begin, n ).array() );
+	const Column dt2( dt * dt );
+
+	Column w[3], o[3];
+	for( int i = 0; i < 3; ++i )
+	{
+	    w[i] = current.velocity.col( 3 + i ).segment( begin, n ).array();
+	    o[i] = previous.velocity.col( 3 + i ).segment( begin, n ).array();
+	}
+	const Column ww( w[0]*w[0] + w[1]*w[1] + w[2]*w[2] );
+	const Column wo( w[0]*o[0] + w[1]*o[1] + w[2]*o[2] );
+
+	// third order quaternion integration applied to the identity, written
+	// on the components: the 4x4 products reduce to dot and cross products
+	Column q[4];
+	q[3] = 1.0 - ww * dt2 / 6.0 + wo * dt2 / 24.0;
+	for( int i = 0; i < 3; ++i )
+	{
+	    const int j = ( i + 1 ) % 3, k = ( i + 2 ) % 3;
+	    const Column cross( o[j]*w[k] - o[k]*w[j] );
+	    q[i] = 0.75 * dt * w[i] - 0.25 * dt * o[i] - dt2 / 24.0 * cross - ww * dt2 * dt / 48.0 * w[i];
+	}
+	const Column norm( ( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] ).sqrt() );
+	for( int i = 0; i < 4; ++i )
+	    deltas.orientation.col( i ).segment( begin, n ) = ( q[i] / norm ).matrix();
+
+	for( int i = 0; i < 3; ++i )
+	    deltas.position.col( i ).segment( begin, n ) = ( 0.5 * dt *
+		    ( current.velocity.col( i ).segment( begin, n ).array() + previous.velocity.col( i ).segment( begin, n ).array() ) ).matrix();
+
+	// rotation block from the angular velocity, translation block from
+	// the linear velocity, column-major 6x6
+	for( int c = 0; c < 3; ++c )
+	    for( int r = 0; r < 3; ++r )
+	    {
+		deltas.cov.col( r + 6*c ).segment( begin, n ) = ( dt2 * current.cov.col( ( r+3 ) + 6*( c+3 ) ).segment( begin, n ).array() ).matrix();
+		deltas.cov.col( ( r+3 ) + 6*( c+3 ) ).segment( begin, n ) = ( dt2 * current.cov.col( r + 6*c ).segment( begin, n ).array() ).matrix();
+		deltas.cov.col( ( r+3 ) + 6*c ).segment( begin, n ).setZero();
+		deltas.cov.col( r + 6*( c+3 ) ).segment( begin, n ).setZero();
+	    }
+    }
+
+    // advances the trajectories [begin, end) through all the samples
+    void deadReckonRange( const Samples& samples, const Eigen::MatrixXd& delta_t, TransformBatch& poses,
+	    TransformBatch& deltas, size_t begin, size_t end )
+    {
+	for( size_t b = begin; b < end; b += CHUNK )
+	{
+	    const int n = static_cast<int>( std::min( static_cast<size_t>( CHUNK ), end - b ) );
+	    for( size_t k = 0; k + 1 < samples.size(); ++k )
+	    {
+		formDeltas( *samples[k+1], *samples[k], delta_t, k, b, n, deltas );
+		composePoses( poses, deltas, b, b + n );
+	    }
+	}
+    }
+
+    void deadReckonSamples( const Samples& samples, const Eigen::MatrixXd& delta_t, TransformBatch& poses,
+	    unsigned int number_threads )
+    {
+	const size_t number = poses.size();
+	for( size_t k = 0; k < samples.size(); ++k )
+	{
+	    if( samples[k]->size() != number )
+	    {
+		std::cerr << "[DEAD_RECKON_BATCH] velocities of sample " << k << " are for " << samples[k]->size()
+		    << " trajectories instead of " << number << std::endl;
+		return;
+	    }
+	}
+	if( samples.size() > 1 && ( static_cast<size_t>( delta_t.rows() ) != number
+		    || static_cast<size_t>( delta_t.cols() ) + 1 < samples.size() ) )
+	{
+	    std::cerr << "[DEAD_RECKON_BATCH] delta_t has to be " << number << " x " << samples.size() - 1 << std::endl;
+	    return;
+	}
+
+	// the threads write disjoint rows of the deltas
+	TransformBatch deltas( number );
+
+	const size_t chunks = ( number + CHUNK - 1 ) / CHUNK;
+	number_threads = std::max( 1u, std::min( number_threads, static_cast<unsigned int>( chunks ) ) );
+
+	if( number_threads == 1 )
+	{
+	    deadReckonRange( samples, delta_t, poses, deltas, 0, number );
+	    return;
+	}
+
+	// contiguous ranges of whole chunks, one per thread
+	const size_t chunks_per_thread = ( chunks + number_threads - 1 ) / number_threads;
+	boost::thread_group workers;
+	for( size_t begin = 0; begin < number; begin += chunks_per_thread * CHUNK )
+	{
+	    const size_t end = std::min( number, begin + chunks_per_thread * CHUNK );
+	    workers.create_thread( boost::bind( &deadReckonRange, boost::cref( samples ), boost::cref( delta_t ),
+			boost::ref( poses ), boost::ref( deltas ), begin, end ) );
+	}
+	workers.join_all();
+    }
+}
+
+VelocityBatch::VelocityBatch() {}
+
+VelocityBatch::VelocityBatch( size_t size )
+{
+    resize( size );
+}
+
+void VelocityBatch::resize( size_t size )
+{
+    velocity.resize( size, 6 );
+    cov.resize( size, 36 );
+}
+
+void VelocityBatch::set( size_t i, const Eigen::Matrix<double,6,1>& vel, const Eigen::Matrix<double,6,6>& vel_cov )
+{
+    velocity.row( i ) = vel.transpose();
+    cov.row( i ) = Eigen::Map<const Eigen::Matrix<double,1,36> >( vel_cov.data() );
+}
+
+void localization::deadReckon( const std::vector<VelocityBatch>& velocities, const Eigen::MatrixXd& delta_t,
+	TransformBatch& poses, unsigned int number_threads )
+{
+    Samples samples( velocities.size() );
+    for( size_t k = 0; k < velocities.size(); ++k )
+	samples[k] = &velocities[k];
+
+    deadReckonSamples( samples, delta_t, poses, number_threads );
+}
+
+void localization::deadReckon( const VelocityBatch& current, const VelocityBatch& previous, const Eigen::VectorXd& delta_t,
+	TransformBatch& poses, unsigned int number_threads )
+{
+    Samples samples( 2 );
+    samples[0] = &previous;
+    samples[1] = &current;
+
+    deadReckonSamples( samples, delta_t, poses, number_threads );
+}
@@ -0,0 +1,62 @@
+#ifndef _LOCALIZATION_CORE_DEAD_RECKON_BATCH_HPP_
+#define _LOCALIZATION_CORE_DEAD_RECKON_BATCH_HPP_
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <localization/core/TransformBatch.hpp>
+
+namespace localization
+{
+    /**
+     * Structure of arrays of body velocities of many trajectories at one
+     * instant.
+     *
+     * velocity has one column per component of [v w] and cov one column per
+     * coefficient of the column-major 6x6 covariance of [v w]. Row i belongs
+     * to the i-th trajectory.
+     */
+    class VelocityBatch
+    {
+    public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,6> Velocities;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,36> Covariances;
+
+    public:
+	VelocityBatch();
+	explicit VelocityBatch( size_t size );
+
+	void resize( size_t size );
+	size_t size() const { return velocity.rows(); }
+
+	void set( size_t i, const Eigen::Matrix<double,6,1>& vel, const Eigen::Matrix<double,6,6>& vel_cov );
+
+	Velocities velocity;
+	Covariances cov;
+    };
+
+    /** dead reckons many independent trajectories over a sequence of
+     * velocity samples.
+     *
+     * velocities[k] are the velocities of all the trajectories at sample k,
+     * delta_t( i, k ) is the time of trajectory i between the samples k and
+     * k+1. poses are the start poses and are replaced by the final ones.
+     * Every step is the same as DeadReckon::updatePose with the current and
+     * previous sample and the covariance of the current one.
+     *
+     * The delta poses are formed with packet math across trajectories and
+     * composed with composePoses. Each chunk of trajectories is advanced
+     * through all the samples while it is in the cache, the chunks can be
+     * split among number_threads threads.
+     */
+    void deadReckon( const std::vector<VelocityBatch>& velocities, const Eigen::MatrixXd& delta_t,
+	    TransformBatch& poses, unsigned int number_threads = 1 );
+
+    /** one step of all the trajectories, the same as deadReckon with the
+     * two samples previous and current
+     */
+    void deadReckon( const VelocityBatch& current, const VelocityBatch& previous, const Eigen::VectorXd& delta_t,
+	    TransformBatch& poses, unsigned int number_threads = 1 );
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "DeadReckonService.hpp"
+#include "DeadReckon.hpp"
+#include <iostream>
+#include <boost/bind.hpp>
+
+using namespace localization;
+
+DeadReckonService::DeadReckonService( size_t capacity, const TransformWithUncertainty& initial_pose )
+    : samples( capacity ), has_previous( false ), pose( initial_pose ),
+    number_samples( 0 ), sequence( 0 ), running( false ), sleeping( false )
+{
+    previous.time = base::Time::fromMicroseconds( 0 );
+    publish();
+}
+
+DeadReckonService::~DeadReckonService()
+{
+    stop();
+}
+
+bool DeadReckonService::start()
+{
+    if( running.exchange( true ) )
+    {
+	std::cerr << "[DEAD_RECKON_SERVICE] the integration thread is already running" << std::endl;
+	return false;
+    }
+    thread = boost::thread( boost::bind( &DeadReckonService::run, this ) );
+    return true;
+}
+
+void DeadReckonService::stop()
+{
+    if( !running.exchange( false ) )
+	return;
+
+    wake.notify_one();
+    thread.join();
+}
+
+bool DeadReckonService::push( const OdometrySample& sample )
+{
+    if( !samples.push( sample ) )
+	return false;
+
+    // only notify a waiting thread, a busy one picks the sample up anyway.
+    // A wake up lost between the check of the consumer and its wait only
+    // delays the integration until the timeout of the wait
+    if( sleeping.load() )
+	wake.notify_one();
+    return true;
+}
+
+size_t DeadReckonService::process()
+{
+    if( running.load() )
+    {
+	std::cerr << "[DEAD_RECKON_SERVICE] samples are integrated by the integration thread" << std::endl;
+	return 0;
+    }
+
+    size_t number = 0;
+    OdometrySample sample;
+    while( samples.pop( sample ) )
+    {
+	integrate( sample );
+	++number;
+    }
+    return number;
+}
+
+void DeadReckonService::run()
+{
+    OdometrySample sample;
+    while( true )
+    {
+	while( samples.pop( sample ) )
+	    integrate( sample );
+
+	if( !running.load() )
+	    break;
+
+	boost::unique_lock<boost::mutex> lock( wake_mutex );
+	sleeping.store( true );
+	if( samples.empty() && running.load() )
+	    wake.timed_wait( lock, boost::posix_time::milliseconds( 1 ) );
+	sleeping.store( false );
+    }
+}
+
+void DeadReckonService::integrate( const OdometrySample& sample )
+{
+    if( has_previous )
+    {
+	const double delta_t = static_cast<double>( sample.time.toMicroseconds() - previous.time.toMicroseconds() ) * 1e-6;
+	if( delta_t <= 0.0 )
+	{
+	    std::cerr << "[DEAD_RECKON_SERVICE] sample at " << sample.time.toMicroseconds()
+		<< " is not newer than the previous one" << std::endl;
+	    return;
+	}
+
+	DeadReckon::updatePose( delta_t, sample.velocity, previous.velocity, sample.cov, pose, post_pose );
+	pose = post_pose;
+	++number_samples;
+    }
+
+    previous = sample;
+    has_previous = true;
+    publish();
+}
+
+void DeadReckonService::publish()
+{
+    const uint64_t current = sequence.load( boost::memory_order_relaxed );
+    sequence.store( current + 1, boost::memory_order_relaxed );
+    boost::atomic_thread_fence( boost::memory_order_release );
+
+    published.time = previous.time.toMicroseconds();
+    published.position = pose.getTransform().translation();
+    published.orientation = pose.getQuaternion();
+    published.cov = pose.getCovariance();
+    published.samples = number_samples;
+
+    sequence.store( current + 2, boost::memory_order_release );
+}
+
+void DeadReckonService::read( Published& copy ) const
+{
+    while( true )
+    {
+	const uint64_t current = sequence.load( boost::memory_order_acquire );
+	if( current % 2 )
+	    continue;
+
+	copy = published;
+
+	boost::atomic_thread_fence( boost::memory_order_acquire );
+	if( sequence.load( boost::memory_order_relaxed ) == current )
+	    return;
+    }
+}
+
+void DeadReckonService::getPose( base::Time& time, TransformWithUncertainty& result ) const
+{
+    Published copy;
+    read( copy );
+
+    TransformWithUncertainty::Transform trans( copy.orientation );
+    trans.translation() = copy.position;
+    time = base::Time::fromMicroseconds( copy.time );
+    result = TransformWithUncertainty( trans, copy.cov );
+}
+
+uint64_t DeadReckonService::getNumberSamples() const
+{
+    Published copy;
+    read( copy );
+    return copy.samples;
+}
@@ -0,0 +1,106 @@
+#ifndef _LOCALIZATION_CORE_DEAD_RECKON_SERVICE_HPP_
+#define _LOCALIZATION_CORE_DEAD_RECKON_SERVICE_HPP_
+
+#include <stdint.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <base/Time.hpp>
+#include <localization/core/Transform.hpp>
+#include <localization/core/SpscQueue.hpp>
+
+namespace localization
+{
+    /** body velocity sample for the dead reckoning */
+    struct OdometrySample
+    {
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	base::Time time;
+	/** [v w] in body frame */
+	Eigen::Matrix<double, 6, 1> velocity;
+	/** covariance of [v w] */
+	Eigen::Matrix<double, 6, 6> cov;
+    };
+
+    /**
+     * Dead reckoning on its own thread.
+     *
+     * A driver thread pushes velocity samples into a bounded lock-free
+     * queue. The service thread integrates each sample with the previous
+     * one using DeadReckon::updatePose and publishes the pose through a
+     * sequence lock: readers copy it without blocking the integration and
+     * retry if it changed meanwhile. Nothing is allocated after the
+     * construction.
+     *
+     * Only one thread may push, any number of threads may read the pose.
+     */
+    class DeadReckonService
+    {
+    public:
+	DeadReckonService( size_t capacity,
+		const TransformWithUncertainty& initial_pose = TransformWithUncertainty::Identity() );
+	~DeadReckonService();
+
+	/** starts the integration thread, false if it is running already */
+	bool start();
+
+	/** integrates the queued samples and joins the thread */
+	void stop();
+
+	bool isRunning() const { return running.load(); }
+
+	/** queues a sample, false if the queue is full. Producer only. */
+	bool push( const OdometrySample& sample );
+
+	/** integrates the queued samples in the calling thread, for use
+	 * without the integration thread. Returns the number of samples. */
+	size_t process();
+
+	/** latest pose, its time and the number of integrated samples. The
+	 * time is the one of the last sample, zero before the first one. */
+	void getPose( base::Time& time, TransformWithUncertainty& pose ) const;
+	uint64_t getNumberSamples() const;
+
+    private:
+	struct Published
+	{
+	    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	    int64_t time;
+	    Eigen::Vector3d position;
+	    Eigen::Quaterniond orientation;
+	    TransformWithUncertainty::Covariance cov;
+	    uint64_t samples;
+	};
+
+	void run();
+	void integrate( const OdometrySample& sample );
+	void publish();
+
+	/** copies the published pose, retrying while it is written */
+	void read( Published& published ) const;
+
+	SpscQueue<OdometrySample> samples;
+
+	/** integration state, owned by the integrating thread */
+	OdometrySample previous;
+	bool has_previous;
+	TransformWithUncertainty pose, post_pose;
+	uint64_t number_samples;
+
+	/** odd while the pose is written */
+	boost::atomic<uint64_t> sequence;
+	Published published;
+
+	boost::atomic<bool> running;
+	boost::thread thread;
+	/** wakes up the thread when samples are pushed while it waits */
+	boost::mutex wake_mutex;
+	boost::condition_variable wake;
+	boost::atomic<bool> sleeping;
+    };
+}
+
+#endif
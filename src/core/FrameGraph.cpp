@@ -0,0 +1,210 @@
+#include "FrameGraph.hpp"
+#include <iostream>
+
+using namespace localization;
+
+FrameGraph::FrameGraph( PropagationMethod method )
+    : method( method ) {}
+
+bool FrameGraph::addFrame( const std::string& frame )
+{
+    boost::unique_lock<boost::shared_mutex> lock( graph_mutex );
+    return addFrameUnlocked( frame, -1, TransformWithUncertainty::Identity() ) >= 0;
+}
+
+bool FrameGraph::addFrame( const std::string& frame, const std::string& parent,
+	const TransformWithUncertainty& frame2parent )
+{
+    boost::unique_lock<boost::shared_mutex> lock( graph_mutex );
+
+    std::map<std::string, int>::const_iterator it = ids.find( parent );
+    if( it == ids.end() )
+    {
+	std::cerr << "[FRAME_GRAPH] parent frame " << parent << " of " << frame << " does not exist" << std::endl;
+	return false;
+    }
+    return addFrameUnlocked( frame, it->second, frame2parent ) >= 0;
+}
+
+int FrameGraph::addFrameUnlocked( const std::string& frame, int parent, const TransformWithUncertainty& frame2parent )
+{
+    if( ids.find( frame ) != ids.end() )
+    {
+	std::cerr << "[FRAME_GRAPH] frame " << frame << " already exists" << std::endl;
+	return -1;
+    }
+
+    const int id = frames.size();
+    frames.push_back( Frame() );
+    Frame &f( frames.back() );
+    f.name = frame;
+    f.parent = parent;
+    f.depth = parent < 0 ? 0 : frames[parent].depth + 1;
+    f.edge = frame2parent;
+    f.cached = false;
+
+    if( parent >= 0 )
+	frames[parent].children.push_back( id );
+    ids[frame] = id;
+
+    return id;
+}
+
+bool FrameGraph::updateTransform( const std::string& frame, const TransformWithUncertainty& frame2parent )
+{
+    return updateTransform( getFrameId( frame ), frame2parent );
+}
+
+bool FrameGraph::updateTransform( int frame, const TransformWithUncertainty& frame2parent )
+{
+    boost::unique_lock<boost::shared_mutex> lock( graph_mutex );
+
+    if( frame < 0 || frame >= static_cast<int>( frames.size() ) || frames[frame].parent < 0 )
+    {
+	std::cerr << "[FRAME_GRAPH] frame " << frame << " is not a child frame" << std::endl;
+	return false;
+    }
+
+    frames[frame].edge = frame2parent;
+    invalidate( frame );
+    return true;
+}
+
+void FrameGraph::invalidate( int frame )
+{
+    // a frame is only cached if all its ancestors are, so the traversal
+    // stops at frames which are already invalid
+    std::vector<int> pending( 1, frame );
+    while( !pending.empty() )
+    {
+	Frame &f( frames[pending.back()] );
+	pending.pop_back();
+	if( !f.cached )
+	    continue;
+
+	f.cached = false;
+	pending.insert( pending.end(), f.children.begin(), f.children.end() );
+    }
+}
+
+void FrameGraph::updateCache( int frame ) const
+{
+    // find the first cached ancestor and update the path down from there
+    std::vector<int> path;
+    for( int id = frame; id >= 0 && !frames[id].cached; id = frames[id].parent )
+	path.push_back( id );
+
+    for( std::vector<int>::reverse_iterator it = path.rbegin(); it != path.rend(); ++it )
+    {
+	Frame &f( frames[*it] );
+	f.ancestors.resize( f.depth );
+	if( f.parent >= 0 )
+	{
+	    const Frame &p( frames[f.parent] );
+	    for( int k = 0; k < p.depth; ++k )
+		f.ancestors[k] = p.ancestors[k].composition( f.edge, method );
+	    f.ancestors[p.depth] = f.edge;
+	}
+	f.cached = true;
+    }
+}
+
+TransformWithUncertainty FrameGraph::toAncestor( int frame, int ancestor ) const
+{
+    if( frame == ancestor )
+	return TransformWithUncertainty::Identity();
+    return frames[frame].ancestors[frames[ancestor].depth];
+}
+
+bool FrameGraph::getTransform( const std::string& source, const std::string& target,
+	TransformWithUncertainty& source2target ) const
+{
+    boost::shared_lock<boost::shared_mutex> lock( graph_mutex );
+
+    std::map<std::string, int>::const_iterator source_it = ids.find( source ), target_it = ids.find( target );
+    if( source_it == ids.end() || target_it == ids.end() )
+    {
+	std::cerr << "[FRAME_GRAPH] unknown frame in " << source << " to " << target << std::endl;
+	return false;
+    }
+
+    lock.unlock();
+    return getTransform( source_it->second, target_it->second, source2target );
+}
+
+bool FrameGraph::getTransform( int source, int target, TransformWithUncertainty& source2target ) const
+{
+    boost::shared_lock<boost::shared_mutex> lock( graph_mutex );
+
+    const int number_frames = frames.size();
+    if( source < 0 || target < 0 || source >= number_frames || target >= number_frames )
+    {
+	std::cerr << "[FRAME_GRAPH] unknown frame id in " << source << " to " << target << std::endl;
+	return false;
+    }
+
+    // lowest common ancestor
+    int a = source, b = target;
+    while( frames[a].depth > frames[b].depth )
+	a = frames[a].parent;
+    while( frames[b].depth > frames[a].depth )
+	b = frames[b].parent;
+    while( a != b && a >= 0 )
+    {
+	a = frames[a].parent;
+	b = frames[b].parent;
+    }
+    if( a < 0 )
+    {
+	std::cerr << "[FRAME_GRAPH] frames " << frames[source].name << " and "
+	    << frames[target].name << " are not connected" << std::endl;
+	return false;
+    }
+
+    // the caches are only invalidated under the exclusive graph lock, so
+    // once both frames are cached they stay cached for this query. The
+    // transforms are copied under the lock since reading their rotation
+    // fills their mutable caches, which is not thread-safe.
+    TransformWithUncertainty source2lca, target2lca;
+    {
+	boost::shared_lock<boost::shared_mutex> cache_lock( cache_mutex );
+	if( frames[source].cached && frames[target].cached )
+	{
+	    source2lca = toAncestor( source, a );
+	    target2lca = toAncestor( target, a );
+	}
+	else
+	{
+	    cache_lock.unlock();
+	    boost::unique_lock<boost::shared_mutex> update_lock( cache_mutex );
+	    // another reader may have filled the caches in between,
+	    // updateCache skips the frames which are cached already
+	    updateCache( source );
+	    updateCache( target );
+	    source2lca = toAncestor( source, a );
+	    target2lca = toAncestor( target, a );
+	}
+    }
+
+    // both paths are disjoint, their uncertainties are independent
+    if( target == a )
+	source2target = source2lca;
+    else
+	source2target = target2lca.inverse( method ).composition( source2lca, method );
+
+    return true;
+}
+
+int FrameGraph::getFrameId( const std::string& frame ) const
+{
+    boost::shared_lock<boost::shared_mutex> lock( graph_mutex );
+
+    std::map<std::string, int>::const_iterator it = ids.find( frame );
+    return it == ids.end() ? -1 : it->second;
+}
+
+size_t FrameGraph::size() const
+{
+    boost::shared_lock<boost::shared_mutex> lock( graph_mutex );
+    return frames.size();
+}
@@ -0,0 +1,107 @@
+#ifndef _LOCALIZATION_CORE_FRAME_GRAPH_HPP_
+#define _LOCALIZATION_CORE_FRAME_GRAPH_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <Eigen/StdVector>
+#include <boost/thread/shared_mutex.hpp>
+#include <localization/core/Transform.hpp>
+
+namespace localization
+{
+    /**
+     * Tree of frames connected by transforms with uncertainty.
+     *
+     * Every frame but the roots has one parent and the transform from the
+     * frame to its parent (it maps coordinates of the frame into the
+     * parent). Several trees can live in the same graph, frames of different
+     * trees are not connected.
+     *
+     * Each frame caches its composed transform to every one of its
+     * ancestors. A query is answered through the lowest common ancestor of
+     * the two frames, so that the edges shared by both paths do not add
+     * their uncertainty twice. Updating an edge invalidates the caches of
+     * the subtree below it only, they are recomputed on the next query.
+     *
+     * Several threads can query the graph while one thread adds frames and
+     * updates edges.
+     */
+    class FrameGraph
+    {
+    public:
+	typedef TransformWithUncertainty::PropagationMethod PropagationMethod;
+
+    public:
+	/** the propagation method is used for all the compositions */
+	explicit FrameGraph( PropagationMethod method = TransformWithUncertainty::PENNEC_THIRION );
+
+	/** adds a root frame, returns false if the frame already exists */
+	bool addFrame( const std::string& frame );
+
+	/** adds a frame below parent with the transform from frame to parent.
+	 * Returns false if the frame already exists or the parent does not.
+	 */
+	bool addFrame( const std::string& frame, const std::string& parent,
+		const TransformWithUncertainty& frame2parent );
+
+	/** sets the transform from frame to its parent */
+	bool updateTransform( const std::string& frame, const TransformWithUncertainty& frame2parent );
+	bool updateTransform( int frame, const TransformWithUncertainty& frame2parent );
+
+	/** transform which maps coordinates of source into target. Returns
+	 * false if one of the frames does not exist or they are not connected.
+	 */
+	bool getTransform( const std::string& source, const std::string& target,
+		TransformWithUncertainty& source2target ) const;
+	bool getTransform( int source, int target, TransformWithUncertainty& source2target ) const;
+
+	/** id of the frame for the queries by id, -1 if it does not exist */
+	int getFrameId( const std::string& frame ) const;
+
+	size_t size() const;
+
+    private:
+	struct Frame
+	{
+	    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	    std::string name;
+	    int parent;
+	    int depth;
+	    std::vector<int> children;
+
+	    /** transform from the frame to its parent */
+	    TransformWithUncertainty edge;
+
+	    /** ancestors[k] is the transform from the frame to its ancestor
+	     * of depth k, valid when cached is true */
+	    std::vector<TransformWithUncertainty, Eigen::aligned_allocator<TransformWithUncertainty> > ancestors;
+	    bool cached;
+	};
+
+	int addFrameUnlocked( const std::string& frame, int parent, const TransformWithUncertainty& frame2parent );
+	void invalidate( int frame );
+
+	/** recomputes the caches of the frame and its ancestors if needed,
+	 * requires cache_mutex exclusively */
+	void updateCache( int frame ) const;
+
+	/** transform from frame to its ancestor, requires cache_mutex */
+	TransformWithUncertainty toAncestor( int frame, int ancestor ) const;
+
+	PropagationMethod method;
+
+	/** frames are modified mutably while filling the cache, which is
+	 * protected by cache_mutex */
+	mutable std::vector<Frame, Eigen::aligned_allocator<Frame> > frames;
+	std::map<std::string, int> ids;
+
+	/** shared by the readers, exclusive for the writer */
+	mutable boost::shared_mutex graph_mutex;
+	/** shared by the readers of a warm cache, exclusive for the readers
+	 * filling it */
+	mutable boost::shared_mutex cache_mutex;
+    };
+}
+
+#endif
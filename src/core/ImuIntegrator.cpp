@@ -0,0 +1,111 @@
+#include "ImuIntegrator.hpp"
+#include <iostream>
+#include <algorithm>
+
+using namespace localization;
+
+ImuIntegrator::ImuIntegrator( unsigned int samples_per_increment, size_t capacity )
+    : samples_per_increment( std::max( samples_per_increment, 1u ) ),
+    samples( capacity ),
+    dropped( 0 )
+{
+    reset();
+}
+
+bool ImuIntegrator::push( const base::Time& time, const Eigen::Vector3d& gyro, const Eigen::Vector3d& acc )
+{
+    Sample sample;
+    sample.time = time.toMicroseconds();
+    sample.gyro = gyro;
+    sample.acc = acc;
+
+    if( !samples.push( sample ) )
+    {
+	// no logging on the producer side, it is usually a driver thread
+	dropped.fetch_add( 1, boost::memory_order_relaxed );
+	return false;
+    }
+    return true;
+}
+
+bool ImuIntegrator::pop( ImuIncrement& increment )
+{
+    Sample sample;
+    while( samples.pop( sample ) )
+    {
+	integrate( sample );
+
+	if( step_samples == samples_per_increment )
+	{
+	    // rotation vector of the step and velocity in the body at its
+	    // start, with the rotation compensation up to the second order
+	    const Eigen::Vector3d rotation( alpha.cross( nu ) );
+	    increment.time = base::Time::fromMicroseconds( last_time );
+	    increment.delta_t = step_time;
+	    increment.delta_angle = alpha + beta;
+	    increment.delta_velocity = nu + 0.5 * rotation + alpha.cross( rotation ) / 6.0 + sculling;
+	    increment.samples = step_samples;
+
+	    alpha.setZero();
+	    nu.setZero();
+	    beta.setZero();
+	    sculling.setZero();
+	    step_time = 0.0;
+	    step_samples = 0;
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+void ImuIntegrator::reset()
+{
+    samples.clear();
+    dropped.store( 0, boost::memory_order_relaxed );
+
+    started = false;
+    last_time = 0;
+    alpha.setZero();
+    nu.setZero();
+    beta.setZero();
+    sculling.setZero();
+    step_time = 0.0;
+    step_samples = 0;
+    last_dtheta.setZero();
+    last_dv.setZero();
+}
+
+void ImuIntegrator::integrate( const Sample& sample )
+{
+    if( !started )
+    {
+	started = true;
+	last_time = sample.time;
+	return;
+    }
+
+    const double dt = static_cast<double>( sample.time - last_time ) * 1e-6;
+    last_time = sample.time;
+    if( dt <= 0.0 )
+    {
+	std::cerr << "[IMU_INTEGRATOR] sample at " << sample.time << " is not newer than the previous one" << std::endl;
+	return;
+    }
+
+    const Eigen::Vector3d dtheta( sample.gyro * dt );
+    const Eigen::Vector3d dv( sample.acc * dt );
+
+    // the compensations use the sums before this sample and the increments
+    // of the previous sample, which model the rates as linear in time
+    beta += 0.5 * ( alpha + last_dtheta / 6.0 ).cross( dtheta );
+    sculling += 0.5 * ( ( alpha + last_dtheta / 6.0 ).cross( dv ) + ( nu + last_dv / 6.0 ).cross( dtheta ) );
+
+    alpha += dtheta;
+    nu += dv;
+    step_time += dt;
+    ++step_samples;
+
+    last_dtheta = dtheta;
+    last_dv = dv;
+}
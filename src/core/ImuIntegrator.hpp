@@ -0,0 +1,107 @@
+#ifndef _LOCALIZATION_CORE_IMU_INTEGRATOR_HPP_
+#define _LOCALIZATION_CORE_IMU_INTEGRATOR_HPP_
+
+#include <stdint.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <boost/atomic.hpp>
+#include <base/Time.hpp>
+#include <localization/core/SpscQueue.hpp>
+
+namespace localization
+{
+    /** compensated increments of one low rate step */
+    struct ImuIncrement
+    {
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	/** time of the last sample of the step */
+	base::Time time;
+	/** duration of the step */
+	double delta_t;
+	/** rotation vector from the body at the end of the step to the body
+	 * at its start, coning compensated */
+	Eigen::Vector3d delta_angle;
+	/** specific force integrated over the step in the body at its
+	 * start, rotation and sculling compensated */
+	Eigen::Vector3d delta_velocity;
+	/** number of imu samples in the step */
+	unsigned int samples;
+    };
+
+    /**
+     * Integrates high rate gyroscope and accelerometer samples into
+     * increments at a lower rate for the filter.
+     *
+     * Every sample gives a delta angle and delta velocity over the time
+     * since the previous sample. Within one step they are accumulated with
+     * the two speed coning and sculling algorithms of Savage (Strapdown
+     * Inertial Navigation Integration Algorithm Design), which use the
+     * increments of the previous sample to compensate the rotation of the
+     * body during the step. The velocity rotation compensation keeps the
+     * second order term, so that long steps stay accurate. One increment is
+     * emitted every samples_per_increment samples.
+     *
+     * The raw samples are queued in a fixed capacity ring buffer. One
+     * thread can push them (e.g. the driver) while another one pops the
+     * increments, without locks.
+     */
+    class ImuIntegrator
+    {
+    public:
+	ImuIntegrator( unsigned int samples_per_increment, size_t capacity = 1024 );
+
+	/** queues a raw sample with the angular velocity and the specific
+	 * force in body frame. False if the buffer is full, the sample is
+	 * then dropped and counted. Producer only. */
+	bool push( const base::Time& time, const Eigen::Vector3d& gyro, const Eigen::Vector3d& acc );
+
+	/** integrates the queued samples until one increment is complete.
+	 * False if there are not enough samples yet, they stay integrated.
+	 * Consumer only. */
+	bool pop( ImuIncrement& increment );
+
+	/** drops the queued samples and the partial increment, and clears
+	 * the count of dropped samples. Consumer only, the producer must not
+	 * push meanwhile. */
+	void reset();
+
+	/** number of samples dropped because the buffer was full, for the
+	 * consumer to report */
+	uint64_t getDropped() const { return dropped.load( boost::memory_order_relaxed ); }
+
+	unsigned int getSamplesPerIncrement() const { return samples_per_increment; }
+	size_t capacity() const { return samples.capacity(); }
+
+    private:
+	struct Sample
+	{
+	    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	    int64_t time;
+	    Eigen::Vector3d gyro;
+	    Eigen::Vector3d acc;
+	};
+
+	/** adds one sample to the current step */
+	void integrate( const Sample& sample );
+
+	unsigned int samples_per_increment;
+
+	SpscQueue<Sample> samples;
+	boost::atomic<uint64_t> dropped;
+
+	/** time of the previous sample, no increment before the first one */
+	int64_t last_time;
+	bool started;
+
+	/** current step: summed angle alpha and velocity nu, coning beta and
+	 * sculling terms, duration and number of samples */
+	Eigen::Vector3d alpha, nu, beta, sculling;
+	double step_time;
+	unsigned int step_samples;
+
+	/** increments of the previous sample, also across steps */
+	Eigen::Vector3d last_dtheta, last_dv;
+    };
+}
+
+#endif
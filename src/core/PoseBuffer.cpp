@@ -0,0 +1,235 @@
+#include "PoseBuffer.hpp"
+#include "TransformImpl.hpp"
+#include <iostream>
+#include <algorithm>
+
+using namespace localization;
+
+PoseBuffer::PoseBuffer( size_t capacity )
+    : samples( std::max( capacity, static_cast<size_t>( 2 ) ) ),
+    sequences( new boost::atomic<uint64_t>[samples.size()] ),
+    head( 0 ), first( 0 )
+{
+    for( size_t i = 0; i < samples.size(); ++i )
+	sequences[i].store( 0 );
+}
+
+bool PoseBuffer::push( const base::Time& time, const TransformWithUncertainty& pose )
+{
+    const uint64_t index = head.load( boost::memory_order_relaxed );
+    const int64_t time_us = time.toMicroseconds();
+
+    int64_t newest;
+    if( index > first.load( boost::memory_order_relaxed ) && readTime( index - 1, newest ) && time_us <= newest )
+    {
+	std::cerr << "[POSE_BUFFER] pose at " << time_us << " is not newer than " << newest << std::endl;
+	return false;
+    }
+
+    const size_t slot = index % samples.size();
+    Sample &sample( samples[slot] );
+
+    // readers of the slot see an odd sequence or a change of it
+    sequences[slot].store( 2 * index + 1, boost::memory_order_relaxed );
+    boost::atomic_thread_fence( boost::memory_order_release );
+
+    sample.time = time_us;
+    sample.position = pose.getTransform().translation();
+    sample.orientation = pose.getQuaternion();
+    sample.cov = pose.getCovariance();
+    sample.uncertain = pose.hasUncertainty();
+
+    sequences[slot].store( 2 * index + 2, boost::memory_order_release );
+    head.store( index + 1, boost::memory_order_release );
+
+    return true;
+}
+
+void PoseBuffer::clear()
+{
+    first.store( head.load( boost::memory_order_relaxed ), boost::memory_order_release );
+}
+
+size_t PoseBuffer::size() const
+{
+    uint64_t begin, end;
+    range( begin, end );
+    return end - begin;
+}
+
+void PoseBuffer::range( uint64_t& begin, uint64_t& end ) const
+{
+    end = head.load( boost::memory_order_acquire );
+    begin = first.load( boost::memory_order_acquire );
+    if( end > samples.size() )
+	begin = std::max( begin, static_cast<uint64_t>( end - samples.size() ) );
+    begin = std::min( begin, end );
+}
+
+bool PoseBuffer::read( uint64_t index, Sample& sample ) const
+{
+    const size_t slot = index % samples.size();
+    const uint64_t sequence = sequences[slot].load( boost::memory_order_acquire );
+    if( sequence != 2 * index + 2 )
+	return false;
+
+    sample = samples[slot];
+
+    boost::atomic_thread_fence( boost::memory_order_acquire );
+    return sequences[slot].load( boost::memory_order_relaxed ) == sequence;
+}
+
+bool PoseBuffer::readTime( uint64_t index, int64_t& time ) const
+{
+    const size_t slot = index % samples.size();
+    const uint64_t sequence = sequences[slot].load( boost::memory_order_acquire );
+    if( sequence != 2 * index + 2 )
+	return false;
+
+    time = samples[slot].time;
+
+    boost::atomic_thread_fence( boost::memory_order_acquire );
+    return sequences[slot].load( boost::memory_order_relaxed ) == sequence;
+}
+
+TransformWithUncertainty PoseBuffer::toTransform( const Sample& sample )
+{
+    Transform trans( sample.orientation );
+    trans.translation() = sample.position;
+    if( !sample.uncertain )
+	return TransformWithUncertainty( trans );
+    return TransformWithUncertainty( trans, sample.cov );
+}
+
+bool PoseBuffer::getLatest( base::Time& time, TransformWithUncertainty& pose ) const
+{
+    Sample sample;
+    while( true )
+    {
+	uint64_t begin, end;
+	range( begin, end );
+	if( begin == end )
+	    return false;
+
+	if( read( end - 1, sample ) )
+	    break;
+    }
+
+    time = base::Time::fromMicroseconds( sample.time );
+    pose = toTransform( sample );
+    return true;
+}
+
+bool PoseBuffer::getTimeRange( base::Time& first_time, base::Time& last_time ) const
+{
+    int64_t t0, t1;
+    while( true )
+    {
+	uint64_t begin, end;
+	range( begin, end );
+	if( begin == end )
+	    return false;
+
+	if( readTime( begin, t0 ) && readTime( end - 1, t1 ) )
+	    break;
+    }
+
+    first_time = base::Time::fromMicroseconds( t0 );
+    last_time = base::Time::fromMicroseconds( t1 );
+    return true;
+}
+
+bool PoseBuffer::interpolate( const base::Time& time, TransformWithUncertainty& pose ) const
+{
+    const int64_t time_us = time.toMicroseconds();
+    Sample s0, s1;
+
+    // retry from the start if the writer overwrote one of the samples read
+    while( true )
+    {
+	uint64_t begin, end;
+	range( begin, end );
+	if( begin == end )
+	    return false;
+
+	int64_t t_begin, t_end;
+	if( !readTime( begin, t_begin ) || !readTime( end - 1, t_end ) )
+	    continue;
+	if( time_us < t_begin || time_us > t_end )
+	    return false;
+
+	// first index with a time greater or equal than the requested one
+	uint64_t lo = begin, hi = end - 1;
+	bool overwritten = false;
+	while( lo < hi )
+	{
+	    const uint64_t mid = lo + ( hi - lo ) / 2;
+	    int64_t t_mid;
+	    if( !readTime( mid, t_mid ) )
+	    {
+		overwritten = true;
+		break;
+	    }
+	    if( t_mid < time_us )
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	if( overwritten || !read( lo, s1 ) )
+	    continue;
+
+	if( s1.time == time_us )
+	{
+	    pose = toTransform( s1 );
+	    return true;
+	}
+
+	if( read( lo - 1, s0 ) )
+	    break;
+    }
+
+    const double alpha = static_cast<double>( time_us - s0.time ) / static_cast<double>( s1.time - s0.time );
+
+    Transform trans( s0.orientation.slerp( alpha, s1.orientation ) );
+    trans.translation() = ( 1.0 - alpha ) * s0.position + alpha * s1.position;
+
+    if( !s0.uncertain && !s1.uncertain )
+    {
+	pose = TransformWithUncertainty( trans );
+	return true;
+    }
+
+    // R = R0 * exp( alpha * phi ) with exp( phi ) = R0^T * R1. Perturbing
+    // R0 and R1 in their tangent spaces gives the tangent perturbation of R,
+    // the right Jacobians map them to the rotation vectors [r t].
+    const Eigen::Matrix3d R0( s0.orientation.toRotationMatrix() );
+    const Eigen::Matrix3d R1( s1.orientation.toRotationMatrix() );
+    const Eigen::Matrix3d Rphi( R0.transpose() * R1 );
+    const Eigen::Matrix3d Ralpha( R0.transpose() * trans.linear() );
+    const Eigen::Vector3d phi( detail::q_to_r( Eigen::Quaterniond( Rphi ) ) );
+
+    const Eigen::Matrix3d Jr_inv( detail::so3_right_jacobian_inverse(
+		detail::q_to_r( Eigen::Quaterniond( trans.linear() ) ) ) );
+    const Eigen::Matrix3d D( alpha * detail::so3_right_jacobian( Eigen::Vector3d( alpha * phi ) )
+	    * detail::so3_right_jacobian_inverse( phi ) );
+
+    TransformWithUncertainty::Covariance cov( TransformWithUncertainty::Covariance::Zero() );
+    if( s0.uncertain )
+    {
+	TransformWithUncertainty::Covariance J0( TransformWithUncertainty::Covariance::Zero() );
+	J0.topLeftCorner<3,3>() = Jr_inv * ( Ralpha.transpose() - D * Rphi.transpose() )
+	    * detail::so3_right_jacobian( detail::q_to_r( s0.orientation ) );
+	J0.bottomRightCorner<3,3>() = ( 1.0 - alpha ) * Eigen::Matrix3d::Identity();
+	cov += J0 * s0.cov * J0.transpose();
+    }
+    if( s1.uncertain )
+    {
+	TransformWithUncertainty::Covariance J1( TransformWithUncertainty::Covariance::Zero() );
+	J1.topLeftCorner<3,3>() = Jr_inv * D * detail::so3_right_jacobian( detail::q_to_r( s1.orientation ) );
+	J1.bottomRightCorner<3,3>() = alpha * Eigen::Matrix3d::Identity();
+	cov += J1 * s1.cov * J1.transpose();
+    }
+
+    pose = TransformWithUncertainty( trans, cov );
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef _LOCALIZATION_CORE_POSE_BUFFER_HPP_
+#define _LOCALIZATION_CORE_POSE_BUFFER_HPP_
+
+#include <vector>
+#include <stdint.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <base/Time.hpp>
+#include <localization/core/Transform.hpp>
+
+namespace localization
+{
+    /**
+     * Fixed capacity ring buffer of timestamped poses with uncertainty.
+     *
+     * Poses are pushed with increasing timestamps, the oldest pose is
+     * overwritten once the buffer is full. The pose at any time between the
+     * oldest and the newest sample is found by binary search in O(log n)
+     * and interpolated between the two surrounding samples: SLERP for the
+     * rotation and linear for the translation.
+     *
+     * The covariance of the interpolated pose is propagated with the exact
+     * Jacobians of the interpolation with respect to both samples. As for the
+     * composition of transforms, the two samples are taken as independent.
+     *
+     * One thread can push while any number of threads read, without locks.
+     * Each slot is protected by a sequence number, readers retry when the
+     * slot they read was overwritten in the meantime.
+     */
+    class PoseBuffer
+    {
+    public:
+	explicit PoseBuffer( size_t capacity );
+
+	/** adds a pose, the time has to be newer than the newest pose.
+	 * Only one thread may push. */
+	bool push( const base::Time& time, const TransformWithUncertainty& pose );
+
+	/** removes all the poses, writer thread only */
+	void clear();
+
+	/** pose at time, false if time is outside of the buffered range */
+	bool interpolate( const base::Time& time, TransformWithUncertainty& pose ) const;
+
+	/** newest pose and its time, false if the buffer is empty */
+	bool getLatest( base::Time& time, TransformWithUncertainty& pose ) const;
+
+	/** times of the oldest and the newest pose, false if the buffer is empty */
+	bool getTimeRange( base::Time& first, base::Time& last ) const;
+
+	size_t size() const;
+	size_t capacity() const { return samples.size(); }
+
+    private:
+	struct Sample
+	{
+	    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	    int64_t time;
+	    Eigen::Vector3d position;
+	    Eigen::Quaterniond orientation;
+	    TransformWithUncertainty::Covariance cov;
+	    bool uncertain;
+	};
+
+	/** oldest and one past the newest valid index */
+	void range( uint64_t& begin, uint64_t& end ) const;
+
+	/** copies the sample of the index, false if it was overwritten */
+	bool read( uint64_t index, Sample& sample ) const;
+	bool readTime( uint64_t index, int64_t& time ) const;
+
+	static TransformWithUncertainty toTransform( const Sample& sample );
+
+	std::vector<Sample, Eigen::aligned_allocator<Sample> > samples;
+
+	/** 2 * index + 2 of the sample in the slot, odd while it is written */
+	boost::scoped_array< boost::atomic<uint64_t> > sequences;
+
+	/** number of poses pushed since the creation */
+	boost::atomic<uint64_t> head;
+	/** first index after the last clear() */
+	boost::atomic<uint64_t> first;
+    };
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef _LOCALIZATION_CORE_SPSC_QUEUE_HPP_
+#define _LOCALIZATION_CORE_SPSC_QUEUE_HPP_
+
+#include <vector>
+#include <stdint.h>
+#include <algorithm>
+#include <Eigen/StdVector>
+#include <boost/atomic.hpp>
+
+namespace localization
+{
+    /**
+     * Bounded lock-free queue for one producer and one consumer thread.
+     *
+     * The elements are copied into a ring buffer allocated once in the
+     * constructor, push and pop never allocate nor block.
+     */
+    template <typename _Type>
+    class SpscQueue
+    {
+    public:
+	explicit SpscQueue( size_t capacity )
+	    : elements( std::max( capacity, static_cast<size_t>( 1 ) ) ),
+	    head( 0 ), tail( 0 ) {}
+
+	/** false if the queue is full. Producer only. */
+	bool push( const _Type& element )
+	{
+	    const uint64_t index = head.load( boost::memory_order_relaxed );
+	    if( index - tail.load( boost::memory_order_acquire ) >= elements.size() )
+		return false;
+
+	    elements[index % elements.size()] = element;
+	    head.store( index + 1, boost::memory_order_release );
+	    return true;
+	}
+
+	/** false if the queue is empty. Consumer only. */
+	bool pop( _Type& element )
+	{
+	    const uint64_t index = tail.load( boost::memory_order_relaxed );
+	    if( index == head.load( boost::memory_order_acquire ) )
+		return false;
+
+	    element = elements[index % elements.size()];
+	    tail.store( index + 1, boost::memory_order_release );
+	    return true;
+	}
+
+	/** drops the queued elements. Consumer only. */
+	void clear()
+	{
+	    tail.store( head.load( boost::memory_order_acquire ), boost::memory_order_release );
+	}
+
+	/** number of queued elements, approximate while the other thread
+	 * pushes or pops */
+	size_t size() const
+	{
+	    const uint64_t end = head.load( boost::memory_order_acquire );
+	    return end - tail.load( boost::memory_order_acquire );
+	}
+
+	bool empty() const { return size() == 0; }
+	size_t capacity() const { return elements.size(); }
+
+    private:
+	std::vector<_Type, Eigen::aligned_allocator<_Type> > elements;
+
+	/** number of elements pushed and popped */
+	boost::atomic<uint64_t> head, tail;
+    };
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define _LOCALIZATION_CORE_TRANSFORM_HPP_
 
 #include <Eigen/Core>
+#include <Eigen/Geometry>
 #include <base/samples/RigidBodyState.hpp>
 
 namespace localization
@@ -13,16 +14,19 @@ namespace localization
      *
      * The uncertainty is represented as a 3x3 covariance matrix.
      */
-    class PointWithUncertainty
+    template <typename _Scalar>
+    class PointWithUncertaintyT
     {
     public:
-	typedef Eigen::Matrix<double,3,3> Covariance;
+	typedef _Scalar Scalar;
+	typedef Eigen::Matrix<_Scalar,3,1> Point;
+	typedef Eigen::Matrix<_Scalar,3,3> Covariance;
 
     public:
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-	PointWithUncertainty();
-	PointWithUncertainty( const Point& point );
-	PointWithUncertainty( const Point& point, const Covariance& cov );
+	PointWithUncertaintyT();
+	PointWithUncertaintyT( const Point& point );
+	PointWithUncertaintyT( const Point& point, const Covariance& cov );
 
 	const Covariance& getCovariance() const { return cov; }
 	void setCovariance( const Covariance& cov ) { this->cov = cov; uncertain = true; }
@@ -31,12 +35,24 @@ namespace localization
 
 	bool hasUncertainty() const { return uncertain; }
 
+	/** same point with the coefficients converted to _NewScalar */
+	template <typename _NewScalar>
+	PointWithUncertaintyT<_NewScalar> cast() const
+	{
+	    if( !uncertain )
+		return PointWithUncertaintyT<_NewScalar>( point.template cast<_NewScalar>() );
+	    return PointWithUncertaintyT<_NewScalar>( point.template cast<_NewScalar>(), cov.template cast<_NewScalar>() );
+	}
+
     protected:
 	Point point;
 	Covariance cov;
 	bool uncertain;
     };
 
+    typedef PointWithUncertaintyT<double> PointWithUncertainty;
+    typedef PointWithUncertaintyT<float> PointWithUncertaintyf;
+
     /** 
      * Class which is used to represent a 3D Transform.
      *
@@ -55,63 +71,162 @@ namespace localization
      *
      * The uncertainty information is optional. The hasUncertainty() method can
      * be used to see if uncertainty information is associated with the class.
+     *
+     * The quaternion and the rotation vector of the rotation are computed on
+     * first use and cached until the transform changes. The cache makes the
+     * const accessors unsafe to call concurrently on the same object.
+     *
+     * The class is a template over the scalar type. It is instantiated in the
+     * library for double (TransformWithUncertainty) and float
+     * (TransformWithUncertaintyf). Other scalars, e.g. automatic
+     * differentiation types to check the Jacobians, need to include
+     * TransformImpl.hpp.
      */
-    class TransformWithUncertainty
+    template <typename _Scalar>
+    class TransformWithUncertaintyT
     {
 
     public:
-	typedef Eigen::Matrix<double,6,6> Covariance;
+	typedef _Scalar Scalar;
+	typedef Eigen::Transform<_Scalar,3,Eigen::Affine> Transform;
+	typedef Eigen::Matrix<_Scalar,6,6> Covariance;
+	typedef Eigen::Quaternion<_Scalar> Quaternion;
+	typedef Eigen::Matrix<_Scalar,3,1> Vector3;
+	typedef PointWithUncertaintyT<_Scalar> PointWithUncertainty;
+
+	/** How the uncertainty is propagated by an operation
+	 *
+	 * PENNEC_THIRION uses the Jacobians of the quaternion representation
+	 * with the series approximations of the paper. They are only accurate
+	 * for moderate rotations.
+	 *
+	 * ADJOINT uses the closed form right Jacobian of SO(3) and the adjoint
+	 * of the rotation, the Jacobians are exact for any rotation and need
+	 * no quaternion conversions.
+	 */
+	enum PropagationMethod
+	{
+	    PENNEC_THIRION = 0,
+	    ADJOINT = 1
+	};
 
     public:
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-	TransformWithUncertainty();
-	explicit TransformWithUncertainty( const base::samples::RigidBodyState& rbs );
-	explicit TransformWithUncertainty( const Transform& trans );
-	TransformWithUncertainty( const Transform& trans, const Covariance& cov );
+	TransformWithUncertaintyT();
+	explicit TransformWithUncertaintyT( const base::samples::RigidBodyState& rbs );
+	explicit TransformWithUncertaintyT( const Transform& trans );
+	TransformWithUncertaintyT( const Transform& trans, const Covariance& cov );
 
-	static TransformWithUncertainty Identity();
+	static TransformWithUncertaintyT Identity();
 
 	/** performs a composition of this transform with the transform given.
 	 * The result is another transform with result = this * trans
 	 */
-	TransformWithUncertainty composition( const TransformWithUncertainty& trans ) const;
+	TransformWithUncertaintyT composition( const TransformWithUncertaintyT& trans,
+		PropagationMethod method = PENNEC_THIRION ) const;
+
+	/** transforms the point, same as operator* with the selected propagation
+	 */
+	PointWithUncertainty composition( const PointWithUncertainty& point,
+		PropagationMethod method = PENNEC_THIRION ) const;
 
 	/** performs an inverse composition of two transformations.
 	 * The result is such that result * trans = this. Note that this is different from
 	 * calling result = this * inv(trans), in the way the uncertainties are handled.
 	 */
-	TransformWithUncertainty compositionInv( const TransformWithUncertainty& trans ) const;
+	TransformWithUncertaintyT compositionInv( const TransformWithUncertaintyT& trans,
+		PropagationMethod method = PENNEC_THIRION ) const;
 
 	/** Same as compositionInv, just that the trans * result = this.
 	 */
-	TransformWithUncertainty preCompositionInv( const TransformWithUncertainty& t2 ) const;
+	TransformWithUncertaintyT preCompositionInv( const TransformWithUncertaintyT& t2,
+		PropagationMethod method = PENNEC_THIRION ) const;
 
 	/** alias for the composition of two transforms
 	 */
-	TransformWithUncertainty operator*( const TransformWithUncertainty& trans ) const;
+	TransformWithUncertaintyT operator*( const TransformWithUncertaintyT& trans ) const;
 	PointWithUncertainty operator*( const PointWithUncertainty& point ) const;
-	TransformWithUncertainty inverse() const;
 
-	TransformWithUncertainty& operator=( const base::samples::RigidBodyState& rbs );
+	/** in place composition, this = this * trans. Same result as
+	 * operator* without the temporary transform.
+	 */
+	TransformWithUncertaintyT& operator*=( const TransformWithUncertaintyT& trans );
+	TransformWithUncertaintyT inverse( PropagationMethod method = PENNEC_THIRION ) const;
+
+	/** the rigid body state is always in double, it is converted to _Scalar */
+	TransformWithUncertaintyT& operator=( const base::samples::RigidBodyState& rbs );
 	void copyToRigidBodyState( base::samples::RigidBodyState& rbs ) const;
-	
+
+	/** same transform with the coefficients converted to _NewScalar */
+	template <typename _NewScalar>
+	TransformWithUncertaintyT<_NewScalar> cast() const
+	{
+	    typedef TransformWithUncertaintyT<_NewScalar> Result;
+	    if( !uncertain )
+		return Result( trans.template cast<_NewScalar>() );
+	    return Result( trans.template cast<_NewScalar>(), cov.template cast<_NewScalar>() );
+	}
 	
 	const Covariance& getCovariance() const { return cov; }
 	void setCovariance( const Covariance& cov ) { this->cov = cov; uncertain = true; }
 	const Transform& getTransform() const { return trans; }
-	void setTransform( const Transform& trans ) { this->trans = trans; }
+	void setTransform( const Transform& trans ) { this->trans = trans; invalidateCache(); }
+
+	/** rotation of the transform as a quaternion (cached) */
+	const Quaternion& getQuaternion() const;
+	/** rotation of the transform as a scaled axis of rotation (cached) */
+	const Vector3& getRotationVector() const;
 
 	bool hasUncertainty() const { return uncertain; }
 
     protected:
+	/** covariance of t2 * t1 with the PENNEC_THIRION propagation */
+	static Covariance compositionCovariance( const TransformWithUncertaintyT& t2, const TransformWithUncertaintyT& t1 );
+
+	/** closed form propagation, see PropagationMethod */
+	TransformWithUncertaintyT compositionAdjoint( const TransformWithUncertaintyT& t1 ) const;
+	TransformWithUncertaintyT compositionInvAdjoint( const TransformWithUncertaintyT& t1 ) const;
+	TransformWithUncertaintyT preCompositionInvAdjoint( const TransformWithUncertaintyT& t2 ) const;
+	TransformWithUncertaintyT inverseAdjoint() const;
+	PointWithUncertainty pointAdjoint( const PointWithUncertainty& point ) const;
+
+	/** needs to be called by derived classes which modify trans directly */
+	void invalidateCache() { cached = 0; }
+
 	Transform trans;
 	Covariance cov;
 	bool uncertain;
+
+    private:
+	enum CacheFlags
+	{
+	    QUATERNION_CACHED = 1,
+	    ROTATION_VECTOR_CACHED = 2
+	};
+
+	mutable Quaternion q_cache;
+	mutable Vector3 r_cache;
+	mutable int cached;
     };
+
+    typedef TransformWithUncertaintyT<double> TransformWithUncertainty;
+    typedef TransformWithUncertaintyT<float> TransformWithUncertaintyf;
     
+    /** composition of rigid body states with uncertainty, result = t2 * t1.
+     *
+     * Same result as converting both states to TransformWithUncertainty,
+     * composing them and calling copyToRigidBodyState(). The rigid body state
+     * has no correlation between orientation and position, only the 3x3
+     * blocks of the propagation are computed. Only the pose and its
+     * covariance of result are written.
+     */
+    void composition( const base::samples::RigidBodyState& t2, const base::samples::RigidBodyState& t1,
+	    base::samples::RigidBodyState& result );
+
     /** Default std::cout function
      */
-    std::ostream & operator<<(std::ostream &out, const  TransformWithUncertainty& trans);
+    template <typename _Scalar>
+    std::ostream & operator<<(std::ostream &out, const  TransformWithUncertaintyT<_Scalar>& trans);
 }
 
 #endif
@@ -0,0 +1,560 @@
+#include "TransformBatch.hpp"
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <iostream>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include <localization/filters/SO3Batch.hpp>
+
+using namespace localization;
+
+namespace
+{
+    // poses are processed in chunks which fit in the cache, the Jacobians
+    // of a chunk are formed LANES poses at a time
+    const int LANES = 8;
+    const int CHUNK = 32 * LANES;
+
+    typedef SO3Batch<double, LANES> SO3Lanes;
+    typedef SO3Lanes::Lane Lane;
+
+    struct Vec3Lane
+    {
+	Lane c[3];
+
+	Lane& operator[]( int i ) { return c[i]; }
+	const Lane& operator[]( int i ) const { return c[i]; }
+    };
+
+    inline Lane dot( const Vec3Lane& a, const Vec3Lane& b )
+    {
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+    }
+
+    inline Vec3Lane cross( const Vec3Lane& a, const Vec3Lane& b )
+    {
+	Vec3Lane res;
+	res[0] = a[1]*b[2] - a[2]*b[1];
+	res[1] = a[2]*b[0] - a[0]*b[2];
+	res[2] = a[0]*b[1] - a[1]*b[0];
+	return res;
+    }
+
+    inline Vec3Lane scaled( const Lane& s, const Vec3Lane& a )
+    {
+	Vec3Lane res;
+	res[0] = s*a[0]; res[1] = s*a[1]; res[2] = s*a[2];
+	return res;
+    }
+
+    inline Vec3Lane add( const Vec3Lane& a, const Vec3Lane& b )
+    {
+	Vec3Lane res;
+	res[0] = a[0]+b[0]; res[1] = a[1]+b[1]; res[2] = a[2]+b[2];
+	return res;
+    }
+
+    // dr_by_dq( q ) * d for the quaternion d = ( dw, dv ), see Transform.cpp
+    struct DrByDq
+    {
+	Vec3Lane v;
+	Lane tau, nu;
+
+	DrByDq( const Lane& w, const Vec3Lane& v ) : v( v )
+	{
+	    const Lane mu2 = dot( v, v );
+	    const Lane sign = (w > 0.0).select( Lane::Ones(), -Lane::Ones() );
+	    tau = 2.0 * sign * ( 1.0 + mu2/6.0 );
+	    nu = -2.0 * sign * ( 2.0/3.0 + mu2/5.0 );
+	}
+
+	Vec3Lane operator()( const Lane& dw, const Vec3Lane& dv ) const
+	{
+	    const Lane vdv = nu * dot( v, dv );
+	    Vec3Lane res;
+	    for( int i = 0; i < 3; ++i )
+		res[i] = -2.0 * v[i] * dw + tau * dv[i] + vdv * v[i];
+	    return res;
+	}
+    };
+
+    // column j of dq_by_dr( q, r ) as a quaternion ( cw, cv )
+    inline void dqByDrColumn( const Vec3Lane& v, const Vec3Lane& r, const Lane& kappa, const Lane& lambda,
+	    int j, Lane& cw, Vec3Lane& cv )
+    {
+	cw = -0.5 * v[j];
+	cv = scaled( -lambda * r[j], r );
+	cv[j] += kappa;
+    }
+
+    /** Jacobian blocks of one chunk, 3x3 column-major blocks, one column per pose
+     */
+    struct ChunkJacobians
+    {
+	Eigen::Matrix<double,9,Eigen::Dynamic> A; // dr2r1_by_r1
+	Eigen::Matrix<double,9,Eigen::Dynamic> B; // dr2r1_by_r2
+	Eigen::Matrix<double,9,Eigen::Dynamic> D; // drx_by_dr
+	Eigen::Matrix<double,4,Eigen::Dynamic> q2; // rotation of the pose before the delta
+	Eigen::Matrix<double,9,Eigen::Dynamic> R2; // same rotation as matrix
+
+	ChunkJacobians() : A( 9, CHUNK ), B( 9, CHUNK ), D( 9, CHUNK ), q2( 4, CHUNK ), R2( 9, CHUNK ) {}
+    };
+
+    // Jacobians of the poses [begin, begin+n) of the chunk, q2 has to be filled
+    void formJacobians( const TransformBatch& deltas, size_t begin, int n, ChunkJacobians& jac )
+    {
+	for( int k = 0; k < n; k += LANES )
+	{
+	    const int size = std::min( LANES, n - k );
+
+	    // gather
+	    Lane w1( Lane::Ones() ), w2( Lane::Ones() );
+	    Vec3Lane v1, v2, x;
+	    for( int i = 0; i < 3; ++i )
+	    {
+		v1[i].setZero(); v2[i].setZero(); x[i].setZero();
+	    }
+	    for( int l = 0; l < size; ++l )
+	    {
+		const Eigen::Quaterniond q1( deltas.orientation.row( begin+k+l ).transpose() );
+		for( int i = 0; i < 3; ++i )
+		{
+		    v1[i][l] = q1.vec()[i];
+		    v2[i][l] = jac.q2( i, k+l );
+		    x[i][l] = deltas.position( begin+k+l, i );
+		}
+		w1[l] = q1.w();
+		w2[l] = jac.q2( 3, k+l );
+	    }
+
+	    // rotation vectors, q_to_r
+	    Vec3Lane r1, r2;
+	    SO3Lanes::log( v1[0], v1[1], v1[2], w1, 1.0, r1[0], r1[1], r1[2] );
+	    SO3Lanes::log( v2[0], v2[1], v2[2], w2, 1.0, r2[0], r2[1], r2[2] );
+
+	    // composed rotation q = q2 * q1
+	    const Lane w = w2*w1 - dot( v2, v1 );
+	    const Vec3Lane v = add( add( scaled( w2, v1 ), scaled( w1, v2 ) ), cross( v2, v1 ) );
+	    const DrByDq drq( w, v );
+
+	    const Lane theta1_sq = dot( r1, r1 ), theta2_sq = dot( r2, r2 );
+	    const Lane kappa1 = 0.5 - theta1_sq/48.0, lambda1 = 1.0/24.0*(1.0 - theta1_sq/40.0);
+	    const Lane kappa2 = 0.5 - theta2_sq/48.0, lambda2 = 1.0/24.0*(1.0 - theta2_sq/40.0);
+
+	    const Lane alpha = 1.0 - theta2_sq/6.0;
+	    const Lane beta = 0.5 - theta2_sq/24.0;
+	    const Lane gamma = 1.0/3.0 - theta2_sq/30.0;
+	    const Lane delta = -1.0/12.0 + theta2_sq/180.0;
+
+	    for( int j = 0; j < 3; ++j )
+	    {
+		Lane cw, dw;
+		Vec3Lane cv, dv;
+
+		// dr2r1_by_r1: dr_by_dq( q ) * dq2q1_by_dq1( q2 ) * dq_by_dr( q1 )
+		dqByDrColumn( v1, r1, kappa1, lambda1, j, cw, cv );
+		dw = w2*cw - dot( v2, cv );
+		dv = add( add( scaled( w2, cv ), scaled( cw, v2 ) ), cross( v2, cv ) );
+		const Vec3Lane a = drq( dw, dv );
+
+		// dr2r1_by_r2: dr_by_dq( q ) * dq2q1_by_dq2( q1 ) * dq_by_dr( q2 )
+		dqByDrColumn( v2, r2, kappa2, lambda2, j, cw, cv );
+		dw = cw*w1 - dot( cv, v1 );
+		dv = add( add( scaled( cw, v1 ), scaled( w1, cv ) ), cross( cv, v1 ) );
+		const Vec3Lane b = drq( dw, dv );
+
+		// drx_by_dr( r2, x ) * e_j
+		Vec3Lane e;
+		for( int i = 0; i < 3; ++i )
+		    e[i].setZero();
+		e[j].setOnes();
+		const Vec3Lane inner = add( add( scaled( gamma * r2[j], r2 ), scaled( -beta, cross( r2, e ) ) ), scaled( alpha, e ) );
+		const Vec3Lane outer = add( scaled( delta * r2[j], r2 ), scaled( 2.0 * beta, e ) );
+		const Vec3Lane d = add( scaled( -Lane::Ones(), cross( x, inner ) ), scaled( -Lane::Ones(), cross( r2, cross( x, outer ) ) ) );
+
+		// scatter
+		for( int l = 0; l < size; ++l )
+		    for( int i = 0; i < 3; ++i )
+		    {
+			jac.A( 3*j+i, k+l ) = a[i][l];
+			jac.B( 3*j+i, k+l ) = b[i][l];
+			jac.D( 3*j+i, k+l ) = d[i][l];
+		    }
+	    }
+	}
+    }
+
+    // cov = J1 * C * J1^T + J2 * P * J2^T with J1 = [A 0; 0 R2] and J2 = [B 0; D I]
+    inline void propagate( const Eigen::Matrix3d& A, const Eigen::Matrix3d& B, const Eigen::Matrix3d& D,
+	    const Eigen::Matrix3d& R2, const Eigen::Matrix<double,6,6>& C, Eigen::Matrix<double,6,6>& P )
+    {
+	const Eigen::Matrix3d P11( P.topLeftCorner<3,3>() );
+	const Eigen::Matrix3d P12( P.topRightCorner<3,3>() );
+	const Eigen::Matrix3d P22( P.bottomRightCorner<3,3>() );
+
+	const Eigen::Matrix3d BP11( B * P11 );
+	const Eigen::Matrix3d DP11( D * P11 + P12.transpose() );
+	const Eigen::Matrix3d AC11( A * C.topLeftCorner<3,3>() );
+	const Eigen::Matrix3d RC22( R2 * C.bottomRightCorner<3,3>() );
+
+	const Eigen::Matrix3d N11( BP11 * B.transpose() + AC11 * A.transpose() );
+	const Eigen::Matrix3d N12( BP11 * D.transpose() + B * P12 + A * C.topRightCorner<3,3>() * R2.transpose() );
+	const Eigen::Matrix3d N22( DP11 * D.transpose() + D * P12 + P22 + RC22 * R2.transpose() );
+
+	P.topLeftCorner<3,3>() = N11;
+	P.topRightCorner<3,3>() = N12;
+	P.bottomLeftCorner<3,3>() = N12.transpose();
+	P.bottomRightCorner<3,3>() = N22;
+    }
+
+    inline Eigen::Matrix3d skew( const Eigen::Vector3d& r )
+    {
+	Eigen::Matrix3d res;
+	res << 0, -r.z(), r.y(),
+	    r.z(), 0, -r.x(),
+	    -r.y(), r.x(), 0;
+	return res;
+    }
+
+    typedef Eigen::Array<double,Eigen::Dynamic,1,Eigen::ColMajor,CHUNK,1> ChunkArray;
+
+    /** Point independent terms of trans * point
+     *
+     * drx_by_dr( r, x ) is linear in x, drx_by_dr = x0*G[0] + x1*G[1] + x2*G[2]
+     */
+    struct PointTransformTerms
+    {
+	Eigen::Matrix3d R;
+	Eigen::Vector3d t;
+	Eigen::Matrix3d G[3];
+	Eigen::Matrix3d Srr, Srt, Stt;
+
+	explicit PointTransformTerms( const TransformWithUncertainty& trans )
+	    : R( trans.getTransform().linear() ), t( trans.getTransform().translation() )
+	{
+	    const Eigen::Vector3d& r( trans.getRotationVector() );
+	    const double theta2 = r.squaredNorm();
+	    const double alpha = 1.0 - theta2/6.0;
+	    const double beta = 0.5 - theta2/24.0;
+	    const double gamma = 1.0 / 3.0 - theta2/30.0;
+	    const double delta = -1.0 / 12.0 + theta2/180.0;
+
+	    const Eigen::Matrix3d M1( gamma*r*r.transpose() - beta*skew(r) + alpha*Eigen::Matrix3d::Identity() );
+	    const Eigen::Matrix3d M2( delta*r*r.transpose() + 2.0*beta*Eigen::Matrix3d::Identity() );
+	    for( int k = 0; k < 3; ++k )
+	    {
+		const Eigen::Matrix3d X( skew( Eigen::Vector3d::Unit(k) ) );
+		G[k] = -X*M1 - skew(r)*X*M2;
+	    }
+
+	    const Eigen::Matrix<double,6,6>& S( trans.getCovariance() );
+	    Srr = S.topLeftCorner<3,3>();
+	    Srt = S.topRightCorner<3,3>();
+	    Stt = S.bottomRightCorner<3,3>();
+	}
+    };
+
+    // transforms the points [begin, end)
+    void transformPointRange( const PointTransformTerms& terms, const PointBatch& points, PointBatch& result,
+	    size_t begin, size_t end )
+    {
+	const bool uncertain = points.hasUncertainty();
+	ChunkArray x[3], D[9], T[9], U[9], V[9], C[9];
+
+	for( size_t b = begin; b < end; b += CHUNK )
+	{
+	    const int n = static_cast<int>( std::min( static_cast<size_t>( CHUNK ), end - b ) );
+
+	    for( int i = 0; i < 3; ++i )
+		x[i] = points.point.col( i ).segment( b, n ).array();
+
+	    // transformed point
+	    for( int i = 0; i < 3; ++i )
+		result.point.col( i ).segment( b, n ) =
+		    ( terms.R(i,0)*x[0] + terms.R(i,1)*x[1] + terms.R(i,2)*x[2] + terms.t(i) ).matrix();
+
+	    // D = drx_by_dr( r, x ), 3x3 column-major
+	    for( int e = 0; e < 9; ++e )
+		D[e] = x[0]*terms.G[0](e) + x[1]*terms.G[1](e) + x[2]*terms.G[2](e);
+
+	    // T = D * Srr and U = D * Srt
+	    for( int j = 0; j < 3; ++j )
+		for( int i = 0; i < 3; ++i )
+		{
+		    T[i+3*j] = D[i]*terms.Srr(0,j) + D[i+3]*terms.Srr(1,j) + D[i+6]*terms.Srr(2,j);
+		    U[i+3*j] = D[i]*terms.Srt(0,j) + D[i+3]*terms.Srt(1,j) + D[i+6]*terms.Srt(2,j);
+		}
+
+	    // R * Cp * R^T of the point covariance
+	    if( uncertain )
+	    {
+		for( int e = 0; e < 9; ++e )
+		    C[e] = points.cov.col( e ).segment( b, n ).array();
+		for( int j = 0; j < 3; ++j )
+		    for( int i = 0; i < 3; ++i )
+			V[i+3*j] = terms.R(i,0)*C[3*j] + terms.R(i,1)*C[1+3*j] + terms.R(i,2)*C[2+3*j];
+	    }
+
+	    // cov = J * S * J^T with J = [D I], plus the rotated point covariance
+	    for( int j = 0; j < 3; ++j )
+		for( int i = 0; i <= j; ++i )
+		{
+		    ChunkArray c( T[i]*D[j] + T[i+3]*D[j+3] + T[i+6]*D[j+6]
+			    + U[i+3*j] + U[j+3*i] + terms.Stt(i,j) );
+		    if( uncertain )
+			c += V[i]*terms.R(j,0) + V[i+3]*terms.R(j,1) + V[i+6]*terms.R(j,2);
+
+		    result.cov.col( i+3*j ).segment( b, n ) = c.matrix();
+		    if( i != j )
+			result.cov.col( j+3*i ).segment( b, n ) = c.matrix();
+		}
+	}
+    }
+
+    TransformWithUncertainty compose( const TransformWithUncertainty& start, const TransformBatch& deltas, TransformBatch* poses )
+    {
+	// the rotation is composed as a matrix and converted to a quaternion
+	// per pose, exactly as operator* does
+	Eigen::Vector3d p( start.getTransform().translation() );
+	Eigen::Matrix3d R( start.getTransform().linear() );
+	Eigen::Quaterniond q( start.getQuaternion() );
+	Eigen::Matrix<double,6,6> P( start.getCovariance() );
+
+	ChunkJacobians jac;
+	const size_t number = deltas.size();
+
+	for( size_t begin = 0; begin < number; begin += CHUNK )
+	{
+	    const int n = static_cast<int>( std::min( static_cast<size_t>( CHUNK ), number - begin ) );
+
+	    // the rotations and positions are a running product
+	    for( int k = 0; k < n; ++k )
+	    {
+		const size_t i = begin + k;
+		const Eigen::Quaterniond q1( deltas.orientation.row( i ).transpose() );
+
+		jac.q2.col( k ) = q.coeffs();
+		Eigen::Map<Eigen::Matrix3d>( jac.R2.col( k ).data() ) = R;
+		p += R * Eigen::Vector3d( deltas.position.row( i ).transpose() );
+		R = R * q1.toRotationMatrix();
+		q = Eigen::Quaterniond( R );
+
+		if( poses )
+		{
+		    poses->position.row( i ) = p.transpose();
+		    poses->orientation.row( i ) = q.coeffs().transpose();
+		}
+	    }
+
+	    // the Jacobians of the chunk are independent of each other
+	    formJacobians( deltas, begin, n, jac );
+
+	    // the covariance is a running sum
+	    for( int k = 0; k < n; ++k )
+	    {
+		const size_t i = begin + k;
+		const Eigen::Matrix<double,6,6> C( Eigen::Map<const Eigen::Matrix<double,6,6> >( deltas.cov.row( i ).eval().data() ) );
+
+		propagate( Eigen::Map<const Eigen::Matrix3d>( jac.A.col( k ).data() ),
+			Eigen::Map<const Eigen::Matrix3d>( jac.B.col( k ).data() ),
+			Eigen::Map<const Eigen::Matrix3d>( jac.D.col( k ).data() ),
+			Eigen::Map<const Eigen::Matrix3d>( jac.R2.col( k ).data() ), C, P );
+
+		if( poses )
+		    poses->cov.row( i ) = Eigen::Map<const Eigen::Matrix<double,1,36> >( P.data() );
+	    }
+	}
+
+	Transform trans( Transform::Identity() );
+	trans.linear() = R;
+	trans.translation() = p;
+	return TransformWithUncertainty( trans, P );
+    }
+}
+
+TransformBatch::TransformBatch() {}
+
+TransformBatch::TransformBatch( size_t size )
+{
+    resize( size );
+}
+
+void TransformBatch::resize( size_t size )
+{
+    position.resize( size, 3 );
+    orientation.resize( size, 4 );
+    cov.resize( size, 36 );
+}
+
+void TransformBatch::set( size_t i, const TransformWithUncertainty& trans )
+{
+    position.row( i ) = trans.getTransform().translation().transpose();
+    orientation.row( i ) = trans.getQuaternion().coeffs().transpose();
+    cov.row( i ) = Eigen::Map<const Eigen::Matrix<double,1,36> >( trans.getCovariance().data() );
+}
+
+TransformWithUncertainty TransformBatch::get( size_t i ) const
+{
+    Transform trans( Eigen::Quaterniond( orientation.row( i ).transpose() ) );
+    trans.translation() = position.row( i ).transpose();
+    return TransformWithUncertainty( trans,
+	    Eigen::Map<const Eigen::Matrix<double,6,6> >( cov.row( i ).eval().data() ) );
+}
+
+PointBatch::PointBatch() {}
+
+PointBatch::PointBatch( size_t size, bool uncertain )
+{
+    resize( size, uncertain );
+}
+
+void PointBatch::resize( size_t size, bool uncertain )
+{
+    point.resize( size, 3 );
+    cov.resize( uncertain ? size : 0, 9 );
+}
+
+void PointBatch::set( size_t i, const PointWithUncertainty& p )
+{
+    point.row( i ) = p.getPoint().transpose();
+    if( hasUncertainty() )
+	cov.row( i ) = Eigen::Map<const Eigen::Matrix<double,1,9> >( p.getCovariance().data() );
+}
+
+PointWithUncertainty PointBatch::get( size_t i ) const
+{
+    if( !hasUncertainty() )
+	return PointWithUncertainty( point.row( i ).transpose() );
+
+    return PointWithUncertainty( point.row( i ).transpose(),
+	    Eigen::Map<const Eigen::Matrix3d>( cov.row( i ).eval().data() ) );
+}
+
+void localization::transformPoints( const TransformWithUncertainty& trans, const PointBatch& points, PointBatch& result,
+	unsigned int number_threads )
+{
+    // result is resized before the points are read
+    if( &points == &result )
+    {
+	const PointBatch copy( points );
+	transformPoints( trans, copy, result, number_threads );
+	return;
+    }
+
+    result.resize( points.size(), true );
+
+    // computed once, the threads only read the terms
+    const PointTransformTerms terms( trans );
+
+    const size_t number = points.size();
+    const size_t chunks = ( number + CHUNK - 1 ) / CHUNK;
+    number_threads = std::max( 1u, std::min( number_threads, static_cast<unsigned int>( chunks ) ) );
+
+    if( number_threads == 1 )
+    {
+	transformPointRange( terms, points, result, 0, number );
+	return;
+    }
+
+    // contiguous ranges of whole chunks, one per thread
+    const size_t chunks_per_thread = ( chunks + number_threads - 1 ) / number_threads;
+    boost::thread_group workers;
+    for( size_t begin = 0; begin < number; begin += chunks_per_thread * CHUNK )
+    {
+	const size_t end = std::min( number, begin + chunks_per_thread * CHUNK );
+	workers.create_thread( boost::bind( &transformPointRange,
+		    boost::cref( terms ), boost::cref( points ), boost::ref( result ), begin, end ) );
+    }
+    workers.join_all();
+}
+
+void localization::composeTrajectory( const TransformWithUncertainty& start, const TransformBatch& deltas, TransformBatch& poses )
+{
+    poses.resize( deltas.size() );
+    compose( start, deltas, &poses );
+}
+
+TransformWithUncertainty localization::composeTrajectory( const TransformWithUncertainty& start, const TransformBatch& deltas )
+{
+    return compose( start, deltas, NULL );
+}
+
+void localization::composePoses( TransformBatch& poses, const TransformBatch& deltas, size_t begin, size_t end )
+{
+    if( deltas.size() != poses.size() || begin > end || end > poses.size() )
+    {
+	std::cerr << "[TRANSFORM_BATCH] range [" << begin << ", " << end << ") of " << deltas.size()
+	    << " deltas does not fit " << poses.size() << " poses" << std::endl;
+	return;
+    }
+
+    ChunkJacobians jac;
+
+    for( size_t b = begin; b < end; b += CHUNK )
+    {
+	const int n = static_cast<int>( std::min( static_cast<size_t>( CHUNK ), end - b ) );
+
+	for( int k = 0; k < n; ++k )
+	    jac.q2.col( k ) = poses.orientation.row( b + k ).transpose();
+
+	// the pairs are independent, all their Jacobians are formed together
+	formJacobians( deltas, b, n, jac );
+
+	for( int k = 0; k < n; ++k )
+	{
+	    const size_t i = b + k;
+	    const Eigen::Quaterniond q1( deltas.orientation.row( i ).transpose() );
+	    const Eigen::Quaterniond q2( jac.q2.col( k ) );
+	    const Eigen::Matrix3d R2( q2.toRotationMatrix() );
+	    const Eigen::Matrix3d R( R2 * q1.toRotationMatrix() );
+
+	    poses.position.row( i ) += ( R2 * Eigen::Vector3d( deltas.position.row( i ).transpose() ) ).transpose();
+	    // the orientation is stored as quaternion only, it is normalized
+	    // so that the rounding errors do not build up over the steps
+	    poses.orientation.row( i ) = Eigen::Quaterniond( R ).normalized().coeffs().transpose();
+
+	    const Eigen::Matrix<double,6,6> C( Eigen::Map<const Eigen::Matrix<double,6,6> >( deltas.cov.row( i ).eval().data() ) );
+	    Eigen::Matrix<double,6,6> P( Eigen::Map<const Eigen::Matrix<double,6,6> >( poses.cov.row( i ).eval().data() ) );
+
+	    propagate( Eigen::Map<const Eigen::Matrix3d>( jac.A.col( k ).data() ),
+		    Eigen::Map<const Eigen::Matrix3d>( jac.B.col( k ).data() ),
+		    Eigen::Map<const Eigen::Matrix3d>( jac.D.col( k ).data() ), R2, C, P );
+
+	    poses.cov.row( i ) = Eigen::Map<const Eigen::Matrix<double,1,36> >( P.data() );
+	}
+    }
+}
+
+void localization::composePoses( TransformBatch& poses, const TransformBatch& deltas, unsigned int number_threads )
+{
+    const size_t number = poses.size();
+    if( deltas.size() != number )
+    {
+	std::cerr << "[TRANSFORM_BATCH] " << deltas.size() << " deltas for " << number << " poses" << std::endl;
+	return;
+    }
+
+    const size_t chunks = ( number + CHUNK - 1 ) / CHUNK;
+    number_threads = std::max( 1u, std::min( number_threads, static_cast<unsigned int>( chunks ) ) );
+
+    if( number_threads == 1 )
+    {
+	composePoses( poses, deltas, 0, number );
+	return;
+    }
+
+    // contiguous ranges of whole chunks, one per thread
+    typedef void (*ComposeRange)( TransformBatch&, const TransformBatch&, size_t, size_t );
+    const size_t chunks_per_thread = ( chunks + number_threads - 1 ) / number_threads;
+    boost::thread_group workers;
+    for( size_t begin = 0; begin < number; begin += chunks_per_thread * CHUNK )
+    {
+	const size_t end = std::min( number, begin + chunks_per_thread * CHUNK );
+	workers.create_thread( boost::bind( static_cast<ComposeRange>( &localization::composePoses ),
+		    boost::ref( poses ), boost::cref( deltas ), begin, end ) );
+    }
+    workers.join_all();
+}
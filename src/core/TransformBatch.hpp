@@ -0,0 +1,110 @@
+#ifndef _LOCALIZATION_CORE_TRANSFORM_BATCH_HPP_
+#define _LOCALIZATION_CORE_TRANSFORM_BATCH_HPP_
+
+#include <Eigen/Core>
+#include <localization/core/Transform.hpp>
+
+namespace localization
+{
+    /**
+     * Structure of arrays of transforms with uncertainty.
+     *
+     * Every component is stored in its own contiguous array: position has one
+     * column per axis, orientation one column per quaternion coefficient in
+     * (x, y, z, w) order and cov one column per coefficient of the
+     * column-major 6x6 covariance. Row i is the i-th transform.
+     */
+    class TransformBatch
+    {
+    public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,3> Positions;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,4> Orientations;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,36> Covariances;
+
+    public:
+	TransformBatch();
+	explicit TransformBatch( size_t size );
+
+	void resize( size_t size );
+	size_t size() const { return position.rows(); }
+
+	void set( size_t i, const TransformWithUncertainty& trans );
+
+	/** the returned transform always has uncertainty, the covariance
+	 * may be zero */
+	TransformWithUncertainty get( size_t i ) const;
+
+	Positions position;
+	Orientations orientation;
+	Covariances cov;
+    };
+
+    /**
+     * Structure of arrays of points with optional uncertainty.
+     *
+     * point has one column per axis and cov one column per coefficient of the
+     * column-major 3x3 covariance. cov is either empty or has one row per
+     * point.
+     */
+    class PointBatch
+    {
+    public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,3> Points;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,9> Covariances;
+
+    public:
+	PointBatch();
+	PointBatch( size_t size, bool uncertain );
+
+	void resize( size_t size, bool uncertain );
+	size_t size() const { return point.rows(); }
+	bool hasUncertainty() const { return cov.rows() == point.rows() && cov.rows() > 0; }
+
+	void set( size_t i, const PointWithUncertainty& point );
+	PointWithUncertainty get( size_t i ) const;
+
+	Points point;
+	Covariances cov;
+    };
+
+    /** transforms all the points, result[i] = trans * points[i] as
+     * TransformWithUncertainty::operator*( const PointWithUncertainty& ).
+     *
+     * The rotation dependent terms of the Jacobian are computed once, the
+     * per point terms are evaluated with packet math across points. Large
+     * batches can be split among number_threads threads. points and result
+     * can be the same batch.
+     */
+    void transformPoints( const TransformWithUncertainty& trans, const PointBatch& points, PointBatch& result,
+	    unsigned int number_threads = 1 );
+
+    /** composes a chain of deltas onto start and stores every intermediate
+     * pose, poses[i] = start * deltas[0] * ... * deltas[i].
+     *
+     * The result is the same as calling TransformWithUncertainty::operator*
+     * in a loop. The Jacobians of a block of poses are formed together with
+     * packet math, the covariance is then propagated pose by pose using the
+     * block structure of the Jacobians.
+     */
+    void composeTrajectory( const TransformWithUncertainty& start, const TransformBatch& deltas, TransformBatch& poses );
+
+    /** same as above, only the final pose is computed and returned
+     */
+    TransformWithUncertainty composeTrajectory( const TransformWithUncertainty& start, const TransformBatch& deltas );
+
+    /** composes independent pairs in place, poses[i] = poses[i] * deltas[i]
+     * as TransformWithUncertainty::operator*=.
+     *
+     * The Jacobians are formed with packet math across the pairs, large
+     * batches can be split among number_threads threads. Nothing is done
+     * if the sizes of the batches differ.
+     */
+    void composePoses( TransformBatch& poses, const TransformBatch& deltas, unsigned int number_threads = 1 );
+
+    /** same as above for the pairs [begin, end) only, for callers which
+     * split the work among threads themselves
+     */
+    void composePoses( TransformBatch& poses, const TransformBatch& deltas, size_t begin, size_t end );
+}
+
+#endif
@@ -0,0 +1,678 @@
+#ifndef _LOCALIZATION_CORE_TRANSFORM_IMPL_HPP_
+#define _LOCALIZATION_CORE_TRANSFORM_IMPL_HPP_
+
+/**
+ * Definitions of the TransformWithUncertaintyT and PointWithUncertaintyT
+ * templates. The library instantiates them for float and double, this file
+ * only needs to be included to use them with other scalar types.
+ */
+
+#include <cmath>
+#include <Eigen/LU>
+#include <Eigen/Geometry>
+#include <localization/core/Transform.hpp>
+
+namespace localization
+{
+namespace detail
+{
+
+// The uncertainty transformations are implemented according to:
+// Pennec X, Thirion JP. A framework for uncertainty and validation of 3-D
+// registration methods based on points and frames. International Journal of
+// Computer Vision. 1997;25(3):203–229. Available at:
+// http://www.springerlink.com/index/JJ25N2Q23T402682.pdf.
+
+template <typename _Scalar>
+Eigen::Quaternion<_Scalar> r_to_q( const Eigen::Matrix<_Scalar,3,1>& r )
+{
+    using std::abs;
+    _Scalar theta = r.norm();
+    if( abs(theta) > _Scalar(1e-5) )
+	return Eigen::Quaternion<_Scalar>( Eigen::AngleAxis<_Scalar>( theta, r/theta ) );
+    else
+	return Eigen::Quaternion<_Scalar>::Identity();
+}
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,3,1> q_to_r( const Eigen::Quaternion<_Scalar>& q )
+{
+    Eigen::AngleAxis<_Scalar> aa( q );
+    return aa.axis() * aa.angle();
+}
+
+template <typename _Scalar>
+inline _Scalar sign( const _Scalar& v )
+{
+    return v > _Scalar(0) ? _Scalar(1) : _Scalar(-1);
+}
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,3,3> skew_symmetric( const Eigen::Matrix<_Scalar,3,1>& r )
+{
+    Eigen::Matrix<_Scalar,3,3> res;
+    res << _Scalar(0), -r.z(), r.y(),
+	r.z(), _Scalar(0), -r.x(),
+	-r.y(), r.x(), _Scalar(0);
+    return res;
+}
+
+// r is the rotation vector of q, q_to_r( q )
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,4,3> dq_by_dr( const Eigen::Quaternion<_Scalar>& q, const Eigen::Matrix<_Scalar,3,1>& r )
+{
+    const _Scalar theta = r.norm();
+    const _Scalar kappa = _Scalar(0.5) - theta*theta / _Scalar(48); // approx. see Paper
+    const _Scalar lambda = _Scalar(1)/_Scalar(24)*(_Scalar(1)-theta*theta/_Scalar(40)); // approx.
+    Eigen::Matrix<_Scalar,4,3> res;
+    res << - q.vec().transpose()/_Scalar(2),
+       kappa * Eigen::Matrix<_Scalar,3,3>::Identity() - lambda * r * r.transpose();
+
+    return res;
+}
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,3,4> dr_by_dq( const Eigen::Quaternion<_Scalar>& q )
+{
+    const _Scalar mu = q.vec().norm();
+    const _Scalar tau = _Scalar(2) * sign( q.w() ) * ( _Scalar(1) + mu*mu/_Scalar(6) ); // approx
+    const _Scalar nu = _Scalar(-2) * sign( q.w() ) * ( _Scalar(2)/_Scalar(3) + mu*mu/_Scalar(5) ); // approx
+
+    Eigen::Matrix<_Scalar,3,4> res;
+    res << _Scalar(-2)*q.vec(), tau * Eigen::Matrix<_Scalar,3,3>::Identity() + nu * q.vec() * q.vec().transpose();
+
+    return res;
+}
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,4,4> dq2q1_by_dq1( const Eigen::Quaternion<_Scalar>& q2 )
+{
+    Eigen::Matrix<_Scalar,4,4> res;
+    res << _Scalar(0), -q2.vec().transpose(),
+	q2.vec(), skew_symmetric<_Scalar>( q2.vec() );
+    return Eigen::Matrix<_Scalar,4,4>::Identity() * q2.w() + res;
+}
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,4,4> dq2q1_by_dq2( const Eigen::Quaternion<_Scalar>& q1 )
+{
+    Eigen::Matrix<_Scalar,4,4> res;
+    res << _Scalar(0), -q1.vec().transpose(),
+	q1.vec(), -skew_symmetric<_Scalar>( q1.vec() );
+    return Eigen::Matrix<_Scalar,4,4>::Identity() * q1.w() + res;
+}
+
+// drq is dr_by_dq( q ) with q = q2 * q1, shared by both Jacobians
+// r1 and r2 are the rotation vectors of q1 and q2
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,3,3> dr2r1_by_r1( const Eigen::Matrix<_Scalar,3,4>& drq,
+	const Eigen::Quaternion<_Scalar>& q1, const Eigen::Matrix<_Scalar,3,1>& r1, const Eigen::Quaternion<_Scalar>& q2 )
+{
+    return Eigen::Matrix<_Scalar,3,3>(
+	    drq
+	    * dq2q1_by_dq1( q2 )
+	    * dq_by_dr( q1, r1 ) );
+}
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,3,3> dr2r1_by_r2( const Eigen::Matrix<_Scalar,3,4>& drq,
+	const Eigen::Quaternion<_Scalar>& q1, const Eigen::Quaternion<_Scalar>& q2, const Eigen::Matrix<_Scalar,3,1>& r2 )
+{
+    return Eigen::Matrix<_Scalar,3,3>(
+	    drq
+	    * dq2q1_by_dq2( q1 )
+	    * dq_by_dr( q2, r2 ) );
+}
+
+// r is the rotation vector of the rotation applied to x
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,3,3> drx_by_dr( const Eigen::Matrix<_Scalar,3,1>& r, const Eigen::Matrix<_Scalar,3,1>& x )
+{
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+    const _Scalar theta = r.norm();
+    const _Scalar alpha = _Scalar(1) - theta*theta/_Scalar(6);
+    const _Scalar beta = _Scalar(0.5) - theta*theta/_Scalar(24);
+    const _Scalar gamma = _Scalar(1) / _Scalar(3) - theta*theta/_Scalar(30);
+    const _Scalar delta = _Scalar(-1) / _Scalar(12) + theta*theta/_Scalar(180);
+
+    return Matrix3(
+	    -skew_symmetric(x)*(gamma*r*r.transpose()
+		- beta*skew_symmetric(r)+alpha*Matrix3::Identity())
+	    -skew_symmetric(r)*skew_symmetric(x)*(delta*r*r.transpose()
+		+ _Scalar(2)*beta*Matrix3::Identity()) );
+}
+
+// inverse of the lower block triangular Jacobian [A 0; C D], given D^-1.
+// Only the 3x3 block A is inverted, D is either the identity or a rotation
+// for which D^-1 = D^T.
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,6,6> block_triangular_inverse( const Eigen::Matrix<_Scalar,3,3>& A,
+	const Eigen::Matrix<_Scalar,3,3>& C, const Eigen::Matrix<_Scalar,3,3>& D_inv )
+{
+    const Eigen::Matrix<_Scalar,3,3> A_inv( A.inverse() );
+
+    Eigen::Matrix<_Scalar,6,6> res;
+    res << A_inv, Eigen::Matrix<_Scalar,3,3>::Zero(),
+	-D_inv * C * A_inv, D_inv;
+    return res;
+}
+
+// Closed form Jacobians for the ADJOINT propagation. With the right
+// Jacobian Jr of SO(3) a change of the rotation vector is a change in the
+// tangent space of the rotation, R(r + dr) = R(r) * exp( Jr(r) * dr ).
+// The Jacobians of the operations on [r t] are then exact chains of Jr,
+// its inverse and the adjoint of the rotations.
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,3,3> so3_right_jacobian( const Eigen::Matrix<_Scalar,3,1>& r )
+{
+    using std::sin; using std::cos;
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+    const _Scalar theta2 = r.squaredNorm();
+    const Matrix3 W( skew_symmetric( r ) );
+
+    // taylor expansion close to zero, the closed form loses precision
+    using std::sqrt;
+    if( theta2 < sqrt( Eigen::NumTraits<_Scalar>::epsilon() ) )
+	return Matrix3( Matrix3::Identity() - ( _Scalar(0.5) - theta2 / _Scalar(24) ) * W
+		+ ( _Scalar(1) / _Scalar(6) - theta2 / _Scalar(120) ) * W * W );
+
+    const _Scalar theta = sqrt( theta2 );
+    return Matrix3( Matrix3::Identity() - ( _Scalar(1) - cos( theta ) ) / theta2 * W
+	    + ( theta - sin( theta ) ) / ( theta2 * theta ) * W * W );
+}
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar,3,3> so3_right_jacobian_inverse( const Eigen::Matrix<_Scalar,3,1>& r )
+{
+    using std::sin; using std::cos;
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+    const _Scalar theta2 = r.squaredNorm();
+    const Matrix3 W( skew_symmetric( r ) );
+
+    // taylor expansion close to zero, the closed form loses precision
+    using std::sqrt;
+    if( theta2 < sqrt( Eigen::NumTraits<_Scalar>::epsilon() ) )
+	return Matrix3( Matrix3::Identity() + _Scalar(0.5) * W
+		+ ( _Scalar(1) / _Scalar(12) + theta2 / _Scalar(720) ) * W * W );
+
+    const _Scalar theta = sqrt( theta2 );
+    return Matrix3( Matrix3::Identity() + _Scalar(0.5) * W
+	    + ( _Scalar(1) / theta2 - ( _Scalar(1) + cos( theta ) ) / ( _Scalar(2) * theta * sin( theta ) ) ) * W * W );
+}
+
+// Jacobians of the composition t = t2 * t1 with respect to [r1 t1] and
+// [r2 t2]. r is the rotation vector of the composed rotation.
+template <typename _Scalar>
+void composition_jacobians( const Eigen::Matrix<_Scalar,3,3>& R1, const Eigen::Matrix<_Scalar,3,1>& r1,
+	const Eigen::Matrix<_Scalar,3,1>& t1,
+	const Eigen::Matrix<_Scalar,3,3>& R2, const Eigen::Matrix<_Scalar,3,1>& r2,
+	const Eigen::Matrix<_Scalar,3,1>& r,
+	Eigen::Matrix<_Scalar,6,6>& J1, Eigen::Matrix<_Scalar,6,6>& J2 )
+{
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+    const Matrix3 Jr_inv( so3_right_jacobian_inverse( r ) );
+    const Matrix3 Jr2( so3_right_jacobian( r2 ) );
+
+    // the tangent of the rotation of t2 is moved to the composed
+    // rotation by the adjoint of R1^-1
+    J1 << Jr_inv * so3_right_jacobian( r1 ), Matrix3::Zero(),
+       Matrix3::Zero(), R2;
+    J2 << Jr_inv * R1.transpose() * Jr2, Matrix3::Zero(),
+       -R2 * skew_symmetric( t1 ) * Jr2, Matrix3::Identity();
+}
+
+}
+}
+
+template <typename _Scalar>
+localization::PointWithUncertaintyT<_Scalar>::PointWithUncertaintyT() {}
+template <typename _Scalar>
+localization::PointWithUncertaintyT<_Scalar>::PointWithUncertaintyT( const Point& point )
+    : point( point ), uncertain(false) {}
+template <typename _Scalar>
+localization::PointWithUncertaintyT<_Scalar>::PointWithUncertaintyT( const Point& point, const Covariance& cov )
+    : point( point ), cov( cov ), uncertain(true) {}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::TransformWithUncertaintyT()
+    : cached(0) {}
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::TransformWithUncertaintyT( const Transform& trans )
+    : trans( trans ), cov( Covariance::Zero() ), uncertain(false), cached(0) {}
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::TransformWithUncertaintyT( const base::samples::RigidBodyState& rbs )
+    : cached(0)
+{
+    operator=( rbs );
+}
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::TransformWithUncertaintyT( const Transform& trans, const Covariance& cov )
+    : trans( trans ), cov( cov ), uncertain(true), cached(0) {}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar> localization::TransformWithUncertaintyT<_Scalar>::Identity()
+{
+    return TransformWithUncertaintyT( Transform::Identity() );
+}
+
+template <typename _Scalar>
+const typename localization::TransformWithUncertaintyT<_Scalar>::Quaternion&
+localization::TransformWithUncertaintyT<_Scalar>::getQuaternion() const
+{
+    if( !(cached & QUATERNION_CACHED) )
+    {
+	q_cache = Quaternion( trans.linear() );
+	cached |= QUATERNION_CACHED;
+    }
+    return q_cache;
+}
+
+template <typename _Scalar>
+const typename localization::TransformWithUncertaintyT<_Scalar>::Vector3&
+localization::TransformWithUncertaintyT<_Scalar>::getRotationVector() const
+{
+    if( !(cached & ROTATION_VECTOR_CACHED) )
+    {
+	r_cache = detail::q_to_r( getQuaternion() );
+	cached |= ROTATION_VECTOR_CACHED;
+    }
+    return r_cache;
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::composition( const TransformWithUncertaintyT& t1,
+	PropagationMethod method ) const
+{
+    if( method == ADJOINT )
+	return compositionAdjoint( t1 );
+    return this->operator*( t1 );
+}
+
+template <typename _Scalar>
+localization::PointWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::composition( const PointWithUncertainty& point,
+	PropagationMethod method ) const
+{
+    if( method == ADJOINT )
+	return pointAdjoint( point );
+    return this->operator*( point );
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::compositionInv( const TransformWithUncertaintyT& t1,
+	PropagationMethod method ) const
+{
+    if( method == ADJOINT )
+	return compositionInvAdjoint( t1 );
+
+    using namespace detail;
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    const TransformWithUncertaintyT &tf(*this);
+    Transform t2 = tf.getTransform() * t1.getTransform().inverse( Eigen::Isometry );
+
+    // short path if there is no uncertainty
+    if( !t1.hasUncertainty() && !tf.hasUncertainty() )
+	return TransformWithUncertaintyT( t2 );
+
+    // convert the rotations of the respective transforms into quaternions
+    // in order to inverse the covariances, we need to get both the t1 and t2 transformations
+    // based on the composition tf = t2 * t1
+    const Quaternion &q1( t1.getQuaternion() );
+    const Vector3 &r1( t1.getRotationVector() );
+    const Quaternion q2( t2.linear() );
+    const Vector3 r2( q_to_r( q2 ) );
+    const Eigen::Matrix<_Scalar,3,4> drq( dr_by_dq( Quaternion( q2 * q1 ) ) );
+
+    // initialize resulting covariance
+    Covariance cov = Covariance::Zero();
+
+    Covariance J1;
+    J1 << dr2r1_by_r1(drq, q1, r1, q2), Matrix3::Zero(),
+       Matrix3::Zero(), t2.linear();
+
+    // J2 = [dr2r1_by_r2 0; drx_by_dr I]
+    const Covariance J2_inv( block_triangular_inverse<_Scalar>(
+		dr2r1_by_r2(drq, q1, q2, r2), drx_by_dr<_Scalar>(r2, t1.getTransform().translation()),
+		Matrix3::Identity() ) );
+
+    cov = J2_inv * ( tf.getCovariance() - J1 * t1.getCovariance() * J1.transpose() ) * J2_inv.transpose();
+
+    // and return the resulting uncertainty transform
+    return TransformWithUncertaintyT(
+	    t2, cov );
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::preCompositionInv( const TransformWithUncertaintyT& t2,
+	PropagationMethod method ) const
+{
+    if( method == ADJOINT )
+	return preCompositionInvAdjoint( t2 );
+
+    using namespace detail;
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    const TransformWithUncertaintyT &tf(*this);
+    Transform t1 = t2.getTransform().inverse( Eigen::Isometry ) * tf.getTransform();
+
+    // short path if there is no uncertainty
+    if( !t2.hasUncertainty() && !tf.hasUncertainty() )
+	return TransformWithUncertaintyT( t1 );
+
+    // convert the rotations of the respective transforms into quaternions
+    // in order to inverse the covariances, we need to get both the t1 and t2 transformations
+    // based on the composition tf = t2 * t1
+    const Quaternion q1( t1.linear() );
+    const Vector3 r1( q_to_r( q1 ) );
+    const Quaternion &q2( t2.getQuaternion() );
+    const Vector3 &r2( t2.getRotationVector() );
+    const Eigen::Matrix<_Scalar,3,4> drq( dr_by_dq( Quaternion( q2 * q1 ) ) );
+
+    // initialize resulting covariance
+    Covariance cov = Covariance::Zero();
+
+    // J1 = [dr2r1_by_r1 0; 0 R2], the rotation is inverted by transposing it
+    const Covariance J1_inv( block_triangular_inverse<_Scalar>(
+		dr2r1_by_r1(drq, q1, r1, q2), Matrix3::Zero(),
+		t2.getTransform().linear().transpose() ) );
+
+    Covariance J2;
+    J2 << dr2r1_by_r2(drq, q1, q2, r2), Matrix3::Zero(),
+       drx_by_dr<_Scalar>(r2, t1.translation()), Matrix3::Identity();
+
+    cov = J1_inv * ( tf.getCovariance() - J2 * t2.getCovariance() * J2.transpose() ) * J1_inv.transpose();
+
+    // and return the resulting uncertainty transform
+    return TransformWithUncertaintyT(
+	    t1, cov );
+}
+
+
+template <typename _Scalar>
+typename localization::TransformWithUncertaintyT<_Scalar>::Covariance
+localization::TransformWithUncertaintyT<_Scalar>::compositionCovariance( const TransformWithUncertaintyT& t2,
+	const TransformWithUncertaintyT& t1 )
+{
+    using namespace detail;
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    // rotations of the respective transforms as quaternions (cached)
+    const Quaternion &q1( t1.getQuaternion() );
+    const Quaternion &q2( t2.getQuaternion() );
+
+    // dr_by_dq of the composed rotation is shared by both Jacobians
+    const Eigen::Matrix<_Scalar,3,4> drq( dr_by_dq( Quaternion( q2 * q1 ) ) );
+
+    // initialize resulting covariance
+    Covariance cov = Covariance::Zero();
+
+    // calculate the Jacobians (this is what all the above functions are for)
+    // and add to the resulting covariance
+    if( t1.hasUncertainty() )
+    {
+	Covariance J1;
+	J1 << dr2r1_by_r1(drq, q1, t1.getRotationVector(), q2), Matrix3::Zero(),
+	   Matrix3::Zero(), t2.getTransform().linear();
+
+	cov += J1*t1.getCovariance()*J1.transpose();
+    }
+
+    if( t2.hasUncertainty() )
+    {
+	Covariance J2;
+	const Vector3 &r2( t2.getRotationVector() );
+	J2 << dr2r1_by_r2(drq, q1, q2, r2), Matrix3::Zero(),
+	   drx_by_dr<_Scalar>(r2, t1.getTransform().translation()), Matrix3::Identity();
+
+	cov += J2*t2.getCovariance()*J2.transpose();
+    }
+
+    return cov;
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::operator*( const TransformWithUncertaintyT& t1 ) const
+{
+    const TransformWithUncertaintyT &t2(*this);
+    // short path if there is no uncertainty
+    if( !t1.hasUncertainty() && !t2.hasUncertainty() )
+	return TransformWithUncertaintyT( t2.getTransform() * t1.getTransform() );
+
+    // and return the resulting uncertainty transform
+    return TransformWithUncertaintyT(
+	    t2.getTransform() * t1.getTransform(), compositionCovariance( t2, t1 ) );
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>&
+localization::TransformWithUncertaintyT<_Scalar>::operator*=( const TransformWithUncertaintyT& t1 )
+{
+    // the covariance needs the rotation of this before the update
+    if( t1.hasUncertainty() || hasUncertainty() )
+    {
+	cov = compositionCovariance( *this, t1 );
+	uncertain = true;
+    }
+
+    trans = trans * t1.getTransform();
+    invalidateCache();
+
+    return *this;
+}
+
+template <typename _Scalar>
+localization::PointWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::operator*( const PointWithUncertainty& point ) const
+{
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    Matrix3 R( getTransform().linear() );
+    Eigen::Matrix<_Scalar,3,6> J;
+    J << detail::drx_by_dr( getRotationVector(), point.getPoint() ), Matrix3::Identity();
+
+    Matrix3 cov = J*getCovariance()*J.transpose();
+    if( point.hasUncertainty() )
+	cov += R*point.getCovariance()*R.transpose();
+
+    return PointWithUncertainty(
+	    getTransform() * point.getPoint(),
+	    cov );
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::inverse( PropagationMethod method ) const
+{
+    if( method == ADJOINT )
+	return inverseAdjoint();
+
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    // short path if there is no uncertainty
+    if( !hasUncertainty() )
+	return TransformWithUncertaintyT( Transform( getTransform().inverse( Eigen::Isometry ) ) );
+
+    // the rotation vector of the inverse rotation is -r
+    Vector3 t( getTransform().translation() );
+    Covariance J;
+    J << Matrix3::Identity(), Matrix3::Zero(),
+	detail::drx_by_dr<_Scalar>( -getRotationVector(), t ), getTransform().linear().transpose();
+
+    return TransformWithUncertaintyT(
+	    Transform( getTransform().inverse( Eigen::Isometry ) ),
+	    J*getCovariance()*J.transpose() );
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::compositionAdjoint( const TransformWithUncertaintyT& t1 ) const
+{
+    const TransformWithUncertaintyT &t2(*this);
+    TransformWithUncertaintyT result( Transform( t2.getTransform() * t1.getTransform() ) );
+
+    // short path if there is no uncertainty
+    if( !t1.hasUncertainty() && !t2.hasUncertainty() )
+	return result;
+
+    Covariance J1, J2;
+    detail::composition_jacobians<_Scalar>( t1.getTransform().linear(), t1.getRotationVector(),
+	    t1.getTransform().translation(), t2.getTransform().linear(), t2.getRotationVector(),
+	    result.getRotationVector(), J1, J2 );
+
+    Covariance cov = Covariance::Zero();
+    if( t1.hasUncertainty() )
+	cov += J1*t1.getCovariance()*J1.transpose();
+    if( t2.hasUncertainty() )
+	cov += J2*t2.getCovariance()*J2.transpose();
+
+    result.setCovariance( cov );
+    return result;
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::compositionInvAdjoint( const TransformWithUncertaintyT& t1 ) const
+{
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    // tf = t2 * t1, t2 is the result
+    const TransformWithUncertaintyT &tf(*this);
+    TransformWithUncertaintyT t2( Transform( tf.getTransform() * t1.getTransform().inverse( Eigen::Isometry ) ) );
+
+    // short path if there is no uncertainty
+    if( !t1.hasUncertainty() && !tf.hasUncertainty() )
+	return t2;
+
+    Covariance J1, J2;
+    detail::composition_jacobians<_Scalar>( t1.getTransform().linear(), t1.getRotationVector(),
+	    t1.getTransform().translation(), t2.getTransform().linear(), t2.getRotationVector(),
+	    tf.getRotationVector(), J1, J2 );
+
+    // J2 = [A 0; C I]
+    const Covariance J2_inv( detail::block_triangular_inverse<_Scalar>(
+		J2.template topLeftCorner<3,3>(), J2.template bottomLeftCorner<3,3>(), Matrix3::Identity() ) );
+
+    t2.setCovariance( J2_inv * ( tf.getCovariance() - J1 * t1.getCovariance() * J1.transpose() ) * J2_inv.transpose() );
+    return t2;
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::preCompositionInvAdjoint( const TransformWithUncertaintyT& t2 ) const
+{
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    // tf = t2 * t1, t1 is the result
+    const TransformWithUncertaintyT &tf(*this);
+    TransformWithUncertaintyT t1( Transform( t2.getTransform().inverse( Eigen::Isometry ) * tf.getTransform() ) );
+
+    // short path if there is no uncertainty
+    if( !t2.hasUncertainty() && !tf.hasUncertainty() )
+	return t1;
+
+    Covariance J1, J2;
+    detail::composition_jacobians<_Scalar>( t1.getTransform().linear(), t1.getRotationVector(),
+	    t1.getTransform().translation(), t2.getTransform().linear(), t2.getRotationVector(),
+	    tf.getRotationVector(), J1, J2 );
+
+    // J1 = [Jr(r)^-1 Jr(r1) 0; 0 R2], the inverse is closed form as well
+    Covariance J1_inv;
+    J1_inv << detail::so3_right_jacobian_inverse( t1.getRotationVector() ) * detail::so3_right_jacobian( tf.getRotationVector() ),
+	   Matrix3::Zero(), Matrix3::Zero(), t2.getTransform().linear().transpose();
+
+    t1.setCovariance( J1_inv * ( tf.getCovariance() - J2 * t2.getCovariance() * J2.transpose() ) * J1_inv.transpose() );
+    return t1;
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::inverseAdjoint() const
+{
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    // short path if there is no uncertainty
+    if( !hasUncertainty() )
+	return TransformWithUncertaintyT( Transform( getTransform().inverse( Eigen::Isometry ) ) );
+
+    // the inverse is [-r -R^T t], the rotation vector of R^T is -r
+    const Matrix3 Rt( getTransform().linear().transpose() );
+    const Vector3 t( getTransform().translation() );
+    Covariance J;
+    J << -Matrix3::Identity(), Matrix3::Zero(),
+	-Rt * detail::skew_symmetric( t ) * detail::so3_right_jacobian<_Scalar>( -getRotationVector() ), -Rt;
+
+    return TransformWithUncertaintyT(
+	    Transform( getTransform().inverse( Eigen::Isometry ) ),
+	    J*getCovariance()*J.transpose() );
+}
+
+template <typename _Scalar>
+localization::PointWithUncertaintyT<_Scalar>
+localization::TransformWithUncertaintyT<_Scalar>::pointAdjoint( const PointWithUncertainty& point ) const
+{
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    const Matrix3 R( getTransform().linear() );
+    Eigen::Matrix<_Scalar,3,6> J;
+    J << -R * detail::skew_symmetric( point.getPoint() ) * detail::so3_right_jacobian( getRotationVector() ),
+      Matrix3::Identity();
+
+    Matrix3 cov = J*getCovariance()*J.transpose();
+    if( point.hasUncertainty() )
+	cov += R*point.getCovariance()*R.transpose();
+
+    return PointWithUncertainty(
+	    getTransform() * point.getPoint(),
+	    cov );
+}
+
+template <typename _Scalar>
+localization::TransformWithUncertaintyT<_Scalar>&
+localization::TransformWithUncertaintyT<_Scalar>::operator=( const base::samples::RigidBodyState& rbs )
+{
+    typedef Eigen::Matrix<_Scalar,3,3> Matrix3;
+
+    // extract the transform
+    const Eigen::Affine3d rbs_trans = rbs;
+    trans = rbs_trans.cast<_Scalar>();
+    invalidateCache();
+
+    // and the covariance
+    cov << rbs.cov_orientation.cast<_Scalar>(), Matrix3::Zero(),
+	Matrix3::Zero(), rbs.cov_position.cast<_Scalar>();
+
+    uncertain = true;
+
+    return *this;
+}
+
+
+template <typename _Scalar>
+std::ostream& localization::operator<<(std::ostream &out, const  TransformWithUncertaintyT<_Scalar>& trans)
+{
+    out << trans.getTransform().matrix() << "\n";
+    if (trans.hasUncertainty())
+    {
+	out << trans.getCovariance().template topLeftCorner<3,3>() << "\n";
+	out << trans.getCovariance().template bottomRightCorner<3,3>() << "\n";
+    }
+    return out;
+}
+
+template <typename _Scalar>
+void localization::TransformWithUncertaintyT<_Scalar>::copyToRigidBodyState( base::samples::RigidBodyState& rbs ) const
+{
+    base::Pose pose( Eigen::Affine3d( getTransform().template cast<double>() ) );
+    rbs.position = pose.position;
+    rbs.orientation = pose.orientation;
+    rbs.cov_orientation = getCovariance().template topLeftCorner<3,3>().template cast<double>();
+    rbs.cov_position = getCovariance().template bottomRightCorner<3,3>().template cast<double>();
+}
+
+#endif
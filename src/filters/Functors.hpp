@@ -0,0 +1,99 @@
+#ifndef _FUNCTORS_HPP_
+#define _FUNCTORS_HPP_
+
+/** Standard libraries **/
+#include <vector> /** std::vector */
+#include <cassert> /** Assert */
+
+namespace localization
+{
+    /**@brief Constant noise covariance functor
+     *
+     * Drop-in replacement of boost::bind(ukfom::id<_Covariance>, Q). It keeps
+     * a reference to the covariance instead of a copy, and it is a plain
+     * inlinable call. The referenced covariance has to outlive the functor
+     * (filters only use it for the duration of a predict or update call).
+     */
+    template <typename _Covariance>
+    struct ConstantCovariance
+    {
+        const _Covariance &cov;
+
+        explicit ConstantCovariance(const _Covariance &cov) : cov(cov) {}
+
+        const _Covariance& operator()() const
+        {
+            return cov;
+        }
+    };
+
+    /**@brief Helper to build a ConstantCovariance
+     */
+    template <typename _Covariance>
+    inline ConstantCovariance<_Covariance> constantCovariance(const _Covariance &cov)
+    {
+        return ConstantCovariance<_Covariance>(cov);
+    }
+
+    /**@brief In-place process or measurement model
+     *
+     * Wraps any callable (function pointer, function object or lambda)
+     * with the signature f(const Input &in, Output &out). The filters call
+     * it directly on the sigma points, so no state is returned by value and
+     * the call can be inlined in the sigma point loop.
+     *
+     * For process models, out holds a copy of the input sigma point on entry,
+     * so the model only needs to write the sub-manifolds it changes.
+     */
+    template <typename _Model>
+    struct InPlaceModel
+    {
+        _Model model;
+
+        explicit InPlaceModel(const _Model &model) : model(model) {}
+
+        template <typename _Input, typename _Output>
+        inline void operator()(const _Input &in, _Output &out)
+        {
+            model(in, out);
+        }
+    };
+
+    /**@brief Helper to build an InPlaceModel
+     *
+     * filter.predict(localization::inPlace(myProcessModel), Q);
+     */
+    template <typename _Model>
+    inline InPlaceModel<_Model> inPlace(const _Model &model)
+    {
+        return InPlaceModel<_Model>(model);
+    }
+
+    /**@brief Apply a model returning by value, out[i] = f(in[i])
+     */
+    template <typename _Model, typename _Input, typename _Output>
+    inline void applyModel(_Model &f, const std::vector<_Input> &in, std::vector<_Output> &out)
+    {
+        assert(in.size() == out.size());
+
+        for (std::size_t i = 0; i < in.size(); ++i)
+        {
+            out[i] = f(in[i]);
+        }
+    }
+
+    /**@brief Apply an in-place model, f(in[i], out[i])
+     */
+    template <typename _Model, typename _Input, typename _Output>
+    inline void applyModel(InPlaceModel<_Model> &f, const std::vector<_Input> &in, std::vector<_Output> &out)
+    {
+        assert(in.size() == out.size());
+
+        for (std::size_t i = 0; i < in.size(); ++i)
+        {
+            f(in[i], out[i]);
+        }
+    }
+}
+
+#endif /** end of _FUNCTORS_HPP_ */
@@ -8,6 +8,8 @@
 
 /** Boost **/
 #include <boost/bind.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
 
 /** Eigen **/
 #include <Eigen/Core>
@@ -25,6 +27,10 @@
 #include <ukfom/traits/dof.hpp>
 #include <ukfom/util.hpp>
 
+/** Process and measurement model functors **/
+#include <localization/filters/Functors.hpp>
+#include <localization/tools/Checkpoint.hpp>
+
 /** MTK's pose and orientation definition **/
 #include <mtk/startIdx.hpp>
 
@@ -86,13 +92,18 @@ namespace localization
             }
 
             /**@brief Filter prediction step
+             *
+             * f is either a callable returning the propagated state, f(state),
+             * or an in-place model built with localization::inPlace(g) where
+             * g(const _SingleState &in, _SingleState &out). The same applies to
+             * the measurement model h of the update.
              */
             template<typename _ProcessModel>
             void predict(_ProcessModel f, const SingleStateCovariance &Q)
             {
                 Eigen::Matrix<ScalarType, _SingleState::DOF, 4> Nk;
                 Nk = base::NaN<double>() * Eigen::Matrix<ScalarType, _SingleState::DOF, 4>::Identity();
-                predict(f, boost::bind(ukfom::id<SingleStateCovariance>, Q), Nk);
+                predict(f, constantCovariance(Q), Nk);
             }
 
             template<typename _ProcessModel, typename _ProcessNoiseCovariance, typename _NullSpaceMatrix>
@@ -123,7 +134,7 @@ namespace localization
                 /*****************************/
 
                 /** Apply the non-linear transformation of the process model **/
-                std::transform(X.begin(), X.end(), X.begin(), f);
+                applyModel(f, XCopy, X);
 
                 #ifdef MSCKF_DEBUG_PRINTS
                 //this->printSigmaPoints<SingleStateSigma>(X);
@@ -160,7 +171,7 @@ namespace localization
                 /************************/
 
                 /** Compute the Process model Covariance **/
-                Pk_i = this->covSigmaPoints<DOF_SINGLE_STATE, _SingleState>(mu_state.statek, X) + Qk;
+                Pk_i = this->covSigmaPoints(mu_state.statek, X) + Qk;
 
                 /** Store the subcovariance matrix for statek **/
                 this->Pk.block(0, 0, _SingleState::DOF, _SingleState::DOF) = Pk_i;
@@ -230,7 +241,7 @@ namespace localization
                     generateSigmaPoints(mu_state, Pk, X);
 
                     std::vector<VectorXd> Z(X.size());
-                    std::transform(X.begin(), X.end(), Z.begin(), h);
+                    applyModel(h, X, Z);
 
                     const VectorXd mean_z = meanSigmaPoints(Z);
 
@@ -395,6 +406,62 @@ namespace localization
                 this->Pk = Pk_i;
             }
 
+            /**@brief Write mean, covariance and window layout to a binary checkpoint
+             */
+            bool saveCheckpoint(const std::string &filename) const
+            {
+                /** The checkpoint stores the state and covariance as double **/
+                BOOST_STATIC_ASSERT((boost::is_same<ScalarType, double>::value));
+
+                CheckpointHeader header;
+                header.filter = CheckpointHeader::MSCKF;
+                header.single_dof = _SingleState::DOF;
+                header.sensor_dof = SENSOR_DOF;
+                header.number_sensors = mu_state.sensorsk.size();
+                header.state_size = mu_state.getDOF();
+                header.cov_rows = Pk.rows();
+                header.cov_cols = Pk.cols();
+
+                CheckpointFile file;
+                if (!file.create(filename, header))
+                    return false;
+
+                Eigen::Map<VectorizedMultiState> (file.stateData(), header.state_size) = mu_state.getVectorizedState();
+                Eigen::Map<MultiStateCovariance> (file.covarianceData(), header.cov_rows, header.cov_cols) = Pk;
+
+                return file.sync();
+            }
+
+            /**@brief Restore mean, covariance and window layout from a binary checkpoint
+             *
+             * The filter is left untouched when the checkpoint does not match
+             * this filter type.
+             */
+            bool loadCheckpoint(const std::string &filename)
+            {
+                BOOST_STATIC_ASSERT((boost::is_same<ScalarType, double>::value));
+
+                CheckpointFile file;
+                if (!file.open(filename))
+                    return false;
+
+                const CheckpointHeader &header(file.header());
+                if (header.filter != CheckpointHeader::MSCKF || header.single_dof != _SingleState::DOF
+                        || header.sensor_dof != SENSOR_DOF
+                        || header.state_size != _SingleState::DOF + SENSOR_DOF * header.number_sensors
+                        || header.cov_rows != header.state_size || header.cov_cols != header.state_size)
+                {
+                    std::cerr << "[MSCKF] checkpoint " << filename << " does not match this filter" << std::endl;
+                    return false;
+                }
+
+                mu_state.sensorsk.resize(header.number_sensors);
+                mu_state.set(Eigen::Map<const VectorizedMultiState> (file.stateData(), header.state_size));
+                Pk = Eigen::Map<const MultiStateCovariance> (file.covarianceData(), header.cov_rows, header.cov_cols);
+
+                return true;
+            }
+
     private:
             /**@brief Sigma Point Calculation for the complete Multi State
             */
@@ -419,13 +486,16 @@ namespace localization
                                       << "<< L" << std::endl;
                      std::cout<<"L*L^T:\n"<< L * L.transpose()<<"\n";*/
 
-                    X[0] = mu + delta;
+                    /** All the sigma points in one boxplus (batched orientations) **/
+                    typename _MultiState::vectorized_points_type deltas(mu.getDOF(), X.size());
+                    deltas.col(0) = delta;
                     for (register unsigned int i = 1, j = 0; j < mu.getDOF(); ++j)
                     {
                             //std::cout << "L.col(" << j << "): " << L.col(j).transpose() << std::endl;
-                            X[i++] = mu + (delta + L.col(j));
-                            X[i++] = mu + (delta - L.col(j));
+                            deltas.col(i++) = delta + L.col(j);
+                            deltas.col(i++) = delta - L.col(j);
                     }
+                    _MultiState::boxplusSigmaPoints(mu, deltas, X);
                     #ifdef MSCKF_DEBUG_PRINTS
                     this->printSigmaPoints<MultiStateSigma>(X);
                     #endif
@@ -455,13 +525,15 @@ namespace localization
                      std::cout<<"L*L^T:\n"<< L * L.transpose()<<"\n";*/
 
 
-                    X[0] = mu + delta;
+                    typename _SingleState::vectorized_points_type deltas(int(DOF_SINGLE_STATE), X.size());
+                    deltas.col(0) = delta;
                     for (std::size_t i = 1, j = 0; j < DOF_SINGLE_STATE; ++j)
                     {
                             //std::cout << "L.col(" << j << "): " << L.getL().col(j).transpose() << std::endl;
-                            X[i++] = mu + (delta + L.col(j));
-                            X[i++] = mu + (delta - L.col(j));
+                            deltas.col(i++) = delta + L.col(j);
+                            deltas.col(i++) = delta - L.col(j);
                     }
+                    _SingleState::boxplusSigmaPoints(mu, deltas, X);
 
                     #ifdef MSCKF_DEBUG_PRINTS
                     this->printSigmaPoints<SingleStateSigma>(X);
@@ -473,16 +545,13 @@ namespace localization
             {
                     _SingleState reference = X[0];
                     typename _SingleState::vectorized_type mean_delta;
+                    typename _SingleState::vectorized_points_type deltas;
                     const static std::size_t max_it = 10000;
 
                     std::size_t i = 0;
                     do {
-                            mean_delta.setZero();
-                            for (typename std::vector<_SingleState>::const_iterator Xi = X.begin(); Xi != X.end(); ++Xi)
-                            {
-                                    mean_delta += *Xi - reference;
-                            }
-                            mean_delta /= X.size();
+                            _SingleState::boxminusSigmaPoints(X, reference, deltas);
+                            mean_delta = deltas.rowwise().sum() / X.size();
                             reference += mean_delta;
                     } while (mean_delta.norm() > 1e-6
                                      && ++i < max_it);
@@ -501,17 +570,13 @@ namespace localization
             {
                     _MultiState reference = X[0];
                     typename _MultiState::vectorized_type mean_delta;
-                    mean_delta.resize(reference.getDOF(), 1);
+                    typename _MultiState::vectorized_points_type deltas;
                     const static std::size_t max_it = 10000;
 
                     std::size_t i = 0;
                     do {
-                            mean_delta.setZero();
-                            for (typename std::vector<_MultiState>::const_iterator Xi = X.begin(); Xi != X.end(); ++Xi)
-                            {
-                                    mean_delta += *Xi - reference;
-                            }
-                            mean_delta /= X.size();
+                            _MultiState::boxminusSigmaPoints(X, reference, deltas);
+                            mean_delta = deltas.rowwise().sum() / X.size();
                             reference += mean_delta;
                     } while (mean_delta.norm() > 1e-6
                                      && ++i < max_it);
@@ -570,21 +635,31 @@ namespace localization
                     return 0.5 * c;
             }
 
+            /*@brief covariance of sigma points when using the _SingleState
+             */
+            SingleStateCovariance covSigmaPoints(const _SingleState &mean, const SingleStateSigma &V) const
+            {
+                    typename _SingleState::vectorized_points_type d;
+                    _SingleState::boxminusSigmaPoints(V, mean, d);
+
+                    SingleStateCovariance c;
+                    c.noalias() = d * d.transpose();
+
+                    return 0.5 * c;
+            }
+
             /*@brief covariance of sigma points when using the _MultiState
              */
             Eigen::Matrix<ScalarType, Eigen::Dynamic, Eigen::Dynamic>
             covSigmaPoints(const _MultiState &mean, const std::vector<_MultiState> &V) const
             {
                     typedef Eigen::Matrix<ScalarType, Eigen::Dynamic, Eigen::Dynamic> CovMat;
-                    typedef Eigen::Matrix<ScalarType, Eigen::Dynamic, 1> CovCol;
 
-                    CovMat c(CovMat::Zero(mean.getDOF(), mean.getDOF()));
+                    typename _MultiState::vectorized_points_type d;
+                    _MultiState::boxminusSigmaPoints(V, mean, d);
 
-                    for (typename std::vector< _MultiState >::const_iterator Vi = V.begin(); Vi != V.end(); ++Vi)
-                    {
-                            CovCol d = *Vi - mean;
-                            c += d * d.transpose();
-                    }
+                    CovMat c(mean.getDOF(), mean.getDOF());
+                    c.noalias() = d * d.transpose();
 
                     return 0.5 * c;
             }
@@ -621,12 +696,14 @@ namespace localization
 
                     CrossCov c(CrossCov::Zero());
 
+                    typename _State::vectorized_points_type dx;
+                    _State::boxminusSigmaPoints(X, mean_x, dx);
+
                     {
-                            typename _SigmaPoints::const_iterator Xi = X.begin();
                             typename std::vector<_Measurement>::const_iterator Zi = Z.begin();
-                            for (;Zi != Z.end(); ++Xi, ++Zi)
+                            for (int i = 0; Zi != Z.end(); ++i, ++Zi)
                             {
-                                    c += (*Xi - mean_x) * (*Zi - mean_z).transpose();
+                                    c += dx.col(i) * (*Zi - mean_z).transpose();
                             }
                     }
 
@@ -645,12 +722,14 @@ namespace localization
                     CrossCov c(mu_state.getDOF(), mean_z.size());
                     c.setZero();
 
+                    typename _State::vectorized_points_type dx;
+                    _State::boxminusSigmaPoints(X, mean_x, dx);
+
                     {
-                            typename _SigmaPoints::const_iterator Xi = X.begin();
                             typename std::vector< Eigen::Matrix<ScalarType, Eigen::Dynamic, 1> >::const_iterator Zi = Z.begin();
-                            for (;Zi != Z.end(); ++Xi, ++Zi)
+                            for (int i = 0; Zi != Z.end(); ++i, ++Zi)
                             {
-                                    c += (*Xi - mean_x) * (*Zi - mean_z).transpose();
+                                    c += dx.col(i) * (*Zi - mean_z).transpose();
                             }
                     }
 
@@ -672,7 +751,7 @@ namespace localization
                     generateSigmaPoints(statek_i, delta, Pk_i, X);
 
                     statek_i = meanSigmaPoints(X);
-                    Pk_i = covSigmaPoints<_SingleState::DOF>(statek_i, X);
+                    Pk_i = covSigmaPoints(statek_i, X);
             }
 
             // for debugging only
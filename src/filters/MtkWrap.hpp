@@ -38,7 +38,15 @@
 #define _MTKWRAP_HPP_
 
 #include <cassert>/** Assert */
+#include <vector> /** std::vector */
 #include <Eigen/Core> /** Eigen */
+#include <Eigen/Geometry> /** Eigen::Quaternion */
+
+/** MTK start index of the sub-manifolds **/
+#include <mtk/startIdx.hpp>
+
+/** Batched SO3 exp/log **/
+#include <localization/filters/SO3Batch.hpp>
 
 
 namespace  localization
@@ -61,6 +69,8 @@ namespace  localization
             };
 
             typedef Eigen::Matrix<scalar_type, DOF, 1> vectorized_type;
+            typedef Eigen::Matrix<scalar_type, DOF, Eigen::Dynamic> vectorized_points_type;
+            typedef SO3Batch<scalar_type> SO3BatchType;
 
             MtkWrap(const M &m=M()) : M(m) {}
 
@@ -112,6 +122,59 @@ namespace  localization
                     return !(*this == other);
             }
 
+            /*
+             * manifold operator (+) for many points,
+             * X[i] = mu + deltas.col(i)
+             *
+             * Same result as the operator (+) on every column, but the
+             * orientations of all the points go through the batched SO3
+             * exponential at once. M has to have an orient member and
+             * a boxplusVectors method for the other sub-manifolds.
+             */
+            template <typename _Sigma>
+            static void boxplusSigmaPoints(const self &mu, const vectorized_points_type &deltas, _Sigma &X)
+            {
+                    const int number_points = static_cast<int>(deltas.cols());
+                    const int orient_idx = ::MTK::getStartIdx(&M::orient);
+                    assert(static_cast<int>(X.size()) == number_points);
+
+                    Eigen::Matrix<scalar_type, 4, Eigen::Dynamic> quat(4, number_points);
+                    SO3BatchType::exp(deltas.template middleRows<3>(orient_idx), 1, quat);
+
+                    for (int i = 0; i < number_points; ++i)
+                    {
+                            X[i] = mu;
+                            X[i].boxplusVectors(deltas.col(i).data());
+                            X[i].orient = mu.orient * Eigen::Quaternion<scalar_type>(quat.col(i));
+                    }
+            }
+
+            /*
+             * manifold operator (-) for many points,
+             * result.col(i) = X[i] - reference
+             *
+             * The orientations of all the points go through the batched
+             * SO3 logarithm at once.
+             */
+            template <typename _Sigma>
+            static void boxminusSigmaPoints(const _Sigma &X, const self &reference, vectorized_points_type &result)
+            {
+                    const int number_points = static_cast<int>(X.size());
+                    const int orient_idx = ::MTK::getStartIdx(&M::orient);
+                    const Eigen::Quaternion<scalar_type> reference_inv(reference.orient.conjugate());
+
+                    result.resize(DOF, number_points);
+                    Eigen::Matrix<scalar_type, 4, Eigen::Dynamic> quat(4, number_points);
+
+                    for (int i = 0; i < number_points; ++i)
+                    {
+                            X[i].boxminusVectors(result.col(i).data(), reference);
+                            quat.col(i) = (reference_inv * X[i].orient).coeffs();
+                    }
+
+                    SO3BatchType::log(quat, 1, result.template middleRows<3>(orient_idx));
+            }
+
     public:
             EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     };
@@ -130,6 +193,11 @@ namespace  localization
 
 
             typedef Eigen::Matrix<scalar_type, Eigen::Dynamic, 1> vectorized_type;
+            typedef Eigen::Matrix<scalar_type, Eigen::Dynamic, Eigen::Dynamic> vectorized_points_type;
+            typedef SO3Batch<scalar_type> SO3BatchType;
+
+            typedef typename M::SingleState SingleState;
+            typedef typename M::SingleSensorState SingleSensorState;
 
             MtkDynamicWrap(const M &m=M()) : M(m) {}
 
@@ -161,8 +229,7 @@ namespace  localization
             {
                     assert(delta_state.getDOF() == M::getDOF());
 
-                    M state; state = delta_state;
-                    M::boxplus(state);
+                    M::boxplus(delta_state);
                     return *this;
             }
 
@@ -239,6 +306,123 @@ namespace  localization
                     return !(*this == other);
             }
 
+            /*
+             * manifold operator (+) for many points,
+             * X[i] = mu + deltas.col(i)
+             *
+             * The orientation of the single state and the ones of all the
+             * sensor poses of all the points go through the batched SO3
+             * exponential at once.
+             */
+            template <typename _Sigma>
+            static void boxplusSigmaPoints(const self &mu, const vectorized_points_type &deltas, _Sigma &X)
+            {
+                    const int number_points = static_cast<int>(deltas.cols());
+                    const int number_sensors = static_cast<int>(mu.sensorsk.size());
+                    const int number_orient = number_sensors + 1;
+                    assert(static_cast<int>(X.size()) == number_points);
+                    assert(deltas.rows() == mu.getDOF());
+
+                    std::vector<int> orient_idx(number_orient);
+                    orientationIndexes(number_sensors, orient_idx);
+
+                    Eigen::Matrix<scalar_type, 3, Eigen::Dynamic> rotvec(3, number_points * number_orient);
+                    Eigen::Matrix<scalar_type, 4, Eigen::Dynamic> quat(4, number_points * number_orient);
+                    for (int i = 0; i < number_points; ++i)
+                    {
+                            for (int k = 0; k < number_orient; ++k)
+                            {
+                                    rotvec.col(i*number_orient + k) = deltas.col(i).template segment<3>(orient_idx[k]);
+                            }
+                    }
+
+                    SO3BatchType::exp(rotvec, 1, quat);
+
+                    for (int i = 0; i < number_points; ++i)
+                    {
+                            const scalar_type *delta = deltas.col(i).data();
+                            const scalar_type *delta_sensors = delta + SingleState::DOF;
+                            self &Xi(X[i]);
+
+                            Xi.statek = mu.statek;
+                            Xi.statek.boxplusVectors(delta);
+                            Xi.statek.orient = mu.statek.orient * Eigen::Quaternion<scalar_type>(quat.col(i*number_orient));
+
+                            Xi.sensorsk = mu.sensorsk;
+                            for (int k = 0; k < number_sensors; ++k)
+                            {
+                                    SingleSensorState &sensor(Xi.sensorsk[k]);
+                                    sensor.boxplusVectors(delta_sensors + k*SingleSensorState::DOF);
+                                    sensor.orient = mu.sensorsk[k].orient * Eigen::Quaternion<scalar_type>(quat.col(i*number_orient + k + 1));
+                            }
+                    }
+            }
+
+            /*
+             * manifold operator (-) for many points,
+             * result.col(i) = X[i] - reference
+             *
+             * All the orientations of all the points go through the batched
+             * SO3 logarithm at once.
+             */
+            template <typename _Sigma>
+            static void boxminusSigmaPoints(const _Sigma &X, const self &reference, vectorized_points_type &result)
+            {
+                    const int number_points = static_cast<int>(X.size());
+                    const int number_sensors = static_cast<int>(reference.sensorsk.size());
+                    const int number_orient = number_sensors + 1;
+
+                    std::vector<int> orient_idx(number_orient);
+                    orientationIndexes(number_sensors, orient_idx);
+
+                    result.resize(reference.getDOF(), number_points);
+                    Eigen::Matrix<scalar_type, 3, Eigen::Dynamic> rotvec(3, number_points * number_orient);
+                    Eigen::Matrix<scalar_type, 4, Eigen::Dynamic> quat(4, number_points * number_orient);
+
+                    for (int i = 0; i < number_points; ++i)
+                    {
+                            const self &Xi(X[i]);
+                            assert(Xi.getDOF() == reference.getDOF());
+                            scalar_type *res = result.col(i).data();
+                            scalar_type *res_sensors = res + SingleState::DOF;
+
+                            Xi.statek.boxminusVectors(res, reference.statek);
+                            quat.col(i*number_orient) = (reference.statek.orient.conjugate() * Xi.statek.orient).coeffs();
+
+                            for (int k = 0; k < number_sensors; ++k)
+                            {
+                                    const SingleSensorState &sensor(Xi.sensorsk[k]);
+                                    const SingleSensorState &other(reference.sensorsk[k]);
+                                    sensor.boxminusVectors(res_sensors + k*SingleSensorState::DOF, other);
+                                    quat.col(i*number_orient + k + 1) = (other.orient.conjugate() * sensor.orient).coeffs();
+                            }
+                    }
+
+                    SO3BatchType::log(quat, 1, rotvec);
+
+                    for (int i = 0; i < number_points; ++i)
+                    {
+                            for (int k = 0; k < number_orient; ++k)
+                            {
+                                    result.col(i).template segment<3>(orient_idx[k]) = rotvec.col(i*number_orient + k);
+                            }
+                    }
+            }
+
+    private:
+            /* Start index of the orientation of the single state and of
+             * each sensor pose in the vectorized state
+             */
+            static void orientationIndexes(const int number_sensors, std::vector<int> &orient_idx)
+            {
+                    orient_idx[0] = ::MTK::getStartIdx(&SingleState::orient);
+                    for (int k = 0; k < number_sensors; ++k)
+                    {
+                            orient_idx[k+1] = SingleState::DOF + k*SingleSensorState::DOF
+                                + ::MTK::getStartIdx(&SingleSensorState::orient);
+                    }
+            }
+
     public:
             EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     };
@@ -0,0 +1,211 @@
+#ifndef _SO3_BATCH_HPP_
+#define _SO3_BATCH_HPP_
+
+#include <cmath> /** std::sqrt */
+#include <algorithm> /** std::min */
+#include <Eigen/Core> /** Core methods of Eigen implementation **/
+
+namespace localization
+{
+    /**@brief Batched SO3 exponential and logarithm
+     *
+     * Same maps as MTK::SO3::exp and MTK::SO3::log but for many rotations at
+     * once. The rotations are processed in lanes of _Lanes elements stored as
+     * fixed size Eigen arrays (one array per component). Eigen has no packet
+     * sin, cos or atan for double, so these are computed here from products,
+     * divisions, square roots, round and selects only, which Eigen maps to
+     * its packet math (SSE/AVX/NEON depending on the compile flags; round
+     * needs SSE4.1 on x86). The small angle case is computed with its Taylor
+     * series and selected per element, there is no branch on the angle.
+     *
+     * Quaternions are stored as (x, y, z, w) columns, the same order as
+     * Eigen::Quaternion::coeffs().
+     */
+    template <typename _Scalar, int _Lanes = 8>
+    struct SO3Batch
+    {
+        enum
+        {
+            LANES = _Lanes
+        };
+
+        typedef Eigen::Array<_Scalar, 1, _Lanes> Lane;
+
+        /**@brief Angle below which the Taylor series are used
+         */
+        static _Scalar tolerance()
+        {
+            return std::sqrt(std::sqrt(Eigen::NumTraits<_Scalar>::epsilon()));
+        }
+
+        /**@brief sin and cos of one lane
+         *
+         * The angle is reduced by the nearest multiple of pi/2 (Cody-Waite,
+         * pi/2 in two parts) to [-pi/4, pi/4], where the Taylor polynomials
+         * are exact to double precision, and the quadrant is selected.
+         */
+        static inline void sinCos(const Lane &angle, Lane &sine, Lane &cosine)
+        {
+            static const double pio2 = 1.5707963267948966;
+            const _Scalar pio2_hi = _Scalar(pio2);
+            const _Scalar pio2_lo = _Scalar((pio2 - static_cast<double>(pio2_hi)) + 6.123233995736766e-17);
+
+            const Lane k = (angle * _Scalar(1.0 / pio2)).round();
+            const Lane r = (angle - k * pio2_hi) - k * pio2_lo;
+            const Lane r2 = r.square();
+
+            /** sin(r)/r and cos(r) as Taylor polynomials of r^2 **/
+            static const double sin_coeffs[9] = {1.0, -1.0/6.0, 1.0/120.0, -1.0/5040.0, 1.0/362880.0,
+                -1.0/39916800.0, 1.0/6227020800.0, -1.0/1307674368000.0, 1.0/355687428096000.0};
+            static const double cos_coeffs[9] = {1.0, -1.0/2.0, 1.0/24.0, -1.0/720.0, 1.0/40320.0,
+                -1.0/3628800.0, 1.0/479001600.0, -1.0/87178291200.0, 1.0/20922789888000.0};
+            Lane s = Lane::Constant(_Scalar(sin_coeffs[8])), c = Lane::Constant(_Scalar(cos_coeffs[8]));
+            for (int i = 7; i >= 0; --i)
+            {
+                s = _Scalar(sin_coeffs[i]) + r2 * s;
+                c = _Scalar(cos_coeffs[i]) + r2 * c;
+            }
+            s *= r;
+
+            /** rotation by k * pi/2: with m = k mod 4 in [-2, 2] its sine
+             * is m * (2 - |m|) and its cosine 1 - |m| **/
+            const Lane m = k - _Scalar(4) * (_Scalar(0.25) * k).round();
+            const Lane sm = m * (_Scalar(2) - m.abs()), cm = _Scalar(1) - m.abs();
+            sine = s * cm + c * sm;
+            cosine = c * cm - s * sm;
+        }
+
+        /**@brief atan(y/x) of one lane for y, x >= 0, not both zero
+         *
+         * Reduced to [0, 1] by the symmetry around pi/4, to [-tan(pi/8),
+         * tan(pi/8)] around pi/4 and halved once more, the Taylor polynomial
+         * of the remaining |u| <= tan(pi/16) is exact to double precision.
+         */
+        static inline Lane atan2Positive(const Lane &y, const Lane &x)
+        {
+            static const double pio4 = 0.78539816339744831;
+            const Lane x1 = y.min(x) / y.max(x);
+            const Lane big = (x1 > _Scalar(0.41421356237309503)).select(Lane::Ones(), Lane::Zero());
+            const Lane x2 = (big > _Scalar(0)).select((x1 - _Scalar(1)) / (x1 + _Scalar(1)), x1);
+            const Lane u = x2 / (_Scalar(1) + (_Scalar(1) + x2.square()).sqrt());
+            const Lane u2 = u.square();
+
+            /** atan(u)/u as Taylor polynomial of u^2 **/
+            static const double atan_coeffs[12] = {1.0, -1.0/3.0, 1.0/5.0, -1.0/7.0, 1.0/9.0, -1.0/11.0,
+                1.0/13.0, -1.0/15.0, 1.0/17.0, -1.0/19.0, 1.0/21.0, -1.0/23.0};
+            Lane a = Lane::Constant(_Scalar(atan_coeffs[11]));
+            for (int i = 10; i >= 0; --i)
+                a = _Scalar(atan_coeffs[i]) + u2 * a;
+            a = _Scalar(2) * u * a + big * _Scalar(pio4);
+
+            return (y > x).select(_Scalar(2.0 * pio4) - a, a);
+        }
+
+        /**@brief exp of one lane: q = exp(scale * r / 2), as MTK::SO3::exp(r, scale)
+         */
+        static inline void exp(const Lane &rx, const Lane &ry, const Lane &rz, const _Scalar scale,
+                        Lane &qx, Lane &qy, Lane &qz, Lane &qw)
+        {
+            const _Scalar tol = tolerance();
+            const Lane theta = (rx.square() + ry.square() + rz.square()).sqrt();
+            const Lane alpha = (_Scalar(0.5) * scale) * theta;
+            const Lane alpha2 = alpha.square();
+
+            Lane sine;
+            sinCos(alpha, sine, qw);
+
+            /** sin(alpha)/theta and its series around zero **/
+            const Lane k = (theta > tol).select(sine / theta.max(tol),
+                    (_Scalar(0.5) * scale) * (_Scalar(1) - alpha2 / _Scalar(6) + alpha2.square() / _Scalar(120)));
+
+            qx = k * rx;
+            qy = k * ry;
+            qz = k * rz;
+        }
+
+        /**@brief log of one lane: r = scale * 2 * log(q), the scaled rotation vector
+         *
+         * Both q and -q give the rotation vector of the shortest rotation.
+         */
+        static inline void log(const Lane &qx, const Lane &qy, const Lane &qz, const Lane &qw, const _Scalar scale,
+                        Lane &rx, Lane &ry, Lane &rz)
+        {
+            const _Scalar tol = tolerance();
+            const Lane n = (qx.square() + qy.square() + qz.square()).sqrt();
+            const Lane aw = qw.abs();
+            const Lane t2 = n.square() / aw.square();
+
+            /** atan(n/|w|)/n and its series around zero **/
+            const Lane k = (n > tol).select(atan2Positive(n, aw) / n.max(tol),
+                    (_Scalar(1) - t2 / _Scalar(3) + t2.square() / _Scalar(5)) / aw);
+            const Lane f = (_Scalar(2) * scale) * (qw < _Scalar(0)).select(-k, k);
+
+            rx = f * qx;
+            ry = f * qy;
+            rz = f * qz;
+        }
+
+        /**@brief exp of all columns of rotvec (3 x n) into quat (4 x n)
+         *
+         * Both arguments can be any Eigen expression with direct access,
+         * e.g. a Map with an outer stride over a state vector.
+         */
+        template <typename _RotVec, typename _Quat>
+        static void exp(const Eigen::MatrixBase<_RotVec> &rotvec, const _Scalar scale,
+                    const Eigen::MatrixBase<_Quat> &quat_)
+        {
+            Eigen::MatrixBase<_Quat> &quat = const_cast< Eigen::MatrixBase<_Quat>& >(quat_);
+            const int n = static_cast<int>(rotvec.cols());
+            Lane rx, ry, rz, qx, qy, qz, qw;
+
+            for (int col = 0; col < n; col += _Lanes)
+            {
+                const int size = std::min(static_cast<int>(_Lanes), n - col);
+                rx.setZero(); ry.setZero(); rz.setZero();
+                for (int i = 0; i < size; ++i)
+                {
+                    rx[i] = rotvec(0, col+i); ry[i] = rotvec(1, col+i); rz[i] = rotvec(2, col+i);
+                }
+
+                exp(rx, ry, rz, scale, qx, qy, qz, qw);
+
+                for (int i = 0; i < size; ++i)
+                {
+                    quat(0, col+i) = qx[i]; quat(1, col+i) = qy[i];
+                    quat(2, col+i) = qz[i]; quat(3, col+i) = qw[i];
+                }
+            }
+        }
+
+        /**@brief log of all columns of quat (4 x n) into rotvec (3 x n)
+         */
+        template <typename _Quat, typename _RotVec>
+        static void log(const Eigen::MatrixBase<_Quat> &quat, const _Scalar scale,
+                    const Eigen::MatrixBase<_RotVec> &rotvec_)
+        {
+            Eigen::MatrixBase<_RotVec> &rotvec = const_cast< Eigen::MatrixBase<_RotVec>& >(rotvec_);
+            const int n = static_cast<int>(quat.cols());
+            Lane qx, qy, qz, qw, rx, ry, rz;
+
+            for (int col = 0; col < n; col += _Lanes)
+            {
+                const int size = std::min(static_cast<int>(_Lanes), n - col);
+                qx.setZero(); qy.setZero(); qz.setZero(); qw.setOnes();
+                for (int i = 0; i < size; ++i)
+                {
+                    qx[i] = quat(0, col+i); qy[i] = quat(1, col+i);
+                    qz[i] = quat(2, col+i); qw[i] = quat(3, col+i);
+                }
+
+                log(qx, qy, qz, qw, scale, rx, ry, rz);
+
+                for (int i = 0; i < size; ++i)
+                {
+                    rotvec(0, col+i) = rx[i]; rotvec(1, col+i) = ry[i]; rotvec(2, col+i) = rz[i];
+                }
+            }
+        }
+    };
+}
+
+#endif /** end of _SO3_BATCH_HPP_ */
@@ -7,6 +7,10 @@
 
 //#include <localization/mtk/SOn.hpp>
 #include <mtk/types/SOn.hpp>
+#include <mtk/startIdx.hpp>
+
+/** Batched SO3 exp/log **/
+#include <localization/filters/SO3Batch.hpp>
 
 #ifndef PARSED_BY_DOXYGEN
 //////// internals //////
@@ -96,6 +100,18 @@ namespace localization
             orient.boxminus(::MTK::subvector(__res, &self::orient), __oth.orient);
         }
 
+        /** @brief boxplus of the position only, see State::boxplusVectors
+         */
+        void boxplusVectors(const ::MTK::vectview<const scalar, DOF> & __vec, scalar __scale = 1 )
+        {
+            pos.boxplus(::MTK::subvector(__vec, &self::pos), __scale);
+        }
+
+        void boxminusVectors(::MTK::vectview<scalar,DOF> __res, const ReducedState& __oth) const
+        {
+            pos.boxminus(::MTK::subvector(__res, &self::pos), __oth.pos);
+        }
+
         friend std::ostream& operator<<(std::ostream& __os, const ReducedState& __var)
         {
             return __os << __var.pos << " " << __var.orient << " ";
@@ -109,7 +125,7 @@ namespace localization
         /**@brief Create a vectorize state of a single state vector
          */
 
-        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS)
+        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS) const
         {
 
             ReducedState::vectorized_type vstate;
@@ -199,6 +215,27 @@ namespace localization
             angvelo.boxminus(::MTK::subvector(__res, &self::angvelo), __oth.angvelo);
         }
 
+        /** @brief boxplus of all the sub-manifolds but the orientation
+         *
+         * The sigma point operations of the wrappers (see MtkWrap.hpp) use
+         * it and apply the orientations of all the points with SO3Batch.
+         */
+        void boxplusVectors(const ::MTK::vectview<const scalar, DOF> & __vec, scalar __scale = 1 )
+        {
+            pos.boxplus(::MTK::subvector(__vec, &self::pos), __scale);
+            velo.boxplus(::MTK::subvector(__vec, &self::velo), __scale);
+            angvelo.boxplus(::MTK::subvector(__vec, &self::angvelo), __scale);
+        }
+
+        /** @brief boxminus of all the sub-manifolds but the orientation
+         */
+        void boxminusVectors(::MTK::vectview<scalar,DOF> __res, const State& __oth) const
+        {
+            pos.boxminus(::MTK::subvector(__res, &self::pos), __oth.pos);
+            velo.boxminus(::MTK::subvector(__res, &self::velo), __oth.velo);
+            angvelo.boxminus(::MTK::subvector(__res, &self::angvelo), __oth.angvelo);
+        }
+
         friend std::ostream& operator<<(std::ostream& __os, const State& __var)
         {
             return __os << __var.pos << " " << " " << __var.orient << " " << __var.velo << " " << __var.angvelo << " " ;
@@ -212,7 +249,7 @@ namespace localization
         /**@brief Create a vectorize state of a single state vector
          */
 
-        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS)
+        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS) const
         {
 
             State::vectorized_type vstate;
@@ -295,6 +332,18 @@ namespace localization
             orient.boxminus(::MTK::subvector(__res, &self::orient), __oth.orient);
         }
 
+        /** @brief boxplus of the position only, see State::boxplusVectors
+         */
+        void boxplusVectors(const ::MTK::vectview<const scalar, DOF> & __vec, scalar __scale = 1 )
+        {
+            pos.boxplus(::MTK::subvector(__vec, &self::pos), __scale);
+        }
+
+        void boxminusVectors(::MTK::vectview<scalar,DOF> __res, const SensorState& __oth) const
+        {
+            pos.boxminus(::MTK::subvector(__res, &self::pos), __oth.pos);
+        }
+
         friend std::ostream& operator<<(std::ostream& __os, const SensorState& __var)
         {
             return __os << __var.pos << " " << " " << __var.orient << " " ;
@@ -308,7 +357,7 @@ namespace localization
         /**@brief Create a vectorize state of a single state vector
          */
 
-        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS)
+        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS) const
         {
 
             SensorState::vectorized_type vstate;
@@ -362,6 +411,13 @@ namespace localization
         typedef Eigen::Matrix<scalar, Eigen::Dynamic, 1> vectorized_type;
 
         typedef _State SingleState;
+        typedef _SensorState SingleSensorState;
+
+        /** Batched SO3 kernels for the orientations of the sensor poses **/
+        typedef SO3Batch<scalar> SO3BatchType;
+        typedef Eigen::Matrix<scalar, 4, SO3BatchType::LANES> LaneQuaternions;
+        typedef Eigen::Map<Eigen::Matrix<scalar, SO3::DOF, Eigen::Dynamic>, 0, Eigen::OuterStride<> > SensorRotations;
+        typedef Eigen::Map<const Eigen::Matrix<scalar, SO3::DOF, Eigen::Dynamic>, 0, Eigen::OuterStride<> > ConstSensorRotations;
 
         MultiState (
                 const _State& statek = _State(),
@@ -380,55 +436,100 @@ namespace localization
         void set (const vectorized_type &vstate, const VectorizedMode type = ANGLE_AXIS)
         {
             /** Set state **/
-            Eigen::Matrix<scalar, _State::DOF, 1> tmp_vstate;
-            tmp_vstate = vstate.block(0, 0, _State::DOF, 1);
-            statek.set(tmp_vstate, typename _State::VectorizedMode(type));
+            statek.set(vstate.template segment<_State::DOF>(0), typename _State::VectorizedMode(type));
 
             /** Set sensor poses states **/
             register size_t sensor_idx = 0;
             for (typename std::vector<_SensorState>::iterator it = sensorsk.begin();
                     it != sensorsk.end(); ++it)
             {
-                Eigen::Matrix<scalar, _SensorState::DOF, 1> tmp_vsensor;
-                tmp_vsensor = vstate.block(_State::DOF +(sensor_idx*_SensorState::DOF), 0, _SensorState::DOF, 1);
-                it->set(tmp_vsensor, typename _SensorState::VectorizedMode(type));
+                it->set(vstate.template segment<_SensorState::DOF>(_State::DOF + (sensor_idx*_SensorState::DOF)),
+                        typename _SensorState::VectorizedMode(type));
                 sensor_idx++;
             }
 
             return;
         }
 
-        void boxplus(MultiState & __state, scalar __scale = 1 )
+        /** @brief boxplus with a delta given as a MultiState
+         *
+         * The tangent vector of __state is written into one vector and
+         * applied with the vectorized boxplus below.
+         */
+        void boxplus(const MultiState & __state, scalar __scale = 1 )
         {
-            typename _State::vectorized_type vectstate;
+            vectorized_type delta(__state.getDOF());
+            __state.getTangentVector(&delta);
+            this->boxplus(delta, __scale);
+        }
 
-            vectstate = __state.statek.getVectorizedState();
-            statek.boxplus(vectstate.data(), __scale);
+        /** @brief Tangent vector of the state, its boxminus from the identity
+         *
+         * __res has to be of size getDOF(). Same values as
+         * getVectorizedState(ANGLE_AXIS) but each sub-state writes directly
+         * into its segment of __res and the orientations of the sensor poses
+         * go through the batched SO3 logarithm.
+         */
+        void getTangentVector(vectorized_type *__res) const
+        {
+            const _SensorState identity;
+            scalar *res = __res->data();
+            this->statek.boxminus(res, _State());
+            res += _State::DOF;
+
+            const int pos_idx = ::MTK::getStartIdx(&_SensorState::pos);
+            const int orient_idx = ::MTK::getStartIdx(&_SensorState::orient);
+            const int number_sensors = static_cast<int>(this->sensorsk.size());
+            SensorRotations rotvec(res + orient_idx, SO3::DOF, number_sensors, Eigen::OuterStride<>(_SensorState::DOF));
+            LaneQuaternions quat;
 
-            typename std::vector<_SensorState>::iterator it_this_sensorsk = sensorsk.begin();
-            typename std::vector<_SensorState>::iterator it_state_sensorsk = __state.sensorsk.begin();
-            for ( ;it_state_sensorsk != __state.sensorsk.end(); ++it_state_sensorsk, ++it_this_sensorsk)
+            for (int col = 0; col < number_sensors; col += SO3BatchType::LANES)
             {
-                typename _SensorState::vectorized_type vectsensor;
-                vectsensor = it_state_sensorsk->getVectorizedState();
-                it_this_sensorsk->boxplus(vectsensor.data(), __scale);
+                const int size = std::min(static_cast<int>(SO3BatchType::LANES), number_sensors - col);
+
+                for (int i = 0; i < size; ++i)
+                {
+                    const _SensorState &sensor(this->sensorsk[col+i]);
+                    sensor.pos.boxminus(res + (col+i)*_SensorState::DOF + pos_idx, identity.pos);
+                    quat.col(i) = sensor.orient.coeffs();
+                }
+
+                SO3BatchType::log(quat.leftCols(size), 1, rotvec.middleCols(col, size));
             }
         }
 
+        /** @brief boxplus with a vectorized delta
+         *
+         * Each sub-state works on a view of its segment in __vecstate, no
+         * intermediate vectors are built. The orientations of the sensor
+         * poses go through the batched SO3 exponential, one lane of poses
+         * at a time.
+         */
         void boxplus(const vectorized_type & __vecstate, scalar __scale = 1 )
         {
             if (__vecstate.size() == this->getDOF())
             {
-                typename _State::vectorized_type vectstate = __vecstate.block(0, 0, _State::DOF, 1);
-                this->statek.boxplus(vectstate.data(), __scale);
+                const scalar *delta = __vecstate.data();
+                this->statek.boxplus(delta, __scale);
+                delta += _State::DOF;
 
-                typename std::vector<_SensorState>::iterator it_this_sensorsk = this->sensorsk.begin();
-                for ( ;it_this_sensorsk != this->sensorsk.end(); ++it_this_sensorsk)
+                const int pos_idx = ::MTK::getStartIdx(&_SensorState::pos);
+                const int orient_idx = ::MTK::getStartIdx(&_SensorState::orient);
+                const int number_sensors = static_cast<int>(this->sensorsk.size());
+                const ConstSensorRotations rotvec(delta + orient_idx, SO3::DOF, number_sensors, Eigen::OuterStride<>(_SensorState::DOF));
+                LaneQuaternions quat;
+
+                for (int col = 0; col < number_sensors; col += SO3BatchType::LANES)
                 {
-                    unsigned int index = it_this_sensorsk - this->sensorsk.begin();
-                    typename _SensorState::vectorized_type vectsensor;
-                    vectsensor = __vecstate.block(_State::DOF+(index*_SensorState::DOF), 0, _SensorState::DOF, 1);
-                    it_this_sensorsk->boxplus(vectsensor.data(), __scale);
+                    const int size = std::min(static_cast<int>(SO3BatchType::LANES), number_sensors - col);
+                    SO3BatchType::exp(rotvec.middleCols(col, size), __scale, quat.leftCols(size));
+
+                    for (int i = 0; i < size; ++i)
+                    {
+                        _SensorState &sensor(this->sensorsk[col+i]);
+                        sensor.pos.boxplus(delta + (col+i)*_SensorState::DOF + pos_idx, __scale);
+                        sensor.orient = sensor.orient * Eigen::Quaternion<scalar>(quat.col(i));
+                    }
                 }
             }
         }
@@ -457,27 +558,38 @@ namespace localization
         //    //std::cout<<"after in boxminus __res:\n "<<__res<<"\n";
         //}
 
+        /** @brief boxminus into a vectorized result
+         *
+         * __res has to be of size getDOF(). Each sub-state writes directly
+         * into its segment of __res. The orientations of the sensor poses go
+         * through the batched SO3 logarithm, one lane of poses at a time.
+         */
         void boxminus(vectorized_type *__res, const MultiState& __oth) const
         {
-            typename _State::vectorized_type vectstate;
-            vectstate = __res->block(0, 0, _State::DOF, 1);
-            //std::cout<<"in boxminus __res:\n "<<__res<<"\n";
-            //std::cout<<"in boxminus __oth:\n "<<__oth<<"\n";
-            this->statek.boxminus(vectstate.data(), __oth.statek);
-            __res->block(0, 0, _State::DOF, 1) = vectstate;
+            scalar *res = __res->data();
+            this->statek.boxminus(res, __oth.statek);
+            res += _State::DOF;
+
+            const int pos_idx = ::MTK::getStartIdx(&_SensorState::pos);
+            const int orient_idx = ::MTK::getStartIdx(&_SensorState::orient);
+            const int number_sensors = static_cast<int>(this->sensorsk.size());
+            SensorRotations rotvec(res + orient_idx, SO3::DOF, number_sensors, Eigen::OuterStride<>(_SensorState::DOF));
+            LaneQuaternions quat;
 
-            typename std::vector<_SensorState>::const_iterator it_this_sensorsk = this->sensorsk.begin();
-            typename std::vector<_SensorState>::const_iterator it_oth_sensorsk = __oth.sensorsk.begin();
-            for ( ;it_this_sensorsk != this->sensorsk.end(); ++it_this_sensorsk, ++it_oth_sensorsk)
+            for (int col = 0; col < number_sensors; col += SO3BatchType::LANES)
             {
-                unsigned int index = it_this_sensorsk - this->sensorsk.begin();
-                typename _SensorState::vectorized_type vectsensor;
-                vectsensor = __res->block(_State::DOF+(index*_SensorState::DOF), 0, _SensorState::DOF, 1);
-                it_this_sensorsk->boxminus(vectsensor.data(), *it_oth_sensorsk);
-                __res->block(_State::DOF+(index*_SensorState::DOF), 0, _SensorState::DOF, 1) = vectsensor;
-            }
+                const int size = std::min(static_cast<int>(SO3BatchType::LANES), number_sensors - col);
+
+                for (int i = 0; i < size; ++i)
+                {
+                    const _SensorState &sensor(this->sensorsk[col+i]);
+                    const _SensorState &other(__oth.sensorsk[col+i]);
+                    sensor.pos.boxminus(res + (col+i)*_SensorState::DOF + pos_idx, other.pos);
+                    quat.col(i) = (other.orient.conjugate() * sensor.orient).coeffs();
+                }
 
-            //std::cout<<"after in boxminus __res:\n "<<*__res<<"\n";
+                SO3BatchType::log(quat.leftCols(size), 1, rotvec.middleCols(col, size));
+            }
         }
 
         friend std::ostream& operator<<(std::ostream& __os, const MultiState& __var)
@@ -506,19 +618,19 @@ namespace localization
             return __is;
         }
 
-        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS)
+        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS) const
         {
-            vectorized_type vstate(static_cast<unsigned int>(DOF), 1);
+            vectorized_type vstate(this->getDOF(), 1);
 
             /** Statek **/
-            vstate.block(0, 0, _State::DOF, 1) = statek.getVectorizedState(static_cast<typename _State::VectorizedMode>(type));
+            vstate.template segment<_State::DOF>(0) = statek.getVectorizedState(static_cast<typename _State::VectorizedMode>(type));
 
             /** Sensors **/
             register size_t sensor_idx = 0;
-            for (typename std::vector<_SensorState>::iterator it = sensorsk.begin();
+            for (typename std::vector<_SensorState>::const_iterator it = sensorsk.begin();
                     it != sensorsk.end(); ++it)
             {
-                vstate.block(_State::DOF + (sensor_idx*_SensorState::DOF), 0, _SensorState::DOF, 1) = it->getVectorizedState(static_cast<typename _SensorState::VectorizedMode >(type));
+                vstate.template segment<_SensorState::DOF>(_State::DOF + (sensor_idx*_SensorState::DOF)) = it->getVectorizedState(static_cast<typename _SensorState::VectorizedMode >(type));
                 sensor_idx++;
             }
 
@@ -645,7 +757,7 @@ namespace localization
             return __is >> __var.statek >> __var.statek_l >> __var.statek_i >> __var.featuresk >> __var.featuresk_l;
         }
 
-        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS)
+        vectorized_type getVectorizedState (const VectorizedMode type = ANGLE_AXIS) const
         {
             vectorized_type vstate(this->getDOF(), 1);
 
@@ -8,6 +8,8 @@
 
 /** Boost **/
 #include <boost/bind.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
 
 /** Eigen **/
 #include <Eigen/Core>
@@ -25,6 +27,10 @@
 #include <ukfom/traits/dof.hpp>
 #include <ukfom/util.hpp>
 
+/** Process and measurement model functors **/
+#include <localization/filters/Functors.hpp>
+#include <localization/tools/Checkpoint.hpp>
+
 /** MTK's pose and orientation definition **/
 #include <mtk/startIdx.hpp>
 
@@ -103,11 +109,16 @@ namespace localization
             }
 
             /**@brief Filter prediction step
+             *
+             * f is either a callable returning the propagated state, f(state),
+             * or an in-place model built with localization::inPlace(g) where
+             * g(const _SingleState &in, _SingleState &out). The same applies to
+             * the measurement model h of the update.
              */
             template<typename _ProcessModel>
             void predict(_ProcessModel f, const SingleStateCovariance &Q)
             {
-                predict(f, boost::bind(ukfom::id<SingleStateCovariance>, Q));
+                predict(f, constantCovariance(Q));
             }
 
             template<typename _ProcessModel, typename _ProcessNoiseCovariance>
@@ -138,7 +149,7 @@ namespace localization
                 /*****************************/
 
                 /** Apply the non-linear transformation of the process model **/
-                std::transform(X.begin(), X.end(), X.begin(), f);
+                applyModel(f, XCopy, X);
 
                 #ifdef USCKF_DEBUG_PRINTS
                 printSigmaPoints<SingleStateSigma>(X);
@@ -175,7 +186,7 @@ namespace localization
                 /************************/
 
                 /** Compute the Process model Covariance **/
-                Pk_i = covSigmaPoints<_SingleState::DOF, _SingleState>(mu_state.statek_i, X) + Qk;
+                Pk_i = covSigmaPoints(mu_state.statek_i, X) + Qk;
 
                 /** Store the subcovariance matrix for statek_i **/
                 MTK::subblock (Pk_states, &_AugmentedState::statek_i) = Pk_i;
@@ -253,8 +264,7 @@ namespace localization
             void update(const _Measurement &z, _MeasurementModel h,
                         const Eigen::Matrix<ScalarType, ukfom::dof<_Measurement>::value, ukfom::dof<_Measurement>::value> &R)
             {
-                    typedef Eigen::Matrix<ScalarType, ukfom::dof<_Measurement>::value, ukfom::dof<_Measurement>::value> measurement_cov;
-                    update(z, h, boost::bind(ukfom::id<measurement_cov>, R), ukfom::accept_any_mahalanobis_distance<ScalarType>);
+                    update(z, h, constantCovariance(R), ukfom::accept_any_mahalanobis_distance<ScalarType>);
             }
 
             template<typename _Measurement, typename _MeasurementModel,
@@ -275,7 +285,7 @@ namespace localization
                     generateSigmaPoints(mu_state, mu_delta, Pk, X);
 
                     std::vector<Measurement> Z(X.size());
-                    std::transform(X.begin(), X.end(), Z.begin(), h);
+                    applyModel(h, X, Z);
 
                     const Measurement meanZ = meanSigmaPoints(Z);
 
@@ -525,6 +535,61 @@ namespace localization
                 return Pk;
             }
 
+            /**@brief Write mean, covariance and features layout to a binary checkpoint
+             */
+            bool saveCheckpoint(const std::string &filename) const
+            {
+                /** The checkpoint stores the state and covariance as double **/
+                BOOST_STATIC_ASSERT((boost::is_same<ScalarType, double>::value));
+
+                CheckpointHeader header;
+                header.filter = CheckpointHeader::USCKF;
+                header.single_dof = _SingleState::DOF;
+                header.features_k = mu_state.featuresk.size();
+                header.features_k_l = mu_state.featuresk_l.size();
+                header.state_size = mu_state.getDOF();
+                header.cov_rows = Pk.rows();
+                header.cov_cols = Pk.cols();
+
+                CheckpointFile file;
+                if (!file.create(filename, header))
+                    return false;
+
+                Eigen::Map<VectorizedAugmentedState> (file.stateData(), header.state_size) = mu_state.getVectorizedState();
+                Eigen::Map<AugmentedStateCovariance> (file.covarianceData(), header.cov_rows, header.cov_cols) = Pk;
+
+                return file.sync();
+            }
+
+            /**@brief Restore mean, covariance and features layout from a binary checkpoint
+             *
+             * The filter is left untouched when the checkpoint does not match
+             * this filter type.
+             */
+            bool loadCheckpoint(const std::string &filename)
+            {
+                BOOST_STATIC_ASSERT((boost::is_same<ScalarType, double>::value));
+
+                CheckpointFile file;
+                if (!file.open(filename))
+                    return false;
+
+                const CheckpointHeader &header(file.header());
+                if (header.filter != CheckpointHeader::USCKF || header.single_dof != _SingleState::DOF
+                        || header.state_size != _AugmentedState::DOF + header.features_k + header.features_k_l
+                        || header.cov_rows != header.state_size || header.cov_cols != header.state_size)
+                {
+                    std::cerr << "[USCKF] checkpoint " << filename << " does not match this filter" << std::endl;
+                    return false;
+                }
+
+                mu_state.set(Eigen::Map<const VectorizedAugmentedState> (file.stateData(), header.state_size),
+                        header.features_k, header.features_k_l);
+                Pk = Eigen::Map<const AugmentedStateCovariance> (file.covarianceData(), header.cov_rows, header.cov_cols);
+
+                return true;
+            }
+
     private:
 
             /**@brief Sigma Point Calculation for the complete Augmented State
@@ -584,13 +649,16 @@ namespace localization
                      std::cout<<"L*L^T:\n"<< L * L.transpose()<<"\n";*/
 
 
-                    X[0] = mu + delta;
+                    /** All the sigma points in one boxplus (batched orientations) **/
+                    typename _SingleState::vectorized_points_type deltas(int(DOF_SINGLE_STATE), X.size());
+                    deltas.col(0) = delta;
                     for (std::size_t i = 1, j = 0; j < DOF_SINGLE_STATE; ++j)
                     {
                             //std::cout << "L.col(" << j << "): " << L.getL().col(j).transpose() << std::endl;
-                            X[i++] = mu + (delta + L.col(j));
-                            X[i++] = mu + (delta - L.col(j));
+                            deltas.col(i++) = delta + L.col(j);
+                            deltas.col(i++) = delta - L.col(j);
                     }
+                    _SingleState::boxplusSigmaPoints(mu, deltas, X);
 
                     #ifdef USCKF_DEBUG_PRINTS
                     printSigmaPoints<SingleStateSigma>(X);
@@ -626,6 +694,31 @@ namespace localization
                     return reference;
             }
 
+            // manifold mean for single state, batched orientations
+            _SingleState meanSigmaPoints(const SingleStateSigma &X) const
+            {
+                    _SingleState reference = X[0];
+                    VectorizedSingleState mean_delta;
+                    typename _SingleState::vectorized_points_type deltas;
+                    const static std::size_t max_it = 10000;
+
+                    std::size_t i = 0;
+                    do {
+                            _SingleState::boxminusSigmaPoints(X, reference, deltas);
+                            mean_delta = deltas.rowwise().sum() / X.size();
+                            reference += mean_delta;
+                    } while (mean_delta.norm() > 1e-6
+                                     && ++i < max_it);
+
+                    if (i >= max_it)
+                    {
+                            std::cerr << "ERROR: meanSigmaPoints() did not converge. norm(mean_delta)=" << mean_delta.norm() << std::endl;
+                            assert(false);
+                    }
+
+                    return reference;
+            }
+
             // vector mean
             template<int _MeasurementRows>
             Eigen::Matrix<ScalarType, _MeasurementRows, 1>
@@ -669,6 +762,17 @@ namespace localization
                     return 0.5 * c;
             }
 
+            SingleStateCovariance covSigmaPoints(const _SingleState &mean, const SingleStateSigma &V) const
+            {
+                    typename _SingleState::vectorized_points_type d;
+                    _SingleState::boxminusSigmaPoints(V, mean, d);
+
+                    SingleStateCovariance c;
+                    c.noalias() = d * d.transpose();
+
+                    return 0.5 * c;
+            }
+
             Eigen::Matrix<ScalarType, Eigen::Dynamic, Eigen::Dynamic>
             covSigmaPoints(const Eigen::Matrix<ScalarType, Eigen::Dynamic, 1>  &mean,
                     const std::vector< Eigen::Matrix<ScalarType, Eigen::Dynamic, 1> > &V) const
@@ -751,7 +855,7 @@ namespace localization
                     generateSigmaPoints(statek_i, delta, Pk_i, X);
 
                     statek_i = meanSigmaPoints(X);
-                    Pk_i = covSigmaPoints<_SingleState::DOF>(statek_i, X);
+                    Pk_i = covSigmaPoints(statek_i, X);
             }
 
             // for debugging only
@@ -25,6 +25,9 @@
 #include <ukfom/traits/dof.hpp>
 #include <ukfom/util.hpp>
 
+/** Process and measurement model functors **/
+#include <localization/filters/Functors.hpp>
+
 // MTK's pose and orientation definition:
 #include <mtk/types/pose.hpp>
 #include <mtk/types/SOn.hpp>
@@ -140,7 +143,7 @@ namespace localization
             template<typename _ProcessModel>
             void predict(_ProcessModel f, const SingleStateCovariance &Q)
             {
-                predict(f, boost::bind(ukfom::id<SingleStateCovariance>, Q));
+                predict(f, constantCovariance(Q));
             }
 
             template<typename _ProcessModel, typename _ProcessNoiseCovariance>
@@ -170,7 +173,7 @@ namespace localization
                 /*****************************/
 
                 /** Apply the non-linear transformation of the process model **/
-                std::transform(X.begin(), X.end(), X.begin(), f);
+                applyModel(f, XCopy, X);
 
                 #ifdef USCKF_DEBUG_PRINTS
                 printSigmaPoints<SingleStateSigma>(X);
@@ -263,8 +266,7 @@ namespace localization
             void update(const _Measurement &z, _MeasurementModel h,
                         const Eigen::Matrix<ScalarType, ukfom::dof<_Measurement>::value, ukfom::dof<_Measurement>::value> &R)
             {
-                    typedef Eigen::Matrix<ScalarType, ukfom::dof<_Measurement>::value, ukfom::dof<_Measurement>::value> measurement_cov;
-                    update(z, h, boost::bind(ukfom::id<measurement_cov>, R), ukfom::accept_any_mahalanobis_distance<ScalarType>);
+                    update(z, h, constantCovariance(R), ukfom::accept_any_mahalanobis_distance<ScalarType>);
             }
 
             template<typename _Measurement, typename _MeasurementModel,
@@ -283,7 +285,7 @@ namespace localization
                     generateSigmaPoints(mu_error, Pk_error, X);
 
                     std::vector<Measurement> Z(X.size());
-                    std::transform(X.begin(), X.end(), Z.begin(), h);
+                    applyModel(h, X, Z);
 
                     const Measurement meanZ = meanSigmaPoints(Z);
                     const MeasurementCov S = covSigmaPoints<measurement_rows>(meanZ, Z) + R();
@@ -387,8 +389,7 @@ namespace localization
             void singleUpdate(const _Measurement &z, _MeasurementModel h,
                         const Eigen::Matrix<ScalarType, ukfom::dof<_Measurement>::value, ukfom::dof<_Measurement>::value> &R)
             {
-                    typedef Eigen::Matrix<ScalarType, ukfom::dof<_Measurement>::value, ukfom::dof<_Measurement>::value> measurement_cov;
-                    singleUpdate(z, h, boost::bind(ukfom::id<measurement_cov>, R));
+                    singleUpdate(z, h, constantCovariance(R));
             }
 
             /** @brief Single UKF Update of the state
@@ -415,7 +416,7 @@ namespace localization
                 generateSigmaPoints(errork_i, Pk, X);
 
                 std::vector<_Measurement> Z(X.size());
-                std::transform(X.begin(), X.end(), Z.begin(), h);
+                applyModel(h, X, Z);
 
                 /** Mean of the measurement model **/
                 const _Measurement meanZ = meanSigmaPoints(Z);
@@ -0,0 +1,168 @@
+#include "Checkpoint.hpp"
+
+#include <iostream> /** std::cerr */
+#include <cstring> /** std::memcpy */
+
+#include <fcntl.h> /** open */
+#include <unistd.h> /** close, ftruncate */
+#include <sys/mman.h> /** mmap, msync, munmap */
+#include <sys/stat.h> /** fstat */
+
+using namespace localization;
+
+const uint32_t CheckpointHeader::MAGIC;
+const uint32_t CheckpointHeader::VERSION;
+const uint32_t CheckpointHeader::ENDIAN_MARK;
+
+CheckpointHeader::CheckpointHeader()
+    : magic(MAGIC), version(VERSION), endian_mark(ENDIAN_MARK), scalar_size(sizeof(double)),
+    filter(0), single_dof(0), sensor_dof(0), number_sensors(0), features_k(0), features_k_l(0),
+    state_size(0), cov_rows(0), cov_cols(0)
+{
+}
+
+std::size_t CheckpointHeader::dataOffset()
+{
+    return ((sizeof(CheckpointHeader) + 63) / 64) * 64;
+}
+
+std::size_t CheckpointHeader::fileSize() const
+{
+    return dataOffset() + scalar_size * (static_cast<std::size_t>(state_size)
+            + static_cast<std::size_t>(cov_rows) * static_cast<std::size_t>(cov_cols));
+}
+
+bool CheckpointHeader::isValid() const
+{
+    return magic == MAGIC && version == VERSION && endian_mark == ENDIAN_MARK
+        && scalar_size == sizeof(double);
+}
+
+CheckpointFile::CheckpointFile()
+    : fd(-1), data(NULL), size(0), writable(false)
+{
+}
+
+CheckpointFile::~CheckpointFile()
+{
+    close();
+}
+
+bool CheckpointFile::create(const std::string &filename, const CheckpointHeader &header)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "[CHECKPOINT] cannot create " << filename << std::endl;
+        return false;
+    }
+
+    size = header.fileSize();
+    if (::ftruncate(fd, size) != 0)
+    {
+        std::cerr << "[CHECKPOINT] cannot resize " << filename << " to " << size << " bytes" << std::endl;
+        close();
+        return false;
+    }
+
+    data = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        data = NULL;
+        std::cerr << "[CHECKPOINT] cannot map " << filename << std::endl;
+        close();
+        return false;
+    }
+
+    writable = true;
+    std::memcpy(data, &header, sizeof(CheckpointHeader));
+
+    return true;
+}
+
+bool CheckpointFile::open(const std::string &filename)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "[CHECKPOINT] cannot open " << filename << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < CheckpointHeader::dataOffset())
+    {
+        std::cerr << "[CHECKPOINT] " << filename << " is not a checkpoint" << std::endl;
+        close();
+        return false;
+    }
+
+    size = st.st_size;
+    data = ::mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        data = NULL;
+        std::cerr << "[CHECKPOINT] cannot map " << filename << std::endl;
+        close();
+        return false;
+    }
+
+    if (!header().isValid() || header().fileSize() != size)
+    {
+        std::cerr << "[CHECKPOINT] " << filename << " has an invalid or incompatible header" << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool CheckpointFile::sync()
+{
+    if (!data || !writable)
+        return false;
+
+    return ::msync(data, size, MS_SYNC) == 0;
+}
+
+void CheckpointFile::close()
+{
+    if (data)
+        ::munmap(data, size);
+    if (fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    data = NULL;
+    size = 0;
+    writable = false;
+}
+
+const CheckpointHeader& CheckpointFile::header() const
+{
+    return *static_cast<const CheckpointHeader*>(data);
+}
+
+double* CheckpointFile::stateData()
+{
+    return reinterpret_cast<double*>(static_cast<char*>(data) + CheckpointHeader::dataOffset());
+}
+
+const double* CheckpointFile::stateData() const
+{
+    return reinterpret_cast<const double*>(static_cast<const char*>(data) + CheckpointHeader::dataOffset());
+}
+
+double* CheckpointFile::covarianceData()
+{
+    return stateData() + header().state_size;
+}
+
+const double* CheckpointFile::covarianceData() const
+{
+    return stateData() + header().state_size;
+}
@@ -0,0 +1,104 @@
+/**\file Checkpoint.hpp
+ * Header function file and defines
+ */
+
+#ifndef _CHECKPOINT_HPP_
+#define _CHECKPOINT_HPP_
+
+#include <string> /** std::string */
+#include <cstddef> /** std::size_t */
+#include <stdint.h> /** Fixed size integer types */
+
+namespace localization
+{
+    /** Header of a binary filter checkpoint
+     *
+     * The file is the header followed by the vectorized state (state_size
+     * doubles) and the covariance in column-major order (cov_rows x cov_cols
+     * doubles). The data starts at an offset multiple of 64 bytes. The
+     * scalar type is always double, the filters check it at compile time.
+     */
+    struct CheckpointHeader
+    {
+        enum FilterType
+        {
+            MSCKF = 1,
+            USCKF = 2
+        };
+
+        static const uint32_t MAGIC = 0x4b43434c; /** "LCCK" **/
+        static const uint32_t VERSION = 1;
+        static const uint32_t ENDIAN_MARK = 0x01020304;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t endian_mark;
+        uint32_t scalar_size; /** sizeof(double), guards against a foreign build **/
+        uint32_t filter; /** FilterType which wrote the checkpoint **/
+        uint32_t single_dof; /** DOF of the single (current) state **/
+        uint32_t sensor_dof; /** DOF of a window pose (MSCKF) **/
+        uint32_t number_sensors; /** Number of poses in the window (MSCKF) **/
+        uint32_t features_k; /** Size of features at k (USCKF) **/
+        uint32_t features_k_l; /** Size of features at k+l (USCKF) **/
+        uint32_t state_size; /** Size of the vectorized state **/
+        uint32_t cov_rows;
+        uint32_t cov_cols;
+
+        CheckpointHeader();
+
+        /** Offset in bytes of the state data in the file **/
+        static std::size_t dataOffset();
+
+        /** Size in bytes of the complete file **/
+        std::size_t fileSize() const;
+
+        /** True if magic, version, endianness and scalar size match this build **/
+        bool isValid() const;
+    };
+
+    /** Memory mapped checkpoint file
+     *
+     * create() maps a new file for writing, open() maps an existing file read
+     * only. The state and covariance are accessed in place, so restoring a
+     * filter is a copy of the mapped memory without any parsing.
+     */
+    class CheckpointFile
+    {
+    public:
+        CheckpointFile();
+        ~CheckpointFile();
+
+        /** Create (or truncate) filename with the size given by header and map it **/
+        bool create(const std::string &filename, const CheckpointHeader &header);
+
+        /** Map an existing checkpoint and validate its header **/
+        bool open(const std::string &filename);
+
+        /** Flush a file created with create() to disk **/
+        bool sync();
+
+        void close();
+
+        bool isOpen() const { return data != NULL; }
+
+        const CheckpointHeader& header() const;
+
+        double* stateData();
+        const double* stateData() const;
+
+        double* covarianceData();
+        const double* covarianceData() const;
+
+    private:
+        /** Not copyable **/
+        CheckpointFile(const CheckpointFile&);
+        CheckpointFile& operator=(const CheckpointFile&);
+
+        int fd;
+        void *data;
+        std::size_t size;
+        bool writable;
+    };
+}
+
+#endif
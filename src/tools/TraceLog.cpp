@@ -0,0 +1,312 @@
+#include "TraceLog.hpp"
+
+#include <iostream> /** std::cerr */
+#include <cstring> /** std::memcpy */
+#include <algorithm> /** std::max */
+
+#include <fcntl.h> /** open */
+#include <unistd.h> /** close, ftruncate */
+#include <sys/mman.h> /** mmap, munmap */
+#include <sys/stat.h> /** fstat */
+
+using namespace localization;
+
+const uint32_t TraceFileHeader::MAGIC;
+const uint32_t TraceFileHeader::VERSION;
+
+/** Number of ESTIMATION records written per StateEstimation **/
+static const uint32_t ESTIMATION_FIELDS = 21;
+
+TraceFileHeader::TraceFileHeader()
+    : magic(MAGIC), version(VERSION), used_size(sizeof(TraceFileHeader))
+{
+}
+
+TraceWriter::TraceWriter()
+    : fd(-1), data(NULL), capacity(0), used(0), grow(0)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool TraceWriter::open(const std::string &filename, const std::size_t grow_size)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "[TRACE_LOG] cannot create " << filename << std::endl;
+        return false;
+    }
+
+    grow = std::max(grow_size, sizeof(TraceFileHeader));
+    if (!reserve(sizeof(TraceFileHeader)))
+    {
+        close();
+        return false;
+    }
+
+    TraceFileHeader header;
+    std::memcpy(data, &header, sizeof(TraceFileHeader));
+    used = sizeof(TraceFileHeader);
+
+    return true;
+}
+
+void TraceWriter::close()
+{
+    if (data)
+    {
+        ::munmap(data, capacity);
+        if (::ftruncate(fd, used) != 0)
+            std::cerr << "[TRACE_LOG] cannot truncate the trace to " << used << " bytes" << std::endl;
+    }
+    if (fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    data = NULL;
+    capacity = 0;
+    used = 0;
+}
+
+bool TraceWriter::reserve(const std::size_t bytes)
+{
+    if (used + bytes <= capacity)
+        return true;
+
+    std::size_t new_capacity = capacity;
+    while (used + bytes > new_capacity)
+        new_capacity += grow;
+
+    if (data)
+        ::munmap(data, capacity);
+    data = NULL;
+
+    if (::ftruncate(fd, new_capacity) != 0)
+    {
+        std::cerr << "[TRACE_LOG] cannot grow the trace to " << new_capacity << " bytes" << std::endl;
+        return false;
+    }
+
+    void *map = ::mmap(NULL, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "[TRACE_LOG] cannot map the trace" << std::endl;
+        return false;
+    }
+
+    data = static_cast<char*>(map);
+    capacity = new_capacity;
+
+    return true;
+}
+
+double* TraceWriter::beginRecord(const TraceRecordHeader::RecordType type, const uint32_t channel, const base::Time &time,
+        const uint32_t rows, const uint32_t cols)
+{
+    if (!data)
+        return NULL;
+
+    const std::size_t payload = sizeof(double) * static_cast<std::size_t>(rows) * cols;
+    if (!reserve(sizeof(TraceRecordHeader) + payload))
+        return NULL;
+
+    TraceRecordHeader header;
+    header.type = type;
+    header.channel = channel;
+    header.time = time.toMicroseconds();
+    header.rows = rows;
+    header.cols = cols;
+
+    std::memcpy(data + used, &header, sizeof(TraceRecordHeader));
+
+    return reinterpret_cast<double*>(data + used + sizeof(TraceRecordHeader));
+}
+
+void TraceWriter::commitRecord(const uint32_t rows, const uint32_t cols)
+{
+    used += sizeof(TraceRecordHeader) + sizeof(double) * static_cast<std::size_t>(rows) * cols;
+
+    /** Publish the record once it is complete **/
+    reinterpret_cast<TraceFileHeader*>(data)->used_size = used;
+}
+
+bool TraceWriter::append(const TraceRecordHeader::RecordType type, const uint32_t channel, const base::Time &time,
+        const double *values, const uint32_t rows, const uint32_t cols)
+{
+    double *record = beginRecord(type, channel, time, rows, cols);
+    if (!record)
+        return false;
+
+    std::memcpy(record, values, sizeof(double) * static_cast<std::size_t>(rows) * cols);
+    commitRecord(rows, cols);
+
+    return true;
+}
+
+bool TraceWriter::estimation(const StateEstimation &estimation)
+{
+    const TraceRecordHeader::RecordType type = TraceRecordHeader::ESTIMATION;
+    const base::Time &time = estimation.time;
+    const Eigen::Matrix<double, 1, 1> mahalanobis(estimation.mahalanobis);
+    uint32_t field = 0;
+
+    return append(type, field++, time, estimation.statek_i)
+        && append(type, field++, time, estimation.errork_i)
+        && append(type, field++, time, estimation.orientation.coeffs())
+        && append(type, field++, time, estimation.Pki)
+        && append(type, field++, time, estimation.K)
+        && append(type, field++, time, estimation.Qk)
+        && append(type, field++, time, estimation.Rk)
+        && append(type, field++, time, estimation.innovation)
+        && append(type, field++, time, estimation.Hellinger)
+        && append(type, field++, time, estimation.Threshold)
+        && append(type, field++, time, mahalanobis)
+        && append(type, field++, time, estimation.abias)
+        && append(type, field++, time, estimation.gbias)
+        && append(type, field++, time, estimation.accModel)
+        && append(type, field++, time, estimation.accModelCov)
+        && append(type, field++, time, estimation.accInertial)
+        && append(type, field++, time, estimation.accInertialCov)
+        && append(type, field++, time, estimation.accError)
+        && append(type, field++, time, estimation.accErrorCov)
+        && append(type, field++, time, estimation.deltaVeloCommon)
+        && append(type, field++, time, estimation.deltaVeloCommonCov);
+}
+
+TraceReader::TraceReader()
+    : fd(-1), data(NULL), mapped(0), size(0), offset(0)
+{
+}
+
+TraceReader::~TraceReader()
+{
+    close();
+}
+
+bool TraceReader::open(const std::string &filename)
+{
+    close();
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "[TRACE_LOG] cannot open " << filename << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(TraceFileHeader))
+    {
+        std::cerr << "[TRACE_LOG] " << filename << " is not a trace" << std::endl;
+        close();
+        return false;
+    }
+
+    void *map = ::mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "[TRACE_LOG] cannot map " << filename << std::endl;
+        close();
+        return false;
+    }
+
+    data = static_cast<const char*>(map);
+    mapped = size = st.st_size;
+
+    const TraceFileHeader *header = reinterpret_cast<const TraceFileHeader*>(data);
+    if (header->magic != TraceFileHeader::MAGIC || header->version != TraceFileHeader::VERSION
+            || header->used_size > size)
+    {
+        std::cerr << "[TRACE_LOG] " << filename << " has an invalid or incompatible header" << std::endl;
+        close();
+        return false;
+    }
+
+    /** Only the complete records are read **/
+    size = header->used_size;
+    rewind();
+
+    return true;
+}
+
+void TraceReader::close()
+{
+    if (data)
+        ::munmap(const_cast<char*>(data), mapped);
+    if (fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    data = NULL;
+    mapped = 0;
+    size = 0;
+    offset = 0;
+}
+
+void TraceReader::rewind()
+{
+    offset = sizeof(TraceFileHeader);
+}
+
+bool TraceReader::next(TraceRecord &record)
+{
+    if (!data || offset + sizeof(TraceRecordHeader) > size)
+        return false;
+
+    record.header = reinterpret_cast<const TraceRecordHeader*>(data + offset);
+    const std::size_t payload = sizeof(double) * static_cast<std::size_t>(record.header->rows) * record.header->cols;
+    if (offset + sizeof(TraceRecordHeader) + payload > size)
+        return false;
+
+    record.data = reinterpret_cast<const double*>(data + offset + sizeof(TraceRecordHeader));
+    offset += sizeof(TraceRecordHeader) + payload;
+
+    return true;
+}
+
+bool TraceReader::estimation(const TraceRecord &first, StateEstimation &estimation)
+{
+    if (first.header->type != TraceRecordHeader::ESTIMATION || first.header->channel != 0)
+        return false;
+
+    TraceRecord fields[ESTIMATION_FIELDS];
+    fields[0] = first;
+    for (uint32_t i = 1; i < ESTIMATION_FIELDS; ++i)
+    {
+        if (!next(fields[i]) || fields[i].header->type != TraceRecordHeader::ESTIMATION
+                || fields[i].header->channel != i)
+            return false;
+    }
+
+    uint32_t field = 0;
+    estimation.time = first.time();
+    estimation.statek_i = fields[field++].matrix();
+    estimation.errork_i = fields[field++].matrix();
+    estimation.orientation.coeffs() = fields[field++].matrix();
+    estimation.Pki = fields[field++].matrix();
+    estimation.K = fields[field++].matrix();
+    estimation.Qk = fields[field++].matrix();
+    estimation.Rk = fields[field++].matrix();
+    estimation.innovation = fields[field++].matrix();
+    estimation.Hellinger = fields[field++].matrix();
+    estimation.Threshold = fields[field++].matrix();
+    estimation.mahalanobis = fields[field++].data[0];
+    estimation.abias = fields[field++].matrix();
+    estimation.gbias = fields[field++].matrix();
+    estimation.accModel = fields[field++].matrix();
+    estimation.accModelCov = fields[field++].matrix();
+    estimation.accInertial = fields[field++].matrix();
+    estimation.accInertialCov = fields[field++].matrix();
+    estimation.accError = fields[field++].matrix();
+    estimation.accErrorCov = fields[field++].matrix();
+    estimation.deltaVeloCommon = fields[field++].matrix();
+    estimation.deltaVeloCommonCov = fields[field++].matrix();
+
+    return true;
+}
@@ -0,0 +1,190 @@
+/**\file TraceLog.hpp
+ * Header function file and defines
+ */
+
+#ifndef _TRACE_LOG_HPP_
+#define _TRACE_LOG_HPP_
+
+#include <string> /** std::string */
+#include <cstddef> /** std::size_t */
+#include <stdint.h> /** Fixed size integer types */
+
+#include <Eigen/Core> /** Core methods of Eigen implementation **/
+
+#include <base/Time.hpp> /** For the timestamp **/
+
+#include <localization/core/Types.hpp> /** StateEstimation **/
+
+namespace localization
+{
+    /** Header of the trace file
+     *
+     * used_size is updated after every complete record, so a trace whose
+     * writer was killed is still readable up to the last complete record.
+     */
+    struct TraceFileHeader
+    {
+        static const uint32_t MAGIC = 0x524c434c; /** "LCLR" **/
+        static const uint32_t VERSION = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        uint64_t used_size; /** Bytes in use, including this header **/
+
+        TraceFileHeader();
+    };
+
+    /** Header of one record, followed by rows x cols doubles (column-major)
+     */
+    struct TraceRecordHeader
+    {
+        enum RecordType
+        {
+            PROCESS_INPUT = 1,
+            PROCESS_NOISE = 2,
+            MEASUREMENT = 3,
+            MEASUREMENT_NOISE = 4,
+            ESTIMATION = 5
+        };
+
+        uint32_t type; /** RecordType **/
+        uint32_t channel; /** User defined input or sensor id, field index for ESTIMATION **/
+        int64_t time; /** Timestamp in microseconds **/
+        uint32_t rows;
+        uint32_t cols;
+    };
+
+    /** A record of a mapped trace, valid while the TraceReader is open
+     */
+    struct TraceRecord
+    {
+        typedef Eigen::Map<const Eigen::MatrixXd> ConstMatrixMap;
+
+        const TraceRecordHeader *header;
+        const double *data;
+
+        base::Time time() const { return base::Time::fromMicroseconds(header->time); }
+        ConstMatrixMap matrix() const { return ConstMatrixMap(data, header->rows, header->cols); }
+    };
+
+    /** Append-only memory mapped trace writer
+     *
+     * The file grows in chunks of grow_size bytes and is truncated to the used
+     * size on close(). A writer is not thread safe, use one writer per thread.
+     */
+    class TraceWriter
+    {
+    public:
+        TraceWriter();
+        ~TraceWriter();
+
+        bool open(const std::string &filename, const std::size_t grow_size = 4*1024*1024);
+
+        void close();
+
+        bool isOpen() const { return data != NULL; }
+
+        /** Append a raw record **/
+        bool append(const TraceRecordHeader::RecordType type, const uint32_t channel, const base::Time &time,
+                const double *values, const uint32_t rows, const uint32_t cols);
+
+        /** Append an Eigen expression, evaluated straight into the mapped trace **/
+        template <typename _Derived>
+        bool append(const TraceRecordHeader::RecordType type, const uint32_t channel, const base::Time &time,
+                const Eigen::MatrixBase<_Derived> &matrix)
+        {
+            const uint32_t rows = matrix.rows(), cols = matrix.cols();
+            double *values = beginRecord(type, channel, time, rows, cols);
+            if (!values)
+                return false;
+
+            Eigen::Map<Eigen::MatrixXd> (values, rows, cols) = matrix;
+            commitRecord(rows, cols);
+            return true;
+        }
+
+        /** Process input and noise of one prediction **/
+        template <typename _Input, typename _Noise>
+        bool predict(const uint32_t channel, const base::Time &time,
+                const Eigen::MatrixBase<_Input> &u, const Eigen::MatrixBase<_Noise> &Q)
+        {
+            return append(TraceRecordHeader::PROCESS_INPUT, channel, time, u)
+                && append(TraceRecordHeader::PROCESS_NOISE, channel, time, Q);
+        }
+
+        /** Measurement and noise of one update **/
+        template <typename _Measurement, typename _Noise>
+        bool update(const uint32_t channel, const base::Time &time,
+                const Eigen::MatrixBase<_Measurement> &z, const Eigen::MatrixBase<_Noise> &R)
+        {
+            return append(TraceRecordHeader::MEASUREMENT, channel, time, z)
+                && append(TraceRecordHeader::MEASUREMENT_NOISE, channel, time, R);
+        }
+
+        /** Filter output, one ESTIMATION record per field of StateEstimation **/
+        bool estimation(const StateEstimation &estimation);
+
+        /** Bytes written so far **/
+        std::size_t size() const { return used; }
+
+    private:
+        /** Not copyable **/
+        TraceWriter(const TraceWriter&);
+        TraceWriter& operator=(const TraceWriter&);
+
+        bool reserve(const std::size_t bytes);
+
+        /** Reserve and write the header of a record, returns where its
+         * rows x cols values go or NULL on failure **/
+        double* beginRecord(const TraceRecordHeader::RecordType type, const uint32_t channel, const base::Time &time,
+                const uint32_t rows, const uint32_t cols);
+
+        /** Publish the record started by beginRecord() **/
+        void commitRecord(const uint32_t rows, const uint32_t cols);
+
+        int fd;
+        char *data;
+        std::size_t capacity;
+        std::size_t used;
+        std::size_t grow;
+    };
+
+    /** Read only memory mapped trace
+     *
+     * Several readers (threads or processes) can map the same trace.
+     */
+    class TraceReader
+    {
+    public:
+        TraceReader();
+        ~TraceReader();
+
+        bool open(const std::string &filename);
+
+        void close();
+
+        bool isOpen() const { return data != NULL; }
+
+        /** Go back to the first record **/
+        void rewind();
+
+        /** Next record, false at the end of the trace **/
+        bool next(TraceRecord &record);
+
+        /** Read the ESTIMATION fields following the first field record **/
+        bool estimation(const TraceRecord &first, StateEstimation &estimation);
+
+    private:
+        /** Not copyable **/
+        TraceReader(const TraceReader&);
+        TraceReader& operator=(const TraceReader&);
+
+        int fd;
+        const char *data;
+        std::size_t mapped; /** Size of the mapping **/
+        std::size_t size; /** Size of the complete records **/
+        std::size_t offset;
+    };
+}
+
+#endif
@@ -0,0 +1,151 @@
+/**\file TraceReplay.hpp
+ * Header function file and defines
+ */
+
+#ifndef _TRACE_REPLAY_HPP_
+#define _TRACE_REPLAY_HPP_
+
+#include <iostream> /** std::cerr */
+#include <string> /** std::string */
+#include <vector> /** std::vector */
+#include <algorithm> /** std::min */
+#include <cassert> /** Assert */
+
+/** Boost **/
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/bind.hpp>
+
+#include <localization/tools/TraceLog.hpp>
+
+namespace localization
+{
+    /**@brief Stream a trace back through a filter
+     *
+     * The handler is the glue between the recorded inputs and the filter
+     * (Msckf, Usckf, ...). It owns the filter and builds its process and
+     * measurement models from the recorded values:
+     *
+     *  void predict(const uint32_t channel, const base::Time &time,
+     *          const TraceRecord::ConstMatrixMap &u, const TraceRecord::ConstMatrixMap &Q);
+     *  void update(const uint32_t channel, const base::Time &time,
+     *          const TraceRecord::ConstMatrixMap &z, const TraceRecord::ConstMatrixMap &R);
+     *  void estimation(const StateEstimation &reference);
+     *
+     * The maps point into the mapped trace, nothing is copied.
+     *
+     * @return number of replayed predictions and updates, -1 if the trace
+     * cannot be opened.
+     */
+    template <typename _Handler>
+    int replayTrace(const std::string &filename, _Handler &handler)
+    {
+        TraceReader reader;
+        if (!reader.open(filename))
+            return -1;
+
+        int number_steps = 0;
+        TraceRecord record, noise;
+        StateEstimation reference;
+
+        while (reader.next(record))
+        {
+            switch (record.header->type)
+            {
+            case TraceRecordHeader::PROCESS_INPUT:
+                if (!reader.next(noise) || noise.header->type != TraceRecordHeader::PROCESS_NOISE
+                        || noise.header->channel != record.header->channel)
+                {
+                    std::cerr << "[TRACE_REPLAY] process input without noise in " << filename << std::endl;
+                    return number_steps;
+                }
+                handler.predict(record.header->channel, record.time(), record.matrix(), noise.matrix());
+                number_steps++;
+                break;
+
+            case TraceRecordHeader::MEASUREMENT:
+                if (!reader.next(noise) || noise.header->type != TraceRecordHeader::MEASUREMENT_NOISE
+                        || noise.header->channel != record.header->channel)
+                {
+                    std::cerr << "[TRACE_REPLAY] measurement without noise in " << filename << std::endl;
+                    return number_steps;
+                }
+                handler.update(record.header->channel, record.time(), record.matrix(), noise.matrix());
+                number_steps++;
+                break;
+
+            case TraceRecordHeader::ESTIMATION:
+                if (!reader.estimation(record, reference))
+                {
+                    std::cerr << "[TRACE_REPLAY] incomplete estimation in " << filename << std::endl;
+                    return number_steps;
+                }
+                handler.estimation(reference);
+                break;
+
+            default:
+                std::cerr << "[TRACE_REPLAY] unknown record type " << record.header->type << " in " << filename << std::endl;
+                return number_steps;
+            }
+        }
+
+        return number_steps;
+    }
+
+    namespace detail
+    {
+        /** Worker of replayTraces, takes the next trace until all are done **/
+        template <typename _Handler>
+        void replayWorker(const std::vector<std::string> *filenames, std::vector<_Handler> *handlers,
+                std::vector<int> *results, std::size_t *next_trace, boost::mutex *mutex)
+        {
+            while (true)
+            {
+                std::size_t idx;
+                {
+                    boost::mutex::scoped_lock lock(*mutex);
+                    if (*next_trace >= filenames->size())
+                        return;
+                    idx = (*next_trace)++;
+                }
+
+                (*results)[idx] = replayTrace((*filenames)[idx], (*handlers)[idx]);
+            }
+        }
+    }
+
+    /**@brief Replay several traces in parallel, one handler (filter) per trace
+     *
+     * The traces are independent, each one is mapped read only by its own
+     * reader. Traces can also be replayed by separate processes.
+     *
+     * @param number_threads worker threads, 0 uses the number of cores
+     * @return result of replayTrace for each trace
+     */
+    template <typename _Handler>
+    std::vector<int> replayTraces(const std::vector<std::string> &filenames, std::vector<_Handler> &handlers,
+            unsigned int number_threads = 0)
+    {
+        assert(filenames.size() == handlers.size());
+
+        std::vector<int> results(filenames.size(), -1);
+        std::size_t next_trace = 0;
+        boost::mutex mutex;
+
+        if (number_threads == 0)
+            number_threads = std::max(boost::thread::hardware_concurrency(), 1u);
+        number_threads = std::min(number_threads, static_cast<unsigned int>(filenames.size()));
+
+        boost::thread_group workers;
+        for (unsigned int i = 0; i < number_threads; ++i)
+        {
+            workers.create_thread(boost::bind(&detail::replayWorker<_Handler>,
+                        &filenames, &handlers, &results, &next_trace, &mutex));
+        }
+        workers.join_all();
+
+        return results;
+    }
+}
+
+#endif
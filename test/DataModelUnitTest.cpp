@@ -4,6 +4,7 @@
 /** Library **/
 #include <localization/Configuration.hpp> /** Constant values of the library */
 #include <localization/core/DataModel.hpp> /** Data Model using Gaussian pdf **/
+#include <localization/core/DataModelBatch.hpp> /** Data Models in structure of arrays **/
 
 /** Eigen **/
 #include <Eigen/Core> /** Core */
@@ -165,3 +166,256 @@ BOOST_AUTO_TEST_CASE( PERMUTATIONS )
 	std::cout<<"\n";
 
 }
+
+BOOST_AUTO_TEST_CASE( DATAMODEL_FUSION )
+{
+	typedef localization::DataModel<double, localization::NUMAXIS> Model;
+	localization::DataModelFusion<double, localization::NUMAXIS> fusion;
+	Model pairwise, fused;
+
+	/** One estimate per wheel, the same as the pairwise fusion **/
+	for (unsigned int i = 0; i < localization::NUMBER_OF_WHEELS; ++i)
+	{
+	    Eigen::Matrix3d A = Eigen::Matrix3d::Random();
+	    Model wheel;
+	    wheel.data = Eigen::Vector3d::Random();
+	    wheel.Cov = A * A.transpose() + 0.1 * Eigen::Matrix3d::Identity();
+
+	    if (i == 0)
+		pairwise = wheel;
+	    else
+		pairwise.fusion(wheel);
+
+	    BOOST_CHECK(fusion.add(wheel));
+	}
+
+	BOOST_CHECK(fusion.result(fused));
+	BOOST_CHECK(fused.data.isApprox(pairwise.data, 1e-10));
+	BOOST_CHECK(fused.Cov.isApprox(pairwise.Cov, 1e-10));
+
+	std::cout<<"*** INFORMATION FUSION *** \n";
+	std::cout<<"fusion of the wheels: "<<fused<<"\n";
+
+	/** Not positive definite input is rejected **/
+	Model wrong;
+	wrong.Cov = -Eigen::Matrix3d::Identity();
+	BOOST_CHECK(!fusion.add(wrong));
+
+	/** Indefinite with a positive determinant and diagonal **/
+	wrong.Cov << 1.0, 2.0, 2.0,
+		  2.0, 1.0, 2.0,
+		  2.0, 2.0, 1.0;
+	BOOST_CHECK_GT(wrong.Cov.determinant(), 0.0);
+	BOOST_CHECK(!fusion.add(wrong));
+	BOOST_CHECK_EQUAL(fusion.size(), localization::NUMBER_OF_WHEELS);
+
+	fusion.reset();
+	BOOST_CHECK(!fusion.result(fused));
+
+	/** Small variances, as for the slip of a wheel **/
+	for (unsigned int i = 0; i < localization::NUMBER_OF_WHEELS; ++i)
+	{
+	    Eigen::Matrix3d A = Eigen::Matrix3d::Random();
+	    Model wheel;
+	    wheel.data = 1e-03 * Eigen::Vector3d::Random();
+	    wheel.Cov = 1e-06 * A * A.transpose() + 1e-05 * Eigen::Matrix3d::Identity();
+
+	    if (i == 0)
+		pairwise = wheel;
+	    else
+		pairwise.fusion(wheel);
+
+	    BOOST_CHECK(fusion.add(wheel));
+	}
+	BOOST_CHECK(fusion.result(fused));
+	BOOST_CHECK(fused.data.isApprox(pairwise.data, 1e-10));
+	BOOST_CHECK(fused.Cov.isApprox(pairwise.Cov, 1e-10));
+
+	localization::DataModelFusion<float, localization::NUMAXIS> floatFusion;
+	localization::DataModel<float, localization::NUMAXIS> floatWheel, floatFused;
+	floatWheel.data = Eigen::Vector3f::Random();
+	floatWheel.Cov = 0.01f * Eigen::Matrix3f::Identity();
+	BOOST_CHECK(floatFusion.add(floatWheel));
+	BOOST_CHECK(floatFusion.add(floatWheel));
+	BOOST_CHECK(floatFusion.result(floatFused));
+	BOOST_CHECK(floatFused.Cov.isApprox(0.005f * Eigen::Matrix3f::Identity(), 1e-05f));
+
+	/** Whole slip vector, through the Cholesky factorization **/
+	typedef localization::DataModel<double, localization::SLIP_VECTOR_SIZE> SlipModel;
+	typedef Eigen::Matrix<double, localization::SLIP_VECTOR_SIZE, localization::SLIP_VECTOR_SIZE> SlipMatrix;
+	localization::DataModelFusion<double, localization::SLIP_VECTOR_SIZE> slipFusion;
+	SlipModel slipPairwise, slipFused;
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+	    SlipMatrix A = SlipMatrix::Random();
+	    SlipModel slip;
+	    slip.data.setRandom();
+	    slip.Cov = A * A.transpose() + 0.1 * SlipMatrix::Identity();
+
+	    if (i == 0)
+		slipPairwise = slip;
+	    else
+		slipPairwise.fusion(slip);
+
+	    BOOST_CHECK(slipFusion.add(slip));
+	}
+	BOOST_CHECK(slipFusion.result(slipFused));
+	BOOST_CHECK(slipFused.data.isApprox(slipPairwise.data, 1e-08));
+	BOOST_CHECK(slipFused.Cov.isApprox(slipPairwise.Cov, 1e-08));
+}
+
+BOOST_AUTO_TEST_CASE( DATAMODEL_SAFE_FUSION )
+{
+	typedef localization::DataModel<double, localization::NUMAXIS> Model;
+	Model data1, data2, data3;
+
+	/** Uncorrelated axes: the smaller variance of each axis **/
+	data1.data << 1.0, 2.0, 3.0;
+	data2.data << 4.0, 5.0, 6.0;
+	data1.Cov = Eigen::Vector3d(1.0, 4.0, 2.0).asDiagonal();
+	data2.Cov = Eigen::Vector3d(4.0, 1.0, 3.0).asDiagonal();
+	data3 = data1;
+	data3.safeFusion(data2);
+	BOOST_CHECK(data3.data.isApprox(Eigen::Vector3d(1.0, 5.0, 3.0), 1e-12));
+	BOOST_CHECK(data3.Cov.isApprox(Eigen::Matrix3d(Eigen::Vector3d(1.0, 1.0, 2.0).asDiagonal()), 1e-12));
+
+	for (register int k = 0; k < 100; ++k)
+	{
+	    Eigen::Matrix3d A = Eigen::Matrix3d::Random(), B = Eigen::Matrix3d::Random();
+	    data1.data.setRandom();
+	    data2.data.setRandom();
+	    data1.Cov = A * A.transpose() + 0.01 * Eigen::Matrix3d::Identity();
+	    data2.Cov = B * B.transpose() + 0.01 * Eigen::Matrix3d::Identity();
+
+	    /** The fused covariance is bounded by both inputs **/
+	    data3 = data1;
+	    data3.safeFusion(data2);
+	    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> bound1(data3.Cov - data1.Cov), bound2(data3.Cov - data2.Cov);
+	    BOOST_CHECK(bound1.eigenvalues().maxCoeff() < 1e-12);
+	    BOOST_CHECK(bound2.eigenvalues().maxCoeff() < 1e-12);
+
+	    /** A more certain estimate in every direction is taken as it is **/
+	    data2.Cov = 0.5 * data1.Cov;
+	    data3 = data1;
+	    data3.safeFusion(data2);
+	    BOOST_CHECK(data3.data.isApprox(data2.data, 1e-10));
+	    BOOST_CHECK(data3.Cov.isApprox(data2.Cov, 1e-10));
+	}
+}
+
+BOOST_AUTO_TEST_CASE( DATAMODEL_BATCH )
+{
+	typedef localization::DataModel<double, localization::NUMAXIS> Model;
+	typedef localization::DataModelBatch<double, localization::NUMAXIS, localization::NUMBER_OF_WHEELS> Batch;
+	Batch batch1, batch2;
+	Model wheels1[localization::NUMBER_OF_WHEELS], wheels2[localization::NUMBER_OF_WHEELS];
+
+	for (unsigned int i = 0; i < localization::NUMBER_OF_WHEELS; ++i)
+	{
+	    Eigen::Matrix3d A = Eigen::Matrix3d::Random(), B = Eigen::Matrix3d::Random();
+	    wheels1[i].data.setRandom();
+	    wheels2[i].data.setRandom();
+	    wheels1[i].Cov = A * A.transpose() + 0.01 * Eigen::Matrix3d::Identity();
+	    wheels2[i].Cov = B * B.transpose() + 0.01 * Eigen::Matrix3d::Identity();
+	    batch1.set(i, wheels1[i]);
+	    batch2.set(i, wheels2[i]);
+	}
+
+	/** Same as DataModel on every wheel **/
+	Batch sum = batch1 + batch2, difference = batch1 - batch2;
+	Batch fused = batch1, safe = batch1;
+	BOOST_CHECK(fused.fusion(batch2));
+	BOOST_CHECK(safe.safeFusion(batch2));
+	for (unsigned int i = 0; i < localization::NUMBER_OF_WHEELS; ++i)
+	{
+	    Model expected = wheels1[i] + wheels2[i];
+	    BOOST_CHECK(sum.get(i).data.isApprox(expected.data, 1e-12));
+	    BOOST_CHECK(sum.get(i).Cov.isApprox(expected.Cov, 1e-12));
+
+	    expected = wheels1[i] - wheels2[i];
+	    BOOST_CHECK(difference.get(i).data.isApprox(expected.data, 1e-12));
+	    BOOST_CHECK(difference.get(i).Cov.isApprox(expected.Cov, 1e-12));
+
+	    expected = wheels1[i];
+	    expected.fusion(wheels2[i]);
+	    BOOST_CHECK(fused.get(i).data.isApprox(expected.data, 1e-10));
+	    BOOST_CHECK(fused.get(i).Cov.isApprox(expected.Cov, 1e-10));
+
+	    expected = wheels1[i];
+	    expected.safeFusion(wheels2[i]);
+	    BOOST_CHECK(safe.get(i).data.isApprox(expected.data, 1e-10));
+	    BOOST_CHECK(safe.get(i).Cov.isApprox(expected.Cov, 1e-10));
+	}
+
+	/** A wheel without valid covariance is left unchanged **/
+	Model wrong;
+	wrong.Cov = -Eigen::Matrix3d::Identity();
+	Batch partial = batch1;
+	partial.set(1, wrong);
+	BOOST_CHECK(!partial.safeFusion(batch2));
+	BOOST_CHECK(partial.get(1).data.isApprox(wrong.data));
+	BOOST_CHECK(partial.get(1).Cov.isApprox(wrong.Cov));
+	BOOST_CHECK(partial.get(0).Cov.isApprox(safe.get(0).Cov, 1e-12));
+}
+
+BOOST_AUTO_TEST_CASE( DATAMODEL_COVARIANCE_INTERSECTION )
+{
+	typedef localization::DataModel<double, localization::NUMAXIS> Model;
+	Model data1, data2, data3;
+
+	for (register int k = 0; k < 100; ++k)
+	{
+	    Eigen::Matrix3d A = Eigen::Matrix3d::Random(), B = Eigen::Matrix3d::Random();
+	    data1.data.setRandom();
+	    data2.data.setRandom();
+	    data1.Cov = A * A.transpose() + 0.01 * Eigen::Matrix3d::Identity();
+	    data2.Cov = B * B.transpose() + 0.01 * Eigen::Matrix3d::Identity();
+
+	    for (register int c = 0; c < 2; ++c)
+	    {
+		const localization::IntersectionCriterion criterion = c? localization::MINIMUM_TRACE : localization::MINIMUM_DETERMINANT;
+		double omega;
+		data3 = data1;
+		BOOST_CHECK(data3.covarianceIntersection(data2, omega, criterion));
+		BOOST_CHECK(omega >= 0.0 && omega <= 1.0);
+
+		/** Same as the intersection in information form with that weight **/
+		Eigen::Matrix3d information = omega * data1.Cov.inverse() + (1.0 - omega) * data2.Cov.inverse();
+		Eigen::Matrix3d cov = information.inverse();
+		Eigen::Vector3d data = cov * (omega * data1.Cov.inverse() * data1.data + (1.0 - omega) * data2.Cov.inverse() * data2.data);
+		BOOST_CHECK(data3.Cov.isApprox(cov, 1e-09));
+		BOOST_CHECK((data3.data - data).norm() < 1e-09 * (1.0 + data.norm()));
+
+		/** No better weight around **/
+		const double value = c? data3.Cov.trace() : data3.Cov.determinant();
+		for (register int w = 0; w <= 100; ++w)
+		{
+		    information = 0.01 * w * data1.Cov.inverse() + (1.0 - 0.01 * w) * data2.Cov.inverse();
+		    cov = information.inverse();
+		    BOOST_CHECK(value <= (c? cov.trace() : cov.determinant()) * (1.0 + 1e-09));
+		}
+	    }
+	}
+
+	/** Intersection of the wheels, never worse than any of them **/
+	std::vector< Model, Eigen::aligned_allocator<Model> > wheels(localization::NUMBER_OF_WHEELS);
+	double determinant = 1e+30;
+	for (unsigned int i = 0; i < wheels.size(); ++i)
+	{
+	    Eigen::Matrix3d A = Eigen::Matrix3d::Random();
+	    wheels[i].data.setRandom();
+	    wheels[i].Cov = A * A.transpose() + 0.01 * Eigen::Matrix3d::Identity();
+	    determinant = std::min(determinant, wheels[i].Cov.determinant());
+	}
+	BOOST_CHECK(Model::covarianceIntersection(wheels, data3));
+	BOOST_CHECK(data3.Cov.determinant() <= determinant * (1.0 + 1e-09));
+
+	data1 = wheels[0];
+	for (unsigned int i = 1; i < wheels.size(); ++i)
+	    data1.covarianceIntersection(wheels[i]);
+	BOOST_CHECK(data3.data.isApprox(data1.data));
+	BOOST_CHECK(data3.Cov.isApprox(data1.Cov));
+
+	std::cout<<"*** COVARIANCE INTERSECTION *** \n";
+	std::cout<<"intersection of the wheels: "<<data3<<"\n";
+}
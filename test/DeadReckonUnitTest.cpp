@@ -0,0 +1,387 @@
+#define BOOST_TEST_MODULE template_for_test_test
+#include <boost/test/included/unit_test.hpp>
+
+/** Library **/
+#include <localization/core/DeadReckon.hpp> /** Dead reckoning and odometry preintegration */
+#include <localization/core/ImuIntegrator.hpp> /** Coning and sculling compensated imu increments */
+#include <localization/core/DeadReckonService.hpp> /** Dead reckoning thread */
+#include <localization/core/DeadReckonBatch.hpp> /** Dead reckoning of many trajectories */
+#include <localization/core/TransformBatch.hpp> /** Structure of arrays of transforms */
+
+/** Eigen **/
+#include <Eigen/Core> /** Core */
+#include <Eigen/StdVector> /** For STL container with Eigen types **/
+
+/** Boost **/
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Standard libs **/
+#include <iostream>
+#include <vector>
+
+typedef Eigen::Matrix<double, 6, 6> Covariance;
+
+localization::TransformWithUncertainty randomTransform(const double angle)
+{
+    Covariance A = Covariance::Random();
+    Eigen::Affine3d trans(Eigen::AngleAxisd(angle, Eigen::Vector3d::Random().normalized()));
+    trans.translation() = Eigen::Vector3d::Random();
+    return localization::TransformWithUncertainty(trans, 0.01 * A * A.transpose() + 1e-03 * Covariance::Identity());
+}
+
+BOOST_AUTO_TEST_CASE( ODOMETRY_PREINTEGRATION )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    typedef std::vector< Eigen::Matrix <double, 6, 1> , Eigen::aligned_allocator < Eigen::Matrix <double, 6, 1> > > Velocities;
+
+    TWU start = randomTransform(2.0);
+    Covariance velocity_cov = 1e-03 * Covariance::Identity();
+    Velocities velocities(2);
+    velocities[1] << 1.0, 0.1, 0.0, 0.2, -0.1, 0.3;
+
+    /** One delta against the composition of every step **/
+    localization::OdometryPreintegration preintegration;
+    TWU pose = start, pose_adjoint = start, post;
+    for (register int i=0; i<100; ++i)
+    {
+        velocities[0] = velocities[1] + 0.05 * Eigen::Matrix<double, 6, 1>::Random();
+        preintegration.integrate(0.01, velocities, velocity_cov);
+
+        TWU delta = localization::DeadReckon::updatePose(0.01, velocities, velocity_cov, pose, post);
+        pose = post;
+        pose_adjoint = pose_adjoint.composition(delta, TWU::ADJOINT);
+        velocities[1] = velocities[0];
+    }
+    BOOST_CHECK_EQUAL(preintegration.getNumberSamples(), 100);
+    BOOST_CHECK_CLOSE(preintegration.getDeltaTime(), 1.0, 1e-10);
+
+    TWU result = preintegration.apply(start);
+    BOOST_CHECK(result.getTransform().isApprox(pose.getTransform(), 1e-12));
+    BOOST_CHECK(result.getCovariance().isApprox(pose_adjoint.getCovariance(), 1e-12));
+
+    /** Re-applied to another start pose **/
+    TWU other = randomTransform(0.5);
+    BOOST_CHECK(preintegration.apply(other).getCovariance().isApprox(
+                other.composition(preintegration.getDeltaWithUncertainty(), TWU::ADJOINT).getCovariance(), 1e-12));
+
+    preintegration.reset();
+    BOOST_CHECK(preintegration.getDelta().isApprox(Eigen::Affine3d::Identity()));
+}
+
+BOOST_AUTO_TEST_CASE( DEAD_RECKON_FIXED_SIZE )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    typedef std::vector< Eigen::Matrix <double, 6, 1> , Eigen::aligned_allocator < Eigen::Matrix <double, 6, 1> > > Velocities;
+
+    Velocities velocities(2);
+    velocities[0] << 1.0, 0.1, 0.0, 0.2, -0.1, 0.3;
+    velocities[1] << 0.9, 0.2, 0.1, 0.1, -0.2, 0.4;
+    Covariance velocity_cov = 1e-03 * Covariance::Identity();
+
+    /** Both forms have to give the same attitude and pose **/
+    Eigen::Quaterniond q = localization::DeadReckon::updateAttitude(0.01, velocities[0].tail<3>(), velocities[1].tail<3>());
+    std::vector< Eigen::Vector3d, Eigen::aligned_allocator< Eigen::Vector3d > > angular(2);
+    angular[0] = velocities[0].tail<3>();
+    angular[1] = velocities[1].tail<3>();
+    BOOST_CHECK(q.coeffs() == localization::DeadReckon::updateAttitude(0.01, angular).coeffs());
+
+    TWU start = randomTransform(1.0), post_vector, post_fixed;
+    TWU delta = localization::DeadReckon::updatePose(0.01, velocities, velocity_cov, start, post_vector);
+    TWU delta_fixed = localization::DeadReckon::updatePose(0.01, velocities[0], velocities[1], velocity_cov, start, post_fixed);
+    BOOST_CHECK(delta.getTransform().matrix() == delta_fixed.getTransform().matrix());
+    BOOST_CHECK(post_vector.getCovariance() == post_fixed.getCovariance());
+
+    /** The delta covariance is the scaled velocity covariance **/
+    BOOST_CHECK(delta_fixed.getCovariance().isApprox(1e-04 * velocity_cov, 1e-12));
+}
+
+BOOST_AUTO_TEST_CASE( DEAD_RECKON_EXPONENTIAL )
+{
+    typedef localization::DeadReckon DR;
+    Eigen::Vector3d current(0.2, -0.1, 0.3), previous(0.1, -0.2, 0.4);
+
+    /** Same constant acceleration model as the series **/
+    Eigen::Quaterniond series = DR::updateAttitude(0.001, current, previous);
+    Eigen::Quaterniond exponential = DR::updateAttitude(0.001, current, previous,
+            Eigen::Matrix3d::Zero(), DR::QUATERNION_EXPONENTIAL);
+    BOOST_CHECK_SMALL(series.angularDistance(exponential), 1e-7);
+    BOOST_CHECK_CLOSE(exponential.norm(), 1.0, 1e-12);
+
+    /** Against a fine integration of the linearly varying rate over a larger
+     * step, where the coning term is well above the truncation error **/
+    const double dt = 0.1;
+    const Eigen::Vector3d before(2.0, 0.5, -1.0), after(-0.5, 2.0, 1.5);
+    Eigen::Quaterniond reference(Eigen::Quaterniond::Identity());
+    const int substeps = 10000;
+    for (register int i=0; i<substeps; ++i)
+    {
+        const double t = (i + 0.5) * dt / substeps;
+        Eigen::Vector3d rate = after + (after - before) * t / dt;
+        reference = reference * Eigen::Quaterniond(Eigen::AngleAxisd(rate.norm() * dt / substeps, rate.normalized()));
+    }
+    exponential = DR::updateAttitude(dt, after, before, Eigen::Matrix3d::Zero(), DR::QUATERNION_EXPONENTIAL);
+    Eigen::Vector3d integral = 1.5 * dt * after - 0.5 * dt * before;
+    Eigen::Quaterniond no_coning(Eigen::AngleAxisd(integral.norm(), integral.normalized()));
+    BOOST_CHECK_SMALL(reference.angularDistance(exponential), 2e-4);
+    BOOST_CHECK(reference.angularDistance(no_coning) > 10.0 * reference.angularDistance(exponential));
+
+    /** The batched form, with one step above the polynomial range **/
+    Eigen::Matrix<double, Eigen::Dynamic, 3> currents(Eigen::Matrix<double, Eigen::Dynamic, 3>::Random(9, 3));
+    Eigen::Matrix<double, Eigen::Dynamic, 3> previouses(Eigen::Matrix<double, Eigen::Dynamic, 3>::Random(9, 3));
+    currents.row(0).setZero();
+    previouses.row(0).setZero();
+    currents.row(1) << 200.0, 0.0, -100.0;
+    Eigen::Matrix<double, Eigen::Dynamic, 4> batch;
+    DR::updateAttitudeExponential(0.01, currents, previouses, batch);
+    BOOST_CHECK_EQUAL(batch.rows(), 9);
+    for (register int i=0; i<currents.rows(); ++i)
+    {
+        Eigen::Quaterniond q = DR::updateAttitudeExponential(0.01, Eigen::Vector3d(currents.row(i).transpose()),
+                Eigen::Vector3d(previouses.row(i).transpose()));
+        Eigen::Vector4d wxyz(q.w(), q.x(), q.y(), q.z());
+        BOOST_CHECK((wxyz - batch.row(i).transpose()).norm() < 1e-15);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( IMU_INTEGRATOR )
+{
+    localization::ImuIntegrator integrator(10, 16);
+    localization::ImuIncrement increment;
+    Eigen::Vector3d gyro(0.3, -0.2, 0.5), acc(1.0, 0.5, 9.81);
+
+    /** The first sample only starts the integration **/
+    for (register int i=0; i<=15; ++i)
+        BOOST_CHECK(integrator.push(base::Time::fromMicroseconds(1000 * i), gyro, acc));
+    BOOST_CHECK(!integrator.push(base::Time::fromMicroseconds(16000), gyro, acc));
+    BOOST_CHECK_EQUAL(integrator.getDropped(), 1u);
+
+    BOOST_CHECK(integrator.pop(increment));
+    BOOST_CHECK_EQUAL(increment.samples, 10);
+    BOOST_CHECK_EQUAL(increment.time.toMicroseconds(), 10000);
+    BOOST_CHECK_CLOSE(increment.delta_t, 0.01, 1e-9);
+
+    /** Constant rates: no coning and sculling, exact rotation **/
+    const double T = increment.delta_t, w = gyro.norm();
+    Eigen::Vector3d wa = gyro.cross(acc);
+    Eigen::Vector3d velocity = T * acc + (1.0 - cos(w * T)) / (w * w) * wa
+        + (T - sin(w * T) / w) / (w * w) * gyro.cross(wa);
+    BOOST_CHECK(increment.delta_angle.isApprox(gyro * T, 1e-12));
+    BOOST_CHECK((increment.delta_velocity - velocity).norm() < 1e-08);
+    BOOST_CHECK((T * acc - velocity).norm() > 1e-04);
+
+    /** The remaining samples are kept for the next step **/
+    BOOST_CHECK(!integrator.pop(increment));
+    for (register int i=16; i<=20; ++i)
+        BOOST_CHECK(integrator.push(base::Time::fromMicroseconds(1000 * i), gyro, acc));
+    BOOST_CHECK(integrator.pop(increment));
+    BOOST_CHECK_EQUAL(increment.time.toMicroseconds(), 20000);
+
+    integrator.reset();
+    BOOST_CHECK(!integrator.pop(increment));
+}
+
+typedef std::vector<localization::TransformWithUncertainty, Eigen::aligned_allocator<localization::TransformWithUncertainty> > PoseVector;
+
+/** Reads the pose of the service until done, counting the reads and the
+ * poses which differ from the expected one at their time **/
+void readDeadReckonPoses(const localization::DeadReckonService *service, const PoseVector *expected,
+        const boost::atomic<bool> *done, int *reads, int *torn)
+{
+    base::Time time;
+    localization::TransformWithUncertainty pose;
+    while (!done->load())
+    {
+        service->getPose(time, pose);
+        const size_t i = time.toMicroseconds() / 10000;
+        if (i >= expected->size() || !pose.getTransform().isApprox((*expected)[i].getTransform(), 1e-12)
+                || !pose.getCovariance().isApprox((*expected)[i].getCovariance(), 1e-12))
+            ++(*torn);
+        ++(*reads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( DEAD_RECKON_SERVICE )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    TWU start = randomTransform(1.0), pose = start, post;
+    localization::DeadReckonService service(8, start);
+
+    /** expected[i] is the pose after the sample i **/
+    std::vector<localization::OdometrySample, Eigen::aligned_allocator<localization::OdometrySample> > samples(200);
+    PoseVector expected(1, start);
+    for (register size_t i=0; i<samples.size(); ++i)
+    {
+        samples[i].time = base::Time::fromMicroseconds(10000 * i);
+        samples[i].velocity << 1.0, 0.1, 0.0, 0.05 * i, -0.1, 0.3;
+        samples[i].cov = 1e-03 * Covariance::Identity();
+        if (i > 0)
+        {
+            localization::DeadReckon::updatePose(0.01, samples[i].velocity, samples[i-1].velocity, samples[i].cov, pose, post);
+            pose = post;
+            expected.push_back(pose);
+        }
+    }
+
+    /** Bounded queue, integrated in the calling thread **/
+    for (register size_t i=0; i<8; ++i)
+        BOOST_CHECK(service.push(samples[i]));
+    BOOST_CHECK(!service.push(samples[8]));
+    BOOST_CHECK_EQUAL(service.process(), 8);
+    BOOST_CHECK_EQUAL(service.getNumberSamples(), 7);
+
+    /** Integration thread, with a reader which never sees a torn pose **/
+    boost::atomic<bool> done(false);
+    int reads = 0, torn = 0;
+    boost::thread reader(boost::bind(&readDeadReckonPoses, &service, &expected, &done, &reads, &torn));
+    BOOST_CHECK(service.start());
+    BOOST_CHECK(!service.start());
+    for (register size_t i=8; i<samples.size(); ++i)
+    {
+        while (!service.push(samples[i]))
+            boost::this_thread::yield();
+    }
+    service.stop();
+    BOOST_CHECK(!service.isRunning());
+    done.store(true);
+    reader.join();
+    BOOST_CHECK(reads > 0);
+    BOOST_CHECK_EQUAL(torn, 0);
+
+    base::Time time;
+    TWU result;
+    service.getPose(time, result);
+    BOOST_CHECK_EQUAL(service.getNumberSamples(), samples.size() - 1);
+    BOOST_CHECK_EQUAL(time.toMicroseconds(), samples.back().time.toMicroseconds());
+    BOOST_CHECK(result.getTransform().isApprox(pose.getTransform(), 1e-12));
+    BOOST_CHECK(result.getCovariance().isApprox(pose.getCovariance(), 1e-12));
+}
+
+BOOST_AUTO_TEST_CASE( DEAD_RECKON_BATCH )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    /** More than one chunk per thread **/
+    const int trajectories = 600, number_samples = 6;
+
+    std::vector<localization::VelocityBatch> velocities(number_samples, localization::VelocityBatch(trajectories));
+    Eigen::MatrixXd delta_t(Eigen::MatrixXd::Constant(trajectories, number_samples - 1, 0.01));
+    delta_t.col(2).setConstant(0.02);
+    for (register int k=0; k<number_samples; ++k)
+    {
+        for (register int i=0; i<trajectories; ++i)
+        {
+            Covariance A = Covariance::Random();
+            velocities[k].set(i, Eigen::Matrix<double, 6, 1>::Random(), 1e-03 * A * A.transpose());
+        }
+    }
+
+    localization::TransformBatch poses(trajectories);
+    std::vector<TWU, Eigen::aligned_allocator<TWU> > expected(trajectories);
+    for (register int i=0; i<trajectories; ++i)
+    {
+        expected[i] = randomTransform(0.3 * i);
+        poses.set(i, expected[i]);
+
+        TWU post;
+        for (register int k=0; k+1<number_samples; ++k)
+        {
+            Covariance cov = Eigen::Map<const Covariance>(velocities[k+1].cov.row(i).eval().data());
+            localization::DeadReckon::updatePose(delta_t(i, k), velocities[k+1].velocity.row(i).transpose(),
+                    velocities[k].velocity.row(i).transpose(), cov, expected[i], post);
+            expected[i] = post;
+        }
+    }
+
+    /** Split among threads, the same as one DeadReckon::updatePose per trajectory and step **/
+    localization::deadReckon(velocities, delta_t, poses, 2);
+    for (register int i=0; i<trajectories; ++i)
+    {
+        TWU result = poses.get(i);
+        BOOST_CHECK(result.getTransform().isApprox(expected[i].getTransform(), 1e-12));
+        BOOST_CHECK(result.getCovariance().isApprox(expected[i].getCovariance(), 1e-10));
+    }
+
+    /** Deltas of another size are refused **/
+    localization::TransformBatch deltas(trajectories - 1), unchanged(poses);
+    localization::composePoses(poses, deltas, 2);
+    localization::composePoses(poses, deltas, 0, trajectories);
+    BOOST_CHECK(poses.position == unchanged.position);
+    BOOST_CHECK(poses.orientation == unchanged.orientation);
+    BOOST_CHECK(poses.cov == unchanged.cov);
+}
+
+/** Smooth body velocity for the adaptive dead reckoning **/
+struct SmoothVelocity
+{
+    void operator()(const double t, Eigen::Matrix<double, 6, 1> &velocity, Covariance &cov) const
+    {
+        velocity << 1.0 + 0.5 * sin(t), 0.2 * cos(t), 0.1 * t, 0.1 * sin(0.5 * t), 0.05 + 0.02 * t, 0.3 * cos(0.3 * t);
+        cov = 1e-04 * Covariance::Identity();
+    }
+};
+
+BOOST_AUTO_TEST_CASE( DEAD_RECKON_ADAPTIVE )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    typedef localization::DeadReckon DR;
+
+    /** No samples: no motion **/
+    localization::VelocityInterpolation circle;
+    Eigen::Matrix<double, 6, 1> twist;
+    Covariance twist_cov;
+    circle(1.0, twist, twist_cov);
+    BOOST_CHECK(twist.isZero() && twist_cov.isZero());
+
+    /** Constant twist: a circle, exact in one step **/
+    twist << 1.0, 0.0, 0.0, 0.0, 0.0, 0.1;
+    circle.push(0.0, twist, 1e-04 * Covariance::Identity());
+    TWU adaptive, fixed(TWU::Identity()), post;
+    BOOST_CHECK_EQUAL(DR::updatePoseAdaptive(circle, 0.0, 2.0, 1e-06, 0.01, TWU::Identity(), adaptive), 1);
+    BOOST_CHECK((adaptive.getTransform().translation() - Eigen::Vector3d(sin(0.2) / 0.1, (1.0 - cos(0.2)) / 0.1, 0.0)).norm() < 1e-12);
+    BOOST_CHECK_SMALL(adaptive.getQuaternion().angularDistance(Eigen::Quaterniond(Eigen::AngleAxisd(0.2, Eigen::Vector3d::UnitZ()))), 1e-12);
+
+    /** The covariance grows as with updatePose at every sample, with the
+     * cross terms of the rotation and the translation, up to the second
+     * order terms of the compositions **/
+    for (register int k=0; k<200; ++k)
+    {
+        DR::updatePose(0.01, twist, twist, 1e-04 * Covariance::Identity(), fixed, post);
+        fixed = post;
+    }
+    BOOST_CHECK(adaptive.getCovariance().isApprox(fixed.getCovariance(), 1e-02));
+    const Eigen::Matrix3d cross = fixed.getCovariance().bottomLeftCorner<3,3>();
+    BOOST_CHECK(cross.norm() > 0.1 * fixed.getCovariance().norm());
+    BOOST_CHECK((adaptive.getCovariance().bottomLeftCorner<3,3>() - cross).norm() < 2e-02 * cross.norm());
+
+    /** It does not depend on the step sizes **/
+    TWU small_steps;
+    BOOST_CHECK(DR::updatePoseAdaptive(circle, 0.0, 2.0, 1e-16, 0.01, TWU::Identity(), small_steps, 0.01) >= 200);
+    BOOST_CHECK(small_steps.getCovariance().isApprox(adaptive.getCovariance(), 1e-02));
+
+    /** Smooth motion in few steps within the tolerance **/
+    SmoothVelocity smooth;
+    TWU reference;
+    DR::updatePoseAdaptive(smooth, 0.0, 10.0, 1e-10, 0.01, TWU::Identity(), reference);
+    const unsigned int steps = DR::updatePoseAdaptive(smooth, 0.0, 10.0, 1e-05, 0.01, TWU::Identity(), adaptive);
+    BOOST_CHECK(steps < 50);
+    BOOST_CHECK((adaptive.getTransform().translation() - reference.getTransform().translation()).norm() < 1e-05);
+    BOOST_CHECK_SMALL(adaptive.getQuaternion().angularDistance(reference.getQuaternion()), 1e-05);
+
+    /** Interpolated samples **/
+    localization::VelocityInterpolation samples;
+    Eigen::Matrix<double, 6, 1> velocity;
+    Covariance cov;
+    for (register int k=0; k<=100; ++k)
+    {
+        smooth(0.1 * k, velocity, cov);
+        samples.push(0.1 * k, velocity, cov);
+    }
+    Eigen::Matrix<double, 6, 1> previous, next;
+    smooth(0.1, previous, cov);
+    smooth(0.2, next, cov);
+    samples(0.125, velocity, cov);
+    BOOST_CHECK(velocity.isApprox(0.75 * previous + 0.25 * next, 1e-12));
+    DR::updatePoseAdaptive(samples, 0.0, 10.0, 1e-05, 0.01, TWU::Identity(), adaptive);
+    BOOST_CHECK((adaptive.getTransform().translation() - reference.getTransform().translation()).norm() < 1e-03);
+}
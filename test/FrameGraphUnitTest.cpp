@@ -0,0 +1,55 @@
+#define BOOST_TEST_MODULE template_for_test_test
+#include <boost/test/included/unit_test.hpp>
+
+/** Library **/
+#include <localization/core/FrameGraph.hpp> /** Tree of frames with cached compositions */
+
+/** Eigen **/
+#include <Eigen/Core> /** Core */
+
+/** Standard libs **/
+#include <iostream>
+
+typedef Eigen::Matrix<double, 6, 6> Covariance;
+
+localization::TransformWithUncertainty randomTransform(const double angle)
+{
+    Covariance A = Covariance::Random();
+    Eigen::Affine3d trans(Eigen::AngleAxisd(angle, Eigen::Vector3d::Random().normalized()));
+    trans.translation() = Eigen::Vector3d::Random();
+    return localization::TransformWithUncertainty(trans, 0.01 * A * A.transpose() + 1e-03 * Covariance::Identity());
+}
+
+BOOST_AUTO_TEST_CASE( FRAME_GRAPH )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    TWU body2world = randomTransform(0.4), camera2body = randomTransform(0.2), imu2body = randomTransform(0.1);
+
+    localization::FrameGraph graph;
+    BOOST_CHECK(graph.addFrame("world"));
+    BOOST_CHECK(graph.addFrame("body", "world", body2world));
+    BOOST_CHECK(graph.addFrame("camera", "body", camera2body));
+    BOOST_CHECK(graph.addFrame("imu", "body", imu2body));
+    BOOST_CHECK(graph.addFrame("map"));
+    BOOST_CHECK(!graph.addFrame("camera", "body", camera2body));
+    BOOST_CHECK(!graph.addFrame("laser", "unknown", camera2body));
+
+    TWU result;
+    BOOST_CHECK(graph.getTransform("camera", "world", result));
+    BOOST_CHECK(result.getCovariance().isApprox((body2world * camera2body).getCovariance(), 1e-12));
+
+    /** Through the common ancestor body, world does not add uncertainty **/
+    BOOST_CHECK(graph.getTransform("imu", "camera", result));
+    BOOST_CHECK(result.getCovariance().isApprox((camera2body.inverse() * imu2body).getCovariance(), 1e-12));
+    BOOST_CHECK(result.getTransform().isApprox(camera2body.getTransform().inverse() * imu2body.getTransform(), 1e-12));
+
+    /** Updating an edge invalidates the cached paths below it **/
+    body2world = randomTransform(0.3);
+    BOOST_CHECK(graph.updateTransform("body", body2world));
+    BOOST_CHECK(graph.getTransform(graph.getFrameId("camera"), graph.getFrameId("world"), result));
+    BOOST_CHECK(result.getCovariance().isApprox((body2world * camera2body).getCovariance(), 1e-12));
+
+    BOOST_CHECK(!graph.updateTransform("world", body2world));
+    BOOST_CHECK(!graph.getTransform("camera", "map", result));
+    BOOST_CHECK_EQUAL(graph.size(), 5);
+}
@@ -0,0 +1,116 @@
+#define BOOST_TEST_MODULE template_for_test_test
+#include <boost/test/included/unit_test.hpp>
+#include <boost/bind.hpp>
+
+/** Library **/
+#include <localization/filters/Msckf.hpp> /** MSCKF_DYNAMIC class with Manifolds */
+#include <localization/filters/MtkWrap.hpp> /** USCKF_DYNAMIC wrapper for the state vector */
+#include <localization/filters/State.hpp> /** Filters State */
+#include <localization/filters/Functors.hpp> /** Process model functors */
+#include <localization/Configuration.hpp> /** Constant values of the library */
+
+/** Rock Types **/
+#include <base/Time.hpp>
+
+/** Eigen **/
+#include <Eigen/Core> /** Core */
+
+/** Standard libs **/
+#include <iostream>
+#include <vector>
+
+/** Wrap the Multi State **/
+typedef localization::MtkWrap<localization::State> WSingleState;
+typedef localization::MtkDynamicWrap< localization::MultiState<localization::State, localization::SensorState> > WMultiState;
+typedef localization::Msckf<WMultiState, WSingleState> MultiStateFilter;
+
+#define NUMBER_ITERATIONS 10000
+
+/** Process model returning the propagated state (boost::bind path) **/
+WSingleState processModel (const WSingleState &state,  const Eigen::Vector3d &delta_position, const localization::SO3 &delta_orientation,
+                            const Eigen::Vector3d &velocity, const Eigen::Vector3d &angular_velocity)
+{
+    WSingleState s2; /** Propagated state */
+
+    /** Apply Rotation **/
+    s2.orient = state.orient * delta_orientation;
+    s2.angvelo = angular_velocity;
+
+    /** Apply Translation **/
+    s2.pos = state.pos + (s2.orient * delta_position);
+    s2.velo = velocity;
+
+    return s2;
+};
+
+/** Same process model as an in-place function object (direct path) **/
+struct InPlaceProcessModel
+{
+    Eigen::Vector3d delta_position;
+    localization::SO3 delta_orientation;
+    Eigen::Vector3d velocity;
+    Eigen::Vector3d angular_velocity;
+
+    void operator()(const WSingleState &state, WSingleState &s2) const
+    {
+        /** Apply Rotation **/
+        s2.orient = state.orient * delta_orientation;
+        s2.angvelo = angular_velocity;
+
+        /** Apply Translation **/
+        s2.pos = state.pos + (s2.orient * delta_position);
+        s2.velo = velocity;
+    }
+};
+
+BOOST_AUTO_TEST_CASE( PREDICT_BIND_VS_DIRECT )
+{
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> MultiStateCovariance;
+    typedef MultiStateFilter::SingleStateCovariance SingleStateCovariance;
+    const unsigned int number_sensor_poses = 4;
+
+    WMultiState statek_0;
+    MultiStateCovariance Pk_0;
+    Pk_0.resize(WSingleState::DOF + WMultiState::SENSOR_DOF * number_sensor_poses, WSingleState::DOF + WMultiState::SENSOR_DOF * number_sensor_poses);
+    Pk_0 = 0.025 * Pk_0.setIdentity();
+
+    SingleStateCovariance cov_process;
+    cov_process = 1e-06 * SingleStateCovariance::Identity();
+
+    InPlaceProcessModel model;
+    model.delta_position << 0.01, 0.01, 0.01;
+    model.delta_orientation = localization::SO3(Eigen::AngleAxisd(0.1 * localization::D2R, Eigen::Vector3d::UnitZ()));
+    model.velocity << 0.1, 0.1, 0.1;
+    model.angular_velocity << 0.01, 0.01, 0.01;
+
+    MultiStateFilter bind_filter(statek_0, Pk_0);
+    MultiStateFilter direct_filter(statek_0, Pk_0);
+
+    /** boost::bind path **/
+    base::Time start = base::Time::now();
+    for (register int i=0; i<NUMBER_ITERATIONS; ++i)
+    {
+        bind_filter.predict(boost::bind(processModel, _1,
+                            static_cast<const Eigen::Vector3d>(model.delta_position),
+                            static_cast<const localization::SO3>(model.delta_orientation),
+                            static_cast<const Eigen::Vector3d>(model.velocity),
+                            static_cast<const Eigen::Vector3d>(model.angular_velocity)),
+                            cov_process);
+    }
+    base::Time bind_time = base::Time::now() - start;
+
+    /** Direct in-place path **/
+    start = base::Time::now();
+    for (register int i=0; i<NUMBER_ITERATIONS; ++i)
+    {
+        direct_filter.predict(localization::inPlace(model), cov_process);
+    }
+    base::Time direct_time = base::Time::now() - start;
+
+    BOOST_TEST_MESSAGE("[BENCHMARK] "<<NUMBER_ITERATIONS<<" predictions with boost::bind: "<<bind_time.toSeconds()<<" [s]");
+    BOOST_TEST_MESSAGE("[BENCHMARK] "<<NUMBER_ITERATIONS<<" predictions with in-place functor: "<<direct_time.toSeconds()<<" [s]");
+
+    /** Both paths have to give the same estimate **/
+    BOOST_CHECK(bind_filter.muSingleState() == direct_filter.muSingleState());
+    BOOST_CHECK(bind_filter.getPkSingleState().isApprox(direct_filter.getPkSingleState(), 1e-09));
+}
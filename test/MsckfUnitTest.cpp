@@ -20,6 +20,7 @@
 /** Standard libs **/
 #include <iostream>
 #include <vector>
+#include <cstdio> /** std::remove */
 
 /** Wrap the Multi State **/
 typedef localization::MtkWrap<localization::State> WSingleState;
@@ -119,6 +120,147 @@ BOOST_AUTO_TEST_CASE( OPERATIONS )
    // BOOST_TEST_MESSAGE("[OPERATIONS] mstatebis = mstate\n"<< mstatebis );
 }
 
+BOOST_AUTO_TEST_CASE( MULTI_STATE_ROUND_TRIP )
+{
+    /** More sensor poses than one lane of the batched SO3 kernels **/
+    const unsigned int number_sensor_poses = 11;
+
+    WMultiState mstate, mstatebis;
+    mstate.statek.pos = Eigen::Vector3d::Random();
+    mstate.statek.orient = localization::SO3::exp(Eigen::Vector3d::Random(), 1);
+    mstate.statek.velo = Eigen::Vector3d::Random();
+    mstate.statek.angvelo = Eigen::Vector3d::Random();
+    mstatebis.statek.pos = Eigen::Vector3d::Random();
+    mstatebis.statek.orient = localization::SO3::exp(Eigen::Vector3d::Random(), 1);
+
+    for (unsigned int i = 0; i < number_sensor_poses; ++i)
+    {
+        mstate.sensorsk.push_back(localization::SensorState(Eigen::Vector3d::Random(),
+                    localization::SO3::exp(Eigen::Vector3d::Random(), 1)));
+        mstatebis.sensorsk.push_back(localization::SensorState(Eigen::Vector3d::Random(),
+                    localization::SO3::exp(Eigen::Vector3d::Random(), 1)));
+    }
+
+    BOOST_CHECK(mstate.getVectorizedState().size() == mstate.getDOF());
+    BOOST_CHECK(mstate.getDOF() == WSingleState::DOF + WMultiState::SENSOR_DOF * number_sensor_poses);
+
+    /** boxminus then boxplus gives back the original state **/
+    const WMultiState::vectorized_type delta = mstate - mstatebis;
+    BOOST_CHECK(delta.size() == mstate.getDOF());
+    BOOST_CHECK(mstate == mstatebis + delta);
+
+    /** boxplus with a MultiState applies its tangent vector **/
+    WMultiState delta_state;
+    delta_state.sensorsk.resize(number_sensor_poses);
+    delta_state.set(delta);
+    BOOST_CHECK((delta_state.getVectorizedState() - delta).isZero(1e-12));
+    BOOST_CHECK(mstate == mstatebis + delta_state);
+}
+
+BOOST_AUTO_TEST_CASE( SO3_BATCH )
+{
+    typedef localization::SO3Batch<double> SO3Batch;
+
+    /** Small angles (series path), regular angles, angles around pi and
+     * beyond, in every quadrant of the reduction of the half angle **/
+    const double angles[] = {0.0, 1e-12, 1e-8, 1e-5, 1e-3, 0.5, 2.0,
+                            M_PI - 1e-6, M_PI, M_PI + 1e-6, 1e-4, 3.0, M_PI - 1e-3,
+                            4.0, 5.5, 2.0 * M_PI, 9.0, 100.0};
+    const int number_angles = sizeof(angles) / sizeof(angles[0]);
+
+    /** Full lanes plus a partial one, and a single partial lane **/
+    const int sizes[] = {number_angles, 3};
+    for (int s = 0; s < 2; ++s)
+    {
+        const int n = sizes[s];
+        Eigen::Matrix<double, 3, Eigen::Dynamic> rotvec(3, n), rotvec_batch(3, n);
+        Eigen::Matrix<double, 4, Eigen::Dynamic> quat(4, n);
+
+        for (int i = 0; i < n; ++i)
+        {
+            rotvec.col(i) = angles[i] * Eigen::Vector3d::Random().normalized();
+        }
+
+        SO3Batch::exp(rotvec, 1, quat);
+        SO3Batch::log(quat, 1, rotvec_batch);
+
+        for (int i = 0; i < n; ++i)
+        {
+            const localization::SO3 q = localization::SO3::exp(rotvec.col(i), 1);
+            BOOST_CHECK_SMALL((quat.col(i) - q.coeffs()).norm(), 1e-12);
+
+            const Eigen::Vector3d r = localization::SO3::log(q);
+            BOOST_CHECK_SMALL((rotvec_batch.col(i) - r).norm(), 1e-9);
+        }
+
+        /** Scaled exp **/
+        SO3Batch::exp(rotvec, -0.5, quat);
+        for (int i = 0; i < n; ++i)
+        {
+            const localization::SO3 q = localization::SO3::exp(rotvec.col(i), -0.5);
+            BOOST_CHECK_SMALL((quat.col(i) - q.coeffs()).norm(), 1e-12);
+        }
+        SO3Batch::exp(rotvec, 1, quat);
+
+        /** log of -q is the same rotation **/
+        quat = -quat;
+        SO3Batch::log(quat, 1, rotvec_batch);
+        for (int i = 0; i < n; ++i)
+        {
+            const Eigen::Vector3d r = localization::SO3::log(localization::SO3::exp(rotvec.col(i), 1));
+            BOOST_CHECK_SMALL((rotvec_batch.col(i) - r).norm(), 1e-9);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( SIGMA_POINTS_BATCH )
+{
+    const unsigned int number_sensor_poses = 5;
+    const int number_points = 21;
+
+    WSingleState state;
+    state.pos = Eigen::Vector3d::Random();
+    state.orient = localization::SO3::exp(Eigen::Vector3d::Random(), 1);
+    state.velo = Eigen::Vector3d::Random();
+    state.angvelo = Eigen::Vector3d::Random();
+
+    WMultiState mstate;
+    mstate.statek = state;
+    for (unsigned int i = 0; i < number_sensor_poses; ++i)
+    {
+        mstate.sensorsk.push_back(localization::SensorState(Eigen::Vector3d::Random(),
+                    localization::SO3::exp(Eigen::Vector3d::Random(), 1)));
+    }
+
+    /** Single state: batched boxplus/boxminus against the operators **/
+    WSingleState::vectorized_points_type deltas = WSingleState::vectorized_points_type::Random(int(WSingleState::DOF), number_points);
+    std::vector<WSingleState> X(number_points);
+    WSingleState::boxplusSigmaPoints(state, deltas, X);
+
+    WSingleState::vectorized_points_type back;
+    WSingleState::boxminusSigmaPoints(X, state, back);
+    for (int i = 0; i < number_points; ++i)
+    {
+        BOOST_CHECK(X[i] == state + WSingleState::vectorized_type(deltas.col(i)));
+        BOOST_CHECK_SMALL((back.col(i) - (X[i] - state)).norm(), 1e-12);
+    }
+    BOOST_CHECK_SMALL((back - deltas).norm(), 1e-9);
+
+    /** Multi state **/
+    WMultiState::vectorized_points_type mdeltas = WMultiState::vectorized_points_type::Random(mstate.getDOF(), number_points);
+    std::vector<WMultiState> MX(number_points);
+    WMultiState::boxplusSigmaPoints(mstate, mdeltas, MX);
+
+    WMultiState::vectorized_points_type mback;
+    WMultiState::boxminusSigmaPoints(MX, mstate, mback);
+    for (int i = 0; i < number_points; ++i)
+    {
+        BOOST_CHECK(MX[i] == mstate + WMultiState::vectorized_type(mdeltas.col(i)));
+        BOOST_CHECK_SMALL((mback.col(i) - (MX[i] - mstate)).norm(), 1e-12);
+    }
+    BOOST_CHECK_SMALL((mback - mdeltas).norm(), 1e-9);
+}
+
 BOOST_AUTO_TEST_CASE( MATRIX_OPERATIONS )
 {
 
@@ -232,3 +374,38 @@ BOOST_AUTO_TEST_CASE( MSCKF )
 
 
 }
+
+BOOST_AUTO_TEST_CASE( MSCKF_CHECKPOINT )
+{
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> MultiStateCovariance;
+    const unsigned int number_sensor_poses = 4;
+    const std::string filename = "msckf_checkpoint.bin";
+
+    WMultiState statek_0;
+    statek_0.statek.pos << 1.0, 2.0, 3.0;
+    statek_0.statek.orient = localization::SO3(Eigen::AngleAxisd(10.0 * localization::D2R, Eigen::Vector3d::UnitZ()));
+    for (register unsigned int i=0; i<number_sensor_poses; ++i)
+    {
+        localization::SensorState sensor;
+        sensor.pos << i, -1.0 * i, 0.5 * i;
+        sensor.orient = localization::SO3(Eigen::AngleAxisd(i * localization::D2R, Eigen::Vector3d::UnitX()));
+        statek_0.sensorsk.push_back(sensor);
+    }
+
+    MultiStateCovariance Pk_0 = MultiStateCovariance::Random(statek_0.getDOF(), statek_0.getDOF());
+    Pk_0 = Pk_0 * Pk_0.transpose();
+
+    MultiStateFilter filter(statek_0, Pk_0);
+    BOOST_CHECK(filter.saveCheckpoint(filename));
+
+    /** Restore in a filter with an empty window **/
+    MultiStateFilter restored(WMultiState(), MultiStateCovariance::Identity(WSingleState::DOF, WSingleState::DOF));
+    BOOST_CHECK(restored.loadCheckpoint(filename));
+
+    BOOST_CHECK_EQUAL(restored.muState().sensorsk.size(), number_sensor_poses);
+    BOOST_CHECK((restored.muState() - filter.muState()).norm() < 1e-12);
+    BOOST_CHECK(restored.getPk() == filter.getPk());
+
+    BOOST_CHECK(!restored.loadCheckpoint("non_existing_checkpoint.bin"));
+    std::remove(filename.c_str());
+}
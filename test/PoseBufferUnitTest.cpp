@@ -0,0 +1,73 @@
+#define BOOST_TEST_MODULE template_for_test_test
+#include <boost/test/included/unit_test.hpp>
+
+/** Library **/
+#include <localization/core/PoseBuffer.hpp> /** Timestamped poses with interpolation */
+
+/** Eigen **/
+#include <Eigen/Core> /** Core */
+
+/** Standard libs **/
+#include <iostream>
+#include <vector>
+
+typedef Eigen::Matrix<double, 6, 6> Covariance;
+
+localization::TransformWithUncertainty randomTransform(const double angle)
+{
+    Covariance A = Covariance::Random();
+    Eigen::Affine3d trans(Eigen::AngleAxisd(angle, Eigen::Vector3d::Random().normalized()));
+    trans.translation() = Eigen::Vector3d::Random();
+    return localization::TransformWithUncertainty(trans, 0.01 * A * A.transpose() + 1e-03 * Covariance::Identity());
+}
+
+BOOST_AUTO_TEST_CASE( POSE_BUFFER )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    localization::PoseBuffer buffer(4);
+    TWU pose;
+    base::Time first, last;
+
+    BOOST_CHECK(!buffer.interpolate(base::Time::fromMicroseconds(0), pose));
+    BOOST_CHECK(!buffer.getTimeRange(first, last));
+
+    std::vector<TWU> poses;
+    for (register int i=0; i<6; ++i)
+    {
+        poses.push_back(randomTransform(0.5));
+        BOOST_CHECK(buffer.push(base::Time::fromMicroseconds(1000 * i), poses.back()));
+    }
+    BOOST_CHECK(!buffer.push(base::Time::fromMicroseconds(5000), poses.back()));
+
+    /** The oldest poses were overwritten **/
+    BOOST_CHECK_EQUAL(buffer.size(), 4);
+    BOOST_CHECK(buffer.getTimeRange(first, last));
+    BOOST_CHECK_EQUAL(first.toMicroseconds(), 2000);
+    BOOST_CHECK_EQUAL(last.toMicroseconds(), 5000);
+    BOOST_CHECK(!buffer.interpolate(base::Time::fromMicroseconds(1500), pose));
+    BOOST_CHECK(!buffer.interpolate(base::Time::fromMicroseconds(5001), pose));
+
+    /** Exactly on a sample **/
+    BOOST_CHECK(buffer.interpolate(base::Time::fromMicroseconds(3000), pose));
+    BOOST_CHECK(pose.getTransform().isApprox(poses[3].getTransform(), 1e-12));
+    BOOST_CHECK(pose.getCovariance().isApprox(poses[3].getCovariance(), 1e-12));
+
+    /** Between samples **/
+    const double alpha = 0.25;
+    BOOST_CHECK(buffer.interpolate(base::Time::fromMicroseconds(4250), pose));
+    Eigen::Quaterniond q = poses[4].getQuaternion().slerp(alpha, poses[5].getQuaternion());
+    BOOST_CHECK((pose.getQuaternion().isApprox(q, 1e-12) || pose.getQuaternion().coeffs().isApprox(-q.coeffs(), 1e-12)));
+    BOOST_CHECK(pose.getTransform().translation().isApprox((1.0 - alpha) * poses[4].getTransform().translation()
+                + alpha * poses[5].getTransform().translation(), 1e-12));
+    Eigen::Matrix3d translation_cov = (1.0 - alpha) * (1.0 - alpha) * poses[4].getCovariance().bottomRightCorner<3,3>()
+        + alpha * alpha * poses[5].getCovariance().bottomRightCorner<3,3>();
+    Eigen::Matrix3d interpolated_cov = pose.getCovariance().bottomRightCorner<3,3>();
+    BOOST_CHECK(interpolated_cov.isApprox(translation_cov, 1e-12));
+
+    BOOST_CHECK(buffer.getLatest(last, pose));
+    BOOST_CHECK_EQUAL(last.toMicroseconds(), 5000);
+
+    buffer.clear();
+    BOOST_CHECK_EQUAL(buffer.size(), 0);
+    BOOST_CHECK(buffer.push(base::Time::fromMicroseconds(0), poses[0]));
+}
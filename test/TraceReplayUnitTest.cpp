@@ -0,0 +1,173 @@
+#define BOOST_TEST_MODULE template_for_test_test
+#include <boost/test/included/unit_test.hpp>
+#include <boost/shared_ptr.hpp> /** For shared pointers **/
+
+/** Library **/
+#include <localization/filters/Msckf.hpp> /** MSCKF_DYNAMIC class with Manifolds */
+#include <localization/filters/MtkWrap.hpp> /** USCKF_DYNAMIC wrapper for the state vector */
+#include <localization/filters/State.hpp> /** Filters State */
+#include <localization/filters/Functors.hpp> /** Process model functors */
+#include <localization/tools/TraceLog.hpp> /** Trace writer and reader */
+#include <localization/tools/TraceReplay.hpp> /** Trace replay */
+#include <localization/Configuration.hpp> /** Constant values of the library */
+
+/** Rock Types **/
+#include <base/Time.hpp>
+
+/** Eigen **/
+#include <Eigen/Core> /** Core */
+
+/** Standard libs **/
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdio> /** std::remove */
+
+/** Wrap the Multi State **/
+typedef localization::MtkWrap<localization::State> WSingleState;
+typedef localization::MtkDynamicWrap< localization::MultiState<localization::State, localization::SensorState> > WMultiState;
+typedef localization::Msckf<WMultiState, WSingleState> MultiStateFilter;
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> MultiStateCovariance;
+
+#define NUMBER_STEPS 100
+#define UPDATE_PERIOD 10
+#define NUMBER_UPDATES (NUMBER_STEPS / UPDATE_PERIOD)
+
+/** Process model with the input u = [delta_position, delta_orientation, velocity, angular_velocity] **/
+struct ProcessModel
+{
+    Eigen::Matrix<double, 12, 1> u;
+
+    void operator()(const WSingleState &state, WSingleState &s2) const
+    {
+        s2.orient = state.orient * localization::SO3::exp(u.segment<3>(3));
+        s2.angvelo = u.segment<3>(9);
+        s2.pos = state.pos + (s2.orient * u.segment<3>(0));
+        s2.velo = u.segment<3>(6);
+    }
+};
+
+/** Replay handler owning the filter, the measurements are only collected **/
+struct MsckfReplay
+{
+    boost::shared_ptr<MultiStateFilter> filter;
+    double max_reference_error;
+
+    std::vector<uint32_t> update_channels;
+    std::vector<base::Time> update_times;
+    std::vector<Eigen::MatrixXd> measurements, measurement_noises;
+
+    MsckfReplay(const WMultiState &statek_0, const MultiStateCovariance &Pk_0)
+        : filter(new MultiStateFilter(statek_0, Pk_0)), max_reference_error(0.00)
+    {
+    }
+
+    void predict(const uint32_t, const base::Time &,
+            const localization::TraceRecord::ConstMatrixMap &u, const localization::TraceRecord::ConstMatrixMap &Q)
+    {
+        ProcessModel model;
+        model.u = u;
+        filter->predict(localization::inPlace(model), MultiStateFilter::SingleStateCovariance(Q));
+    }
+
+    void update(const uint32_t channel, const base::Time &time,
+            const localization::TraceRecord::ConstMatrixMap &z, const localization::TraceRecord::ConstMatrixMap &R)
+    {
+        update_channels.push_back(channel);
+        update_times.push_back(time);
+        measurements.push_back(z);
+        measurement_noises.push_back(R);
+    }
+
+    void estimation(const localization::StateEstimation &reference)
+    {
+        const double error = (reference.statek_i - filter->muSingleState().getVectorizedState()).norm();
+        max_reference_error = std::max(max_reference_error, error);
+    }
+};
+
+BOOST_AUTO_TEST_CASE( TRACE_RECORD_AND_REPLAY )
+{
+    const std::string filename = "msckf_trace.bin";
+    const unsigned int number_sensor_poses = 2;
+
+    WMultiState statek_0;
+    statek_0.sensorsk.resize(number_sensor_poses);
+    MultiStateCovariance Pk_0 = 0.025 * MultiStateCovariance::Identity(statek_0.getDOF(), statek_0.getDOF());
+
+    MultiStateFilter::SingleStateCovariance cov_process;
+    cov_process = 1e-06 * MultiStateFilter::SingleStateCovariance::Identity();
+
+    /** Run the filter and record its inputs and outputs **/
+    MultiStateFilter filter(statek_0, Pk_0);
+    localization::TraceWriter writer;
+    BOOST_CHECK(writer.open(filename, 4096));
+
+    /** Measurements written between the predictions **/
+    std::vector<base::Time> update_times;
+    std::vector<Eigen::MatrixXd> measurements, measurement_noises;
+
+    base::Time time = base::Time::fromMicroseconds(1000000);
+    for (register int i=0; i<NUMBER_STEPS; ++i)
+    {
+        ProcessModel model;
+        model.u = 0.01 * Eigen::Matrix<double, 12, 1>::Random();
+        time = time + base::Time::fromMicroseconds(10000);
+
+        filter.predict(localization::inPlace(model), cov_process);
+
+        localization::StateEstimation output;
+        output.time = time;
+        output.statek_i = filter.muSingleState().getVectorizedState();
+        output.Pki = filter.getPkSingleState();
+
+        BOOST_CHECK(writer.predict(0, time, model.u, cov_process));
+        BOOST_CHECK(writer.estimation(output));
+
+        if (i % UPDATE_PERIOD == 0)
+        {
+            Eigen::Matrix<double, 3, 3> A = Eigen::Matrix<double, 3, 3>::Random();
+            Eigen::Matrix<double, 3, 1> z = Eigen::Matrix<double, 3, 1>::Random();
+            Eigen::Matrix<double, 3, 3> R = A * A.transpose();
+            BOOST_CHECK(writer.update(1, time, z, R));
+            update_times.push_back(time);
+            measurements.push_back(z);
+            measurement_noises.push_back(R);
+        }
+    }
+    writer.close();
+
+    /** Replay one trace **/
+    MsckfReplay replay(statek_0, Pk_0);
+    BOOST_CHECK_EQUAL(localization::replayTrace(filename, replay), NUMBER_STEPS + NUMBER_UPDATES);
+    BOOST_CHECK(replay.max_reference_error < 1e-12);
+
+    /** The measurements come back in order, bit for bit **/
+    BOOST_CHECK_EQUAL(replay.measurements.size(), NUMBER_UPDATES);
+    for (register size_t i=0; i<replay.measurements.size() && i<measurements.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(replay.update_channels[i], 1u);
+        BOOST_CHECK(replay.update_times[i] == update_times[i]);
+        BOOST_CHECK(replay.measurements[i] == measurements[i]);
+        BOOST_CHECK(replay.measurement_noises[i] == measurement_noises[i]);
+    }
+    BOOST_CHECK((replay.filter->muState() - filter.muState()).norm() < 1e-12);
+    BOOST_CHECK(replay.filter->getPk().isApprox(filter.getPk(), 1e-12));
+
+    /** Replay the same trace several times in parallel **/
+    std::vector<std::string> filenames(4, filename);
+    std::vector<MsckfReplay> replays(filenames.size(), MsckfReplay(statek_0, Pk_0));
+    for (std::vector<MsckfReplay>::iterator it = replays.begin(); it != replays.end(); ++it)
+        it->filter.reset(new MultiStateFilter(statek_0, Pk_0));
+
+    std::vector<int> results = localization::replayTraces(filenames, replays);
+    for (register size_t i=0; i<replays.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(results[i], NUMBER_STEPS + NUMBER_UPDATES);
+        BOOST_CHECK(replays[i].max_reference_error < 1e-12);
+        BOOST_CHECK_EQUAL(replays[i].measurements.size(), NUMBER_UPDATES);
+    }
+
+    BOOST_CHECK_EQUAL(localization::replayTrace("non_existing_trace.bin", replay), -1);
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,287 @@
+#define BOOST_TEST_MODULE template_for_test_test
+#include <boost/test/included/unit_test.hpp>
+
+/** Library **/
+#include <localization/core/TransformImpl.hpp> /** Transform with uncertainty for any scalar type */
+#include <localization/core/TransformBatch.hpp> /** Structure of arrays of transforms and points */
+
+/** Eigen **/
+#include <Eigen/Core> /** Core */
+#include <Eigen/StdVector> /** For STL container with Eigen types **/
+#include <unsupported/Eigen/AutoDiff> /** Automatic differentiation scalar */
+
+/** Standard libs **/
+#include <iostream>
+
+typedef Eigen::Matrix<double, 6, 6> Covariance;
+typedef Eigen::AutoDiffScalar<Eigen::Vector3d> ADScalar;
+typedef localization::TransformWithUncertaintyT<ADScalar> ADTransform;
+
+localization::TransformWithUncertainty randomTransform(const double angle)
+{
+    Covariance A = Covariance::Random();
+    Eigen::Affine3d trans(Eigen::AngleAxisd(angle, Eigen::Vector3d::Random().normalized()));
+    trans.translation() = Eigen::Vector3d::Random();
+    return localization::TransformWithUncertainty(trans, 0.01 * A * A.transpose() + 1e-03 * Covariance::Identity());
+}
+
+BOOST_AUTO_TEST_CASE( TRANSFORM_FLOAT_DOUBLE )
+{
+    localization::TransformWithUncertainty t1 = randomTransform(0.3), t2 = randomTransform(1.2);
+    localization::TransformWithUncertaintyf t1f = t1.cast<float>(), t2f = t2.cast<float>();
+
+    localization::TransformWithUncertainty t = t2 * t1;
+    localization::TransformWithUncertaintyf tf = t2f * t1f;
+    BOOST_CHECK(tf.getTransform().matrix().cast<double>().isApprox(t.getTransform().matrix(), 1e-05));
+    BOOST_CHECK(tf.getCovariance().cast<double>().isApprox(t.getCovariance(), 1e-04));
+
+    localization::TransformWithUncertaintyf t1f_inv = tf.preCompositionInv(t2f);
+    BOOST_CHECK(t1f_inv.getCovariance().cast<double>().isApprox(t1.getCovariance(), 1e-03));
+
+    localization::PointWithUncertainty p(Eigen::Vector3d(1.0, -2.0, 0.5), 0.1 * Eigen::Matrix3d::Identity());
+    localization::PointWithUncertaintyf pf = (t2f * p.cast<float>());
+    BOOST_CHECK(pf.getCovariance().cast<double>().isApprox((t2 * p).getCovariance(), 1e-04));
+}
+
+BOOST_AUTO_TEST_CASE( TRANSFORM_AUTODIFF )
+{
+    localization::TransformWithUncertainty t1 = randomTransform(0.1), t2 = randomTransform(0.1);
+    ADTransform t1_ad = t1.cast<ADScalar>(), t2_ad = t2.cast<ADScalar>();
+
+    /** Same values as in double **/
+    ADTransform t_ad = t2_ad * t1_ad;
+    localization::TransformWithUncertainty t = t2 * t1;
+    for (register int i=0; i<36; ++i)
+        BOOST_CHECK_CLOSE(t_ad.getCovariance()(i).value(), t.getCovariance()(i), 1e-10);
+
+    /** Derivatives of the translation with respect to the translation of t1 is the rotation of t2 **/
+    Eigen::Matrix<ADScalar, 3, 1> x;
+    for (register int i=0; i<3; ++i)
+        x(i) = ADScalar(t1.getTransform().translation()(i), 3, i);
+    ADTransform::Transform trans = t1_ad.getTransform();
+    trans.translation() = x;
+    t1_ad.setTransform(trans);
+
+    Eigen::Matrix<ADScalar, 3, 1> y = (t2_ad * t1_ad).getTransform().translation();
+    Eigen::Matrix3d J;
+    for (register int i=0; i<3; ++i)
+        J.row(i) = y(i).derivatives().transpose();
+    BOOST_CHECK(J.isApprox(t2.getTransform().linear(), 1e-12));
+
+    /** drx_by_dr is the series approximation of the derivative of R(r) * x **/
+    Eigen::Vector3d r(0.05, -0.1, 0.08), point(1.0, 2.0, -0.5);
+    Eigen::Matrix<ADScalar, 3, 1> r_ad;
+    for (register int i=0; i<3; ++i)
+        r_ad(i) = ADScalar(r(i), 3, i);
+    Eigen::Matrix<ADScalar, 3, 1> rx = localization::detail::r_to_q(r_ad) * point.cast<ADScalar>();
+    for (register int i=0; i<3; ++i)
+        J.row(i) = rx(i).derivatives().transpose();
+    BOOST_CHECK((J - localization::detail::drx_by_dr(r, point)).norm() < 0.05);
+}
+
+BOOST_AUTO_TEST_CASE( TRANSFORM_ADJOINT )
+{
+    typedef Eigen::AutoDiffScalar< Eigen::Matrix<double, 12, 1> > ADScalar12;
+    typedef Eigen::Matrix<ADScalar12, 3, 1> ADVector3;
+    typedef Eigen::Transform<ADScalar12, 3, Eigen::Affine> ADAffine3;
+    typedef localization::TransformWithUncertainty TWU;
+
+    /** Large rotations where the series approximations are not valid **/
+    TWU t2 = randomTransform(2.5), t1 = randomTransform(1.5);
+    Eigen::Matrix<double, 6, 1> p1, p2;
+    p1 << t1.getRotationVector(), t1.getTransform().translation();
+    p2 << t2.getRotationVector(), t2.getTransform().translation();
+
+    /** Jacobian of the composition on [r1 t1 r2 t2] by automatic differentiation **/
+    ADVector3 r1_ad, t1_ad, r2_ad, t2_ad;
+    for (register int i=0; i<3; ++i)
+    {
+        r1_ad(i) = ADScalar12(p1(i), 12, i); t1_ad(i) = ADScalar12(p1(3+i), 12, 3+i);
+        r2_ad(i) = ADScalar12(p2(i), 12, 6+i); t2_ad(i) = ADScalar12(p2(3+i), 12, 9+i);
+    }
+    ADAffine3 T1(localization::detail::r_to_q(r1_ad)), T2(localization::detail::r_to_q(r2_ad));
+    T1.translation() = t1_ad; T2.translation() = t2_ad;
+    ADAffine3 T = T2 * T1;
+    ADVector3 r_ad = localization::detail::q_to_r(Eigen::Quaternion<ADScalar12>(T.linear()));
+
+    Eigen::Matrix<double, 6, 12> J;
+    for (register int i=0; i<3; ++i)
+    {
+        J.row(i) = r_ad(i).derivatives().transpose();
+        J.row(3+i) = T.translation()(i).derivatives().transpose();
+    }
+    Covariance cov = J.leftCols<6>() * t1.getCovariance() * J.leftCols<6>().transpose()
+        + J.rightCols<6>() * t2.getCovariance() * J.rightCols<6>().transpose();
+
+    TWU t = t2.composition(t1, TWU::ADJOINT);
+    BOOST_CHECK(t.getCovariance().isApprox(cov, 1e-10));
+
+    /** Inverse compositions recover the inputs **/
+    BOOST_CHECK(t.compositionInv(t1, TWU::ADJOINT).getCovariance().isApprox(t2.getCovariance(), 1e-10));
+    BOOST_CHECK(t.preCompositionInv(t2, TWU::ADJOINT).getCovariance().isApprox(t1.getCovariance(), 1e-10));
+
+    /** Inverse of the inverse **/
+    BOOST_CHECK(t2.inverse(TWU::ADJOINT).inverse(TWU::ADJOINT).getCovariance().isApprox(t2.getCovariance(), 1e-10));
+}
+
+BOOST_AUTO_TEST_CASE( TRANSFORM_BLOCK_INVERSE )
+{
+    typedef localization::TransformWithUncertainty TWU;
+
+    /** Same as the general inverse of [A 0; C D], D a rotation or the identity **/
+    Eigen::Matrix3d A = Eigen::Matrix3d::Random() + 3.0 * Eigen::Matrix3d::Identity(), C = Eigen::Matrix3d::Random();
+    Eigen::Matrix3d rotation = Eigen::AngleAxisd(0.7, Eigen::Vector3d::Random().normalized()).toRotationMatrix();
+    for (register int i=0; i<2; ++i)
+    {
+        const Eigen::Matrix3d D = (i == 0)? Eigen::Matrix3d::Identity() : rotation;
+        Covariance J;
+        J << A, Eigen::Matrix3d::Zero(), C, D;
+        const Covariance J_inv = localization::detail::block_triangular_inverse<double>(A, C, D.transpose());
+        BOOST_CHECK((J_inv - J.inverse()).norm() < 1e-14 * J.inverse().norm());
+    }
+
+    /** Inverse compositions recover the inputs of the composition **/
+    TWU t1 = randomTransform(0.6), t2 = randomTransform(1.1);
+    TWU t = t2.composition(t1, TWU::PENNEC_THIRION);
+    BOOST_CHECK(t.compositionInv(t1, TWU::PENNEC_THIRION).getCovariance().isApprox(t2.getCovariance(), 1e-12));
+    BOOST_CHECK(t.preCompositionInv(t2, TWU::PENNEC_THIRION).getCovariance().isApprox(t1.getCovariance(), 1e-12));
+}
+
+BOOST_AUTO_TEST_CASE( TRANSFORM_IN_PLACE )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    TWU t2 = randomTransform(0.8), t1 = randomTransform(0.1);
+
+    TWU t = t2;
+    t *= t1;
+    BOOST_CHECK(t.getTransform().isApprox((t2 * t1).getTransform(), 1e-15));
+    BOOST_CHECK(t.getCovariance().isApprox((t2 * t1).getCovariance(), 1e-15));
+
+    /** Rigid body states without correlation between orientation and position **/
+    base::samples::RigidBodyState rbs2, rbs1, result, expected;
+    t2.copyToRigidBodyState(rbs2);
+    t1.copyToRigidBodyState(rbs1);
+    (TWU(rbs2) * TWU(rbs1)).copyToRigidBodyState(expected);
+
+    localization::composition(rbs2, rbs1, result);
+    BOOST_CHECK(result.position.isApprox(expected.position, 1e-12));
+    BOOST_CHECK(result.orientation.isApprox(expected.orientation, 1e-12));
+    BOOST_CHECK(result.cov_position.isApprox(expected.cov_position, 1e-12));
+    BOOST_CHECK(result.cov_orientation.isApprox(expected.cov_orientation, 1e-12));
+}
+
+/** The cached rotations and the Jacobians built from them match the ones
+ * of a transform constructed from scratch **/
+void checkFreshCache(const localization::TransformWithUncertainty &t, const localization::TransformWithUncertainty &t1)
+{
+    const localization::TransformWithUncertainty fresh(t.getTransform(), t.getCovariance());
+    BOOST_CHECK(t.getQuaternion().coeffs() == fresh.getQuaternion().coeffs());
+    BOOST_CHECK(t.getRotationVector() == fresh.getRotationVector());
+    BOOST_CHECK((t * t1).getCovariance() == (fresh * t1).getCovariance());
+    BOOST_CHECK((t1 * t).getCovariance() == (t1 * fresh).getCovariance());
+}
+
+BOOST_AUTO_TEST_CASE( TRANSFORM_CACHE )
+{
+    typedef localization::TransformWithUncertainty TWU;
+    TWU t = randomTransform(0.4), other = randomTransform(1.1), t1 = randomTransform(0.7);
+
+    /** Warm the caches before every change **/
+    t.getRotationVector();
+    t.setTransform(other.getTransform());
+    BOOST_CHECK(t.getQuaternion().isApprox(other.getQuaternion(), 1e-15));
+    checkFreshCache(t, t1);
+
+    base::samples::RigidBodyState rbs;
+    randomTransform(2.0).copyToRigidBodyState(rbs);
+    t.getRotationVector();
+    t = rbs;
+    BOOST_CHECK(t.getQuaternion().isApprox(rbs.orientation, 1e-12));
+    checkFreshCache(t, t1);
+
+    /** Copy of a transform with a cold cache **/
+    t.getRotationVector();
+    t = randomTransform(0.2);
+    checkFreshCache(t, t1);
+
+    t.getRotationVector();
+    const TWU t_before = t;
+    t *= t1;
+    BOOST_CHECK(t.getQuaternion().isApprox((t_before * t1).getQuaternion(), 1e-15));
+    checkFreshCache(t, t1);
+}
+
+BOOST_AUTO_TEST_CASE( TRANSFORM_BATCH_TRAJECTORY )
+{
+    typedef localization::TransformWithUncertainty TWU;
+
+    /** More than one chunk of 256 poses and not a multiple of the lanes **/
+    const size_t number = 2 * 256 + 37;
+    const TWU start = randomTransform(0.5);
+
+    localization::TransformBatch deltas(number);
+    for (register size_t i=0; i<number; ++i)
+        deltas.set(i, randomTransform(0.2));
+
+    localization::TransformBatch poses;
+    localization::composeTrajectory(start, deltas, poses);
+    BOOST_CHECK_EQUAL(poses.size(), number);
+
+    TWU expected = start;
+    for (register size_t i=0; i<number; ++i)
+    {
+        expected = expected * deltas.get(i);
+        const TWU result = poses.get(i);
+        BOOST_CHECK(result.getTransform().isApprox(expected.getTransform(), 1e-10));
+        BOOST_CHECK(result.getCovariance().isApprox(expected.getCovariance(), 1e-10));
+
+        /** Same quaternion as operator*, not only the same rotation **/
+        BOOST_CHECK(poses.orientation.row(i).transpose().isApprox(expected.getQuaternion().coeffs(), 1e-10));
+    }
+
+    const TWU final_pose = localization::composeTrajectory(start, deltas);
+    BOOST_CHECK(final_pose.getTransform().isApprox(expected.getTransform(), 1e-10));
+    BOOST_CHECK(final_pose.getCovariance().isApprox(expected.getCovariance(), 1e-10));
+    BOOST_CHECK(final_pose.getQuaternion().coeffs().isApprox(expected.getQuaternion().coeffs(), 1e-10));
+}
+
+BOOST_AUTO_TEST_CASE( TRANSFORM_BATCH_POINTS )
+{
+    typedef localization::TransformWithUncertainty TWU;
+
+    /** Two threads with more than one chunk of 256 points each **/
+    const size_t number = 1000;
+    const unsigned int number_threads = 2;
+    const TWU trans = randomTransform(0.9);
+
+    for (register int uncertain=0; uncertain<2; ++uncertain)
+    {
+        localization::PointBatch points(number, uncertain);
+        for (register size_t i=0; i<number; ++i)
+        {
+            const Eigen::Matrix3d A = Eigen::Matrix3d::Random();
+            if (uncertain)
+                points.set(i, localization::PointWithUncertainty(10.0 * Eigen::Vector3d::Random(), 0.01 * A * A.transpose()));
+            else
+                points.set(i, localization::PointWithUncertainty(10.0 * Eigen::Vector3d::Random()));
+        }
+
+        localization::PointBatch result;
+        localization::transformPoints(trans, points, result, number_threads);
+        BOOST_CHECK_EQUAL(result.size(), number);
+        BOOST_CHECK(result.hasUncertainty());
+
+        for (register size_t i=0; i<number; ++i)
+        {
+            const localization::PointWithUncertainty expected = trans * points.get(i);
+            const localization::PointWithUncertainty p = result.get(i);
+            BOOST_CHECK(p.getPoint().isApprox(expected.getPoint(), 1e-12));
+            BOOST_CHECK(p.getCovariance().isApprox(expected.getCovariance(), 1e-12));
+        }
+
+        /** In place, the points are read before result is resized **/
+        localization::transformPoints(trans, points, points, number_threads);
+        BOOST_CHECK(points.point.isApprox(result.point, 1e-15));
+        BOOST_CHECK(points.cov.isApprox(result.cov, 1e-15));
+    }
+}
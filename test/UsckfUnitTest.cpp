@@ -14,6 +14,7 @@
 /** Standard libs **/
 #include <iostream>
 #include <vector>
+#include <cstdio> /** std::remove */
 
 std::vector<int> hola(100, 2);
 typedef std::vector< MTK::vect<3, double> > MTKintFeature;
@@ -362,3 +363,35 @@ BOOST_AUTO_TEST_CASE( USCKF_STATIC )
 
 }
 
+BOOST_AUTO_TEST_CASE( USCKF_CHECKPOINT )
+{
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> AugmentedStateCovariance;
+    const std::string filename = "usckf_checkpoint.bin";
+
+    WAugmentedState statek_0;
+    statek_0.statek_i.pos << 1.0, 2.0, 3.0;
+    statek_0.statek_i.orient = localization::SO3(Eigen::AngleAxisd(10.0 * localization::D2R, Eigen::Vector3d::UnitZ()));
+    statek_0.statek.pos << -1.0, 0.5, 0.0;
+    statek_0.featuresk.resize(3, 1);
+    statek_0.featuresk << 3.34, 3.34, 3.34;
+    statek_0.featuresk_l.resize(6, 1);
+    statek_0.featuresk_l << 1.34, 1.34, 1.34, 1.34, 1.34, 1.34;
+
+    AugmentedStateCovariance Pk_0 = AugmentedStateCovariance::Random(statek_0.getDOF(), statek_0.getDOF());
+    Pk_0 = Pk_0 * Pk_0.transpose();
+
+    StateFilterDynamic filter(statek_0, Pk_0);
+    BOOST_CHECK(filter.saveCheckpoint(filename));
+
+    /** Restore in a filter without features **/
+    StateFilterDynamic restored(WAugmentedState(), AugmentedStateCovariance::Identity(WAugmentedState::DOF, WAugmentedState::DOF));
+    BOOST_CHECK(restored.loadCheckpoint(filename));
+
+    BOOST_CHECK_EQUAL(restored.muState().featuresk.size(), statek_0.featuresk.size());
+    BOOST_CHECK_EQUAL(restored.muState().featuresk_l.size(), statek_0.featuresk_l.size());
+    BOOST_CHECK((restored.muState().getVectorizedState() - filter.muState().getVectorizedState()).norm() < 1e-12);
+    BOOST_CHECK(restored.PkAugmentedState() == filter.PkAugmentedState());
+
+    BOOST_CHECK(!restored.loadCheckpoint("non_existing_checkpoint.bin"));
+    std::remove(filename.c_str());
+}